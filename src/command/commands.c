@@ -22,6 +22,12 @@
 
 #include "commands.h"
 
+#include <functions/attrset.h>
+#include <functions/compress.h>
+#include <functions/pathtab.h>
+#include <functions/pool.h>
+#include <functions/trace.h>
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -31,10 +37,32 @@
 #include <netdb.h>
 
 
+#define RIB_SHOW_DEFAULT    20
+
+
+/* send what changed in the local prefix list since it was last originated */
+static void
+originate_local(parser_t *parser)
+{
+    if (!parser->manager || !parser->manager->rib)
+        return;
+
+    int r = rib_originate(parser->manager->rib,
+        prefixlist_get(PREFIXLIST_LOCAL));
+    if (r < 0)
+        fprintf(parser->outf, "rib: could not originate local routes\n");
+    else if (r > 0)
+        fprintf(parser->outf, "rib: %d local routes changed\n", r);
+}
 
 int
 cmd_end(parser_t *parser, int no, char *args)
 {
+    if (parser->state.ctx == CTX_PREFIXLIST ||
+        parser->state.ctx == CTX_ROUTEMAP)
+    {
+        cmd_exit(parser, no, args);
+    }
     parser->state.ctx = CTX_BASE;
     if (parser->state.ctx == CTX_BASE)
         parser->state.enabled = 0;
@@ -47,8 +75,24 @@ cmd_exit(parser_t *parser, int no, char *args)
     switch (parser->state.ctx) {
     case CTX_BASE: parser->state.enabled = 0; break;
     case CTX_CONFIG: parser->state.ctx = CTX_BASE; break;
-    case CTX_PREFIXLIST: parser->state.ctx = CTX_CONFIG; break;
+    case CTX_PREFIXLIST:
+        if (prefixlist_commit(parser->state.plist) < 0)
+            fprintf(parser->outf, "prefix-list: could not compile %s\n",
+                parser->state.plist->name);
+        else if (!parser->state.reloading &&
+            strcmp(parser->state.plist->name, PREFIXLIST_LOCAL) == 0)
+            originate_local(parser);
+        parser->state.ctx = CTX_CONFIG;
+    break;
     case CTX_TRIP: parser->state.ctx = CTX_CONFIG; break;
+    case CTX_ROUTEMAP:
+        /* a reload compiles the maps that changed once it is done */
+        if (!parser->state.reloading &&
+            routemap_commit(parser->state.rmap) < 0)
+            fprintf(parser->outf, "route-map: could not compile %s\n",
+                parser->state.rmap->name);
+        parser->state.ctx = CTX_CONFIG;
+    break;
     default: return -1;
     }
     return 0;
@@ -71,7 +115,155 @@ cmd_configure(parser_t *parser, int no, char *args)
 int
 cmd_show(parser_t *parser, int no, char *args)
 {
-    /* TODO */
+    args = strip(args);
+
+    if (strncmp(args, "trace", 5) == 0) {
+        trace_print(parser->outf, strtoul(strip(args + 5), NULL, 10));
+        return 0;
+    }
+
+    if (strncmp(args, "memory", 6) == 0) {
+        pool_print(parser->outf);
+        return 0;
+    }
+
+    if (strncmp(args, "prefix-list", 11) == 0) {
+        char *name = strip(args + 11);
+        prefixlist_print(parser->outf, *name ? name : NULL);
+        return 0;
+    }
+
+    if (strncmp(args, "route-map", 9) == 0) {
+        char *name = strip(args + 9);
+        routemap_print(parser->outf, *name ? name : NULL);
+        return 0;
+    }
+
+    if (strncmp(args, "trip", 4) == 0) {
+        if (!parser->manager) {
+            fprintf(parser->outf, "bind-address must be set first\n");
+            return -1;
+        }
+
+        args = strip(args + 4);
+        if (strncmp(args, "flooding", 8) == 0) {
+            flood_print(parser->manager->flood, parser->outf);
+            return 0;
+        }
+        if (strncmp(args, "paths", 5) == 0) {
+            pathtab_print(parser->outf);
+            return 0;
+        }
+        if (strncmp(args, "attribute-sets", 14) == 0) {
+            attrset_print(parser->outf);
+            return 0;
+        }
+        if (strncmp(args, "topology", 8) == 0) {
+            topology_print(parser->manager->topology, parser->outf);
+            return 0;
+        }
+        if (strncmp(args, "peers", 5) == 0) {
+            manager_print(parser->manager, parser->outf);
+            return 0;
+        }
+        if (strncmp(args, "rib", 3) == 0) {
+            char *count = strip(args + 3);
+            rib_print(parser->manager->rib, parser->outf,
+                *count ? strtoul(count, NULL, 10) : RIB_SHOW_DEFAULT);
+            return 0;
+        }
+    }
+
+    fprintf(parser->outf, "show: unknown target: %s\n", args);
+    return -1;
+}
+
+int
+cmd_trace(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    char *action = strtok(args, " ");
+    char *path = strtok(NULL, " ");
+
+    if (!action || !path || strcmp(action, "dump") != 0) {
+        fprintf(parser->outf, "trace: usage: trace dump <file>\n");
+        return -1;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(parser->outf, "trace: could not open %s\n", path);
+        return -1;
+    }
+
+    int res = trace_dump(f);
+    fclose(f);
+
+    if (res < 0) {
+        fprintf(parser->outf, "trace: error writing %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+cmd_benchmark(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    char *what = strtok(args, " ");
+    char *name = strtok(NULL, " ");
+    char *count = strtok(NULL, " ");
+
+    if (what && strcmp(what, "memory") == 0) {
+        /* benchmark memory [ops] */
+        size_t ops = name ? strtoul(name, NULL, 10) : 10000000;
+        double rate;
+        uint64_t sys_allocs;
+        if (pool_benchmark(ops, &rate, &sys_allocs) < 0) {
+            fprintf(parser->outf, "benchmark: out of memory\n");
+            return -1;
+        }
+        fprintf(parser->outf, "memory: %zu allocations, %.0f/s, %llu from "
+            "malloc()\n", ops, rate, (unsigned long long)sys_allocs);
+        return 0;
+    }
+
+    routemap_t *rmap = name ? routemap_find(name) : NULL;
+    if (!what || strcmp(what, "route-map") != 0 || !rmap) {
+        fprintf(parser->outf, "benchmark: usage: benchmark route-map "
+            "<name> [routes] | benchmark memory [allocations]\n");
+        return -1;
+    }
+
+    size_t routes = count ? strtoul(count, NULL, 10) : 1000000;
+    double cold, warm;
+    if (routemap_benchmark(rmap, routes, &cold, &warm) < 0) {
+        fprintf(parser->outf, "benchmark: could not build test UPDATE\n");
+        return -1;
+    }
+
+    fprintf(parser->outf, "route-map %s: %zu routes, %.0f routes/s "
+        "decoding each, %.0f routes/s sharing an UPDATE\n", rmap->name,
+        routes, cold, warm);
+    return 0;
+}
+
+int
+cmd_reload(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    const char *path = *args ? args : parser->config_path;
+    if (!path) {
+        fprintf(parser->outf, "reload: usage: reload [file]\n");
+        return -1;
+    }
+    if (parser->state.reloading) {
+        fprintf(parser->outf, "reload: already reloading\n");
+        return -1;
+    }
+
+    return parser_reload(parser, path);
 }
 
 /* config context */
@@ -86,13 +278,27 @@ int
 cmd_config_bind(parser_t *parser, int no, char *args)
 {
     args = strip(args);
+    struct in6_addr addr = parser->listen_addr.sin6_addr;
     parser->listen_addr.sin6_family = AF_INET6;
     parser->listen_addr.sin6_port = htons(PROTO_TCP_PORT);
-    if (inet_pton(AF_INET6, args, &parser->listen_addr.sin6_addr) < 0) {
+    if (inet_pton(AF_INET6, args, &addr) < 0) {
         fprintf(parser->outf, "invalid bind address: %s\n", args);
         return -1;
     }
 
+    /* the listen socket stays, moving it takes a restart */
+    if (parser->manager) {
+        if (memcmp(&addr, &parser->listen_addr.sin6_addr,
+            sizeof(addr)) != 0)
+        {
+            fprintf(parser->outf, "bind-address: change to %s needs a "
+                "restart\n", args);
+            return -1;
+        }
+        return 0;
+    }
+    parser->listen_addr.sin6_addr = addr;
+
     /* create session manager */
     parser->manager = manager_new(&parser->listen_addr);
     if (!parser->manager)
@@ -102,7 +308,58 @@ cmd_config_bind(parser_t *parser, int no, char *args)
 int
 cmd_config_prefixlist(parser_t *parser, int no, char *args)
 {
+    args = strip(args);
+    char *name = strtok(args, " ");
+    if (!name)
+        name = PREFIXLIST_LOCAL;
+
+    if (strlen(name) >= PREFIXLIST_NAME_MAX) {
+        fprintf(parser->outf, "prefix-list: name too long: %s\n", name);
+        return -1;
+    }
+
+    /* the definition replaces the previous one on exit */
+    parser->state.plist = prefixlist_get(name);
+    prefixlist_begin(parser->state.plist);
+
     parser->state.ctx = CTX_PREFIXLIST;
+    return 0;
+}
+
+int
+cmd_config_routemap(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    char *name = strtok(args, " ");
+    char *action = strtok(NULL, " ");
+    char *seq = strtok(NULL, " ");
+
+    /* action defaults to permit */
+    if (action && !seq && action[0] >= '0' && action[0] <= '9') {
+        seq = action;
+        action = NULL;
+    }
+
+    if (!name || strlen(name) >= ROUTEMAP_NAME_MAX ||
+        (action && strcmp(action, "permit") != 0 &&
+        strcmp(action, "deny") != 0))
+    {
+        fprintf(parser->outf, "route-map: usage: route-map <name> "
+            "[permit|deny] [seq]\n");
+        return -1;
+    }
+
+    /* the clause is replaced, the map is recompiled on exit */
+    parser->state.rmap = routemap_get(name);
+    if (routemap_clause(parser->state.rmap,
+        action && strcmp(action, "deny") == 0 ? PREFIXLIST_DENY :
+        PREFIXLIST_PERMIT, seq ? strtoul(seq, NULL, 10) : 0) < 0)
+    {
+        return -1;
+    }
+
+    parser->state.ctx = CTX_ROUTEMAP;
+    return 0;
 }
 
 int
@@ -125,6 +382,10 @@ cmd_config_trip(parser_t *parser, int no, char *args)
     }
 
     parser->manager->itad = itad;
+    topology_set_root(parser->manager->topology, itad);
+    rib_set_local(parser->manager->rib, itad, parser->manager->id);
+
+    return 0;
 }
 
 /* prefix list context */
@@ -132,7 +393,65 @@ cmd_config_trip(parser_t *parser, int no, char *args)
 int
 cmd_config_prefixlist_prefix(parser_t *parser, int no, char *args)
 {
-    /* TODO */
+    args = strip(args);
+    if (prefixlist_stage(parser->state.plist, args) < 0) {
+        fprintf(parser->outf, "prefix: usage: prefix <digits> [sip|h323-q931|"
+            "h323-ras|h323-annexg|iax2] [permit|deny] [exact] [server]\n");
+        return -1;
+    }
+    return 0;
+}
+
+int
+cmd_config_prefixlist_import(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    if (!*args) {
+        fprintf(parser->outf, "import: usage: import <file>\n");
+        return -1;
+    }
+
+    /* staged like typed prefixes, the trie is swapped on exit */
+    size_t bad = 0;
+    int staged = prefixlist_import(parser->state.plist, args, &bad);
+    if (staged < 0) {
+        fprintf(parser->outf, "import: could not import %s\n", args);
+        return -1;
+    }
+
+    fprintf(parser->outf, "import: %d entries staged from %s", staged, args);
+    if (bad)
+        fprintf(parser->outf, ", %zu skipped", bad);
+    fprintf(parser->outf, "\n");
+    return 0;
+}
+
+/* route-map context */
+
+int
+cmd_config_routemap_match(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    if (routemap_stage_match(parser->state.rmap, args) < 0) {
+        fprintf(parser->outf, "match: usage: match community <itad:id>|"
+            "no-export | advertisement-path [origin|length] <n> | "
+            "next-hop-itad <itad> | route-type <af|proto> | "
+            "prefix-list <name>\n");
+        return -1;
+    }
+    return 0;
+}
+
+int
+cmd_config_routemap_set(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    if (routemap_stage_set(parser->state.rmap, args) < 0) {
+        fprintf(parser->outf, "set: usage: set local-pref <n> | med <n> | "
+            "community <itad:id>...\n");
+        return -1;
+    }
+    return 0;
 }
 
 /* trip context */
@@ -159,32 +478,88 @@ cmd_config_trip_lsid(parser_t *parser, int no, char *args)
     }
 
     parser->manager->id = lsid;
-    
-    manager_run(parser->manager);
+    rib_set_local(parser->manager->rib, parser->manager->itad, lsid);
+
+    /* once, a reload goes through here again */
+    if (!parser->manager->running) {
+        manager_run(parser->manager);
+        if (!parser->state.reloading)
+            originate_local(parser);
+    }
+    return 0;
 }
 
 int
 cmd_config_trip_timers(parser_t *parser, int no, char *args)
 {
+    if (!parser->manager) {
+        fprintf(parser->outf, "bind-address must be set first\n");
+        return -1;
+    }
+
+    /* taken by peers added from here on, or by all of them on reload */
     args = strip(args);
     parser->manager->hold = strtoul(args, NULL, 10);
+    return 0;
 }
 
 int
-cmd_config_trip_peer(parser_t *parser, int no, char *args)
+cmd_config_trip_compress(parser_t *parser, int no, char *args)
 {
-    args = strip(args);
-    char *peer = strtok(args, " ");
-    char *remote_itad_arg = strtok(NULL, " ");
-    char *remote_itad = strtok(NULL, " ");
+    if (!parser->manager) {
+        fprintf(parser->outf, "bind-address must be set first\n");
+        return -1;
+    }
 
-    if (!peer || !remote_itad_arg || !remote_itad ||
-        strcmp(remote_itad_arg, "remote-itad") != 0)
-    {
-        fprintf(parser->outf, "peer: invalid args: %s\n", args);
+    if (!no && !compress_supported()) {
+        fprintf(parser->outf, "compress: built without zlib\n");
+        return -1;
+    }
+
+    /* offered to peers in OPENs sent from here on */
+    __atomic_store_n(&parser->manager->env.env_compress, !no,
+        __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* parse addr/len, IPv4 ranges become IPv4-mapped IPv6 ones */
+static int
+parse_range(const char *range, struct in6_addr *addr, uint8_t *len)
+{
+    char buff[INET6_ADDRSTRLEN];
+    const char *slash = strchr(range, '/');
+    if (!slash || slash - range >= INET6_ADDRSTRLEN || !slash[1])
+        return -1;
+    memcpy(buff, range, slash - range);
+    buff[slash - range] = '\0';
+
+    char *end = NULL;
+    unsigned long bits = strtoul(slash + 1, &end, 10);
+    if (*end)
         return -1;
+
+    struct in_addr addr4;
+    if (inet_pton(AF_INET, buff, &addr4) == 1) {
+        if (bits > 32)
+            return -1;
+        memset(&addr->s6_addr[0], 0x00, 10);
+        memset(&addr->s6_addr[10], 0xff, 2);
+        memcpy(&addr->s6_addr[12], &addr4, sizeof(addr4));
+        *len = 96 + bits;
+        return 0;
     }
 
+    if (inet_pton(AF_INET6, buff, addr) != 1 || bits > 128)
+        return -1;
+    *len = bits;
+    return 0;
+}
+
+/* resolve peer into an IPv6 or IPv4-mapped address */
+static int
+parse_peer_addr(parser_t *parser, const char *peer,
+    struct sockaddr_in6 *peer_addr)
+{
     struct addrinfo *peer_addrs;
     int res = getaddrinfo(peer, NULL, NULL, &peer_addrs);
     if (res != 0) {
@@ -193,29 +568,128 @@ cmd_config_trip_peer(parser_t *parser, int no, char *args)
         return -1;
     }
 
-    struct sockaddr_in6 peer_addr = { 0 };
+    memset(peer_addr, 0, sizeof(struct sockaddr_in6));
 
+    /* pick first */
     if (peer_addrs->ai_addr->sa_family == AF_INET6) {
-        memcpy(&peer_addr, &peer_addrs->ai_addr, peer_addrs->ai_addrlen);
+        memcpy(peer_addr, peer_addrs->ai_addr, sizeof(struct sockaddr_in6));
+        peer_addr->sin6_port = htons(PROTO_TCP_PORT);
     } else if (peer_addrs->ai_addr->sa_family == AF_INET) {
-        peer_addr.sin6_family = AF_INET6;
-        peer_addr.sin6_port = htons(PROTO_TCP_PORT);
+        peer_addr->sin6_family = AF_INET6;
+        peer_addr->sin6_port = htons(PROTO_TCP_PORT);
         /* map IPv4 into IPv4-mapped IPv6 */
-        memset(&peer_addr.sin6_addr.s6_addr[0], 0x00, 10);  /* 80 0s */
-        memset(&peer_addr.sin6_addr.s6_addr[10], 0xff, 2);  /* 16 1s */
-        memcpy(&peer_addr.sin6_addr.s6_addr[12],            /* 32 IPv4 addr */
+        memset(&peer_addr->sin6_addr.s6_addr[0], 0x00, 10); /* 80 0s */
+        memset(&peer_addr->sin6_addr.s6_addr[10], 0xff, 2); /* 16 1s */
+        memcpy(&peer_addr->sin6_addr.s6_addr[12],           /* 32 IPv4 addr */
             &((struct sockaddr_in *)peer_addrs->ai_addr)->sin_addr.s_addr,
             sizeof(in_addr_t)); 
     } else {
-        fprintf(parser->outf, "peer: unsupported address family: %s\n", args);
+        fprintf(parser->outf, "peer: unsupported address family: %s\n", peer);
+        freeaddrinfo(peer_addrs);
+        return -1;
+    }
+
+    freeaddrinfo(peer_addrs);
+    return 0;
+}
+
+int
+cmd_config_trip_listen_range(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    char *range = strtok(args, " ");
+    char *keyword = strtok(NULL, " ");
+    char *value = strtok(NULL, " ");
+
+    struct in6_addr addr;
+    uint8_t len;
+    if (!range || parse_range(range, &addr, &len) < 0 || (!no &&
+        (!keyword || !value || strcmp(keyword, "remote-itad") != 0)))
+    {
+        fprintf(parser->outf, "listen-range: usage: listen-range "
+            "<addr>/<len> remote-itad <itad>\n");
         return -1;
     }
 
+    if (no) {
+        if (manager_remove_range(parser->manager, &addr, len) < 0) {
+            fprintf(parser->outf, "listen-range: unknown range: %s\n",
+                range);
+            return -1;
+        }
+        return 0;
+    }
+
+    uint32_t itad = strtoul(value, NULL, 10);
+    if (itad == 0) {
+        fprintf(parser->outf, "listen-range: invalid itad: %s\n", value);
+        return -1;
+    }
 
-    uint32_t remote_itad_num = strtoul(remote_itad, NULL, 10);
+    return manager_add_range(parser->manager, &addr, len, itad) < 0 ? -1 : 0;
+}
 
-    /* pick first */
-    manager_add_peer(parser->manager, &peer_addr, remote_itad_num);
+int
+cmd_config_trip_peer(parser_t *parser, int no, char *args)
+{
+    args = strip(args);
+    char *peer = strtok(args, " ");
+    char *keyword = strtok(NULL, " ");
+    char *value = strtok(NULL, " ");
+    char *dir = strtok(NULL, " ");
+
+    struct sockaddr_in6 peer_addr;
+
+    if (peer && keyword && value && strcmp(keyword, "remote-itad") == 0) {
+        if (parse_peer_addr(parser, peer, &peer_addr) < 0)
+            return -1;
+
+        uint32_t remote_itad_num = strtoul(value, NULL, 10);
+        if (manager_add_peer(parser->manager, &peer_addr,
+            remote_itad_num) < 0)
+        {
+            fprintf(parser->outf, "peer: could not add peer: %s\n", peer);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (peer && keyword && value && dir &&
+        strcmp(keyword, "prefix-list") == 0 &&
+        (strcmp(dir, "in") == 0 || strcmp(dir, "out") == 0))
+    {
+        if (parse_peer_addr(parser, peer, &peer_addr) < 0)
+            return -1;
+
+        if (manager_peer_prefixlist(parser->manager, &peer_addr,
+            prefixlist_get(value), strcmp(dir, "out") == 0) < 0)
+        {
+            fprintf(parser->outf, "peer: unknown peer: %s\n", peer);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (peer && keyword && value && dir &&
+        strcmp(keyword, "route-map") == 0 &&
+        (strcmp(dir, "in") == 0 || strcmp(dir, "out") == 0))
+    {
+        if (parse_peer_addr(parser, peer, &peer_addr) < 0)
+            return -1;
+
+        if (strlen(value) >= ROUTEMAP_NAME_MAX ||
+            manager_peer_routemap(parser->manager, &peer_addr,
+            routemap_get(value), strcmp(dir, "out") == 0) < 0)
+        {
+            fprintf(parser->outf, "peer: unknown peer: %s\n", peer);
+            return -1;
+        }
+        return 0;
+    }
+
+    fprintf(parser->outf, "peer: usage: peer <addr> remote-itad <itad> | "
+        "peer <addr> prefix-list|route-map <name> in|out\n");
+    return -1;
 }
 
 
@@ -31,19 +31,30 @@ int cmd_exit(parser_t *parser, int no, char *args);
 int cmd_enable(parser_t *parser, int no, char *args);
 int cmd_configure(parser_t *parser, int no, char *args);
 int cmd_show(parser_t *parser, int no, char *args);
+int cmd_trace(parser_t *parser, int no, char *args);
+int cmd_benchmark(parser_t *parser, int no, char *args);
+int cmd_reload(parser_t *parser, int no, char *args);
 
 /* config context */
 int cmd_config_log(parser_t *parser, int no, char *args);
 int cmd_config_bind(parser_t *parser, int no, char *args);
 int cmd_config_prefixlist(parser_t *parser, int no, char *args);
 int cmd_config_trip(parser_t *parser, int no, char *args);
+int cmd_config_routemap(parser_t *parser, int no, char *args);
 
 /* prefixlist context */
 int cmd_config_prefixlist_prefix(parser_t *parser, int no, char *args);
+int cmd_config_prefixlist_import(parser_t *parser, int no, char *args);
+
+/* route-map context */
+int cmd_config_routemap_match(parser_t *parser, int no, char *args);
+int cmd_config_routemap_set(parser_t *parser, int no, char *args);
 
 /* trip context */
 int cmd_config_trip_lsid(parser_t *parser, int no, char *args);
 int cmd_config_trip_timers(parser_t *parser, int no, char *args);
+int cmd_config_trip_compress(parser_t *parser, int no, char *args);
+int cmd_config_trip_listen_range(parser_t *parser, int no, char *args);
 int cmd_config_trip_peer(parser_t *parser, int no, char *args);
 
 #endif /* _COMMANDS_H */
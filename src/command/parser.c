@@ -28,6 +28,7 @@
 #include <functions/manager.h>
 
 #include <string.h>
+#include <time.h>
 
 
 /* handler function pointer type */
@@ -46,6 +47,9 @@ const cmd_def_t cmds_base[] = {
     { "enable",         &cmd_enable },
     { "configure",      &cmd_configure },
     { "show",           &cmd_show },
+    { "trace",          &cmd_trace },
+    { "benchmark",      &cmd_benchmark },
+    { "reload",         &cmd_reload },
     { NULL,             NULL }
 };
 
@@ -55,6 +59,7 @@ const cmd_def_t cmds_config[] = {
     { "log",            &cmd_config_log },
     { "bind-address",   &cmd_config_bind },
     { "prefix-list",    &cmd_config_prefixlist },
+    { "route-map",      &cmd_config_routemap },
     { "trip",           &cmd_config_trip },
     { NULL,             NULL }
 };
@@ -63,6 +68,7 @@ const cmd_def_t cmds_prefixlist[] = {
     { "end",            &cmd_end },
     { "exit",           &cmd_exit },
     { "prefix",         &cmd_config_prefixlist_prefix },
+    { "import",         &cmd_config_prefixlist_import },
     { NULL,             NULL }
 };
 
@@ -71,7 +77,17 @@ const cmd_def_t cmds_trip[] = {
     { "exit",           &cmd_exit },
     { "ls-id",          &cmd_config_trip_lsid },
     { "timers",         &cmd_config_trip_timers },
+    { "compress",       &cmd_config_trip_compress },
     { "peer",           &cmd_config_trip_peer },
+    { "listen-range",   &cmd_config_trip_listen_range },
+    { NULL,             NULL }
+};
+
+const cmd_def_t cmds_routemap[] = {
+    { "end",            &cmd_end },
+    { "exit",           &cmd_exit },
+    { "match",          &cmd_config_routemap_match },
+    { "set",            &cmd_config_routemap_set },
     { NULL,             NULL }
 };
 
@@ -79,9 +95,30 @@ const cmd_def_t *cmds[] = {
     cmds_base,
     cmds_config,
     cmds_prefixlist,
-    cmds_trip
+    cmds_trip,
+    cmds_routemap
 };
 
+#define CTX_COUNT       (sizeof(cmds) / sizeof(cmds[0]))
+#define CMD_TRIE_MAX    256     /* nodes per context */
+
+/* command name trie, children are a sibling list, every node counts the
+ * commands below it so an abbreviation is resolved where it ends */
+typedef struct {
+    char        node_char;
+    int16_t     node_child, node_sibling;   /* -1 if none */
+    int16_t     node_cmd;       /* command ending here, or -1 */
+    int16_t     node_last;      /* a command below, the only one if count 1 */
+    int16_t     node_count;     /* commands below, this one included */
+} cmd_node_t;
+
+typedef struct {
+    cmd_node_t  nodes[CMD_TRIE_MAX];
+    size_t      nodes_size;
+} cmd_trie_t;
+
+static cmd_trie_t cmd_tries[CTX_COUNT];
+
 
 char *
 strip(char *s)
@@ -92,11 +129,84 @@ strip(char *s)
 }
 
 
+static int16_t
+cmd_trie_node(cmd_trie_t *trie, char c)
+{
+    if (trie->nodes_size == CMD_TRIE_MAX)
+        return -1;
+    cmd_node_t *node = &trie->nodes[trie->nodes_size];
+    node->node_char = c;
+    node->node_child = node->node_sibling = node->node_cmd = -1;
+    node->node_last = -1;
+    node->node_count = 0;
+    return trie->nodes_size++;
+}
+
+static int16_t
+cmd_trie_child(const cmd_trie_t *trie, int16_t n, char c)
+{
+    int16_t child = trie->nodes[n].node_child;
+    while (child >= 0 && trie->nodes[child].node_char != c)
+        child = trie->nodes[child].node_sibling;
+    return child;
+}
+
+static int
+cmd_trie_build(cmd_trie_t *trie, const cmd_def_t *defs)
+{
+    trie->nodes_size = 0;
+    cmd_trie_node(trie, '\0');
+
+    for (int16_t i = 0; defs[i].cmd; i++) {
+        int16_t n = 0;
+        trie->nodes[n].node_count++;
+        trie->nodes[n].node_last = i;
+
+        for (const char *c = defs[i].cmd; *c; c++) {
+            int16_t child = cmd_trie_child(trie, n, *c);
+            if (child < 0) {
+                if ((child = cmd_trie_node(trie, *c)) < 0)
+                    return -1;
+                trie->nodes[child].node_sibling = trie->nodes[n].node_child;
+                trie->nodes[n].node_child = child;
+            }
+            n = child;
+            trie->nodes[n].node_count++;
+            trie->nodes[n].node_last = i;
+        }
+        trie->nodes[n].node_cmd = i;
+    }
+
+    return 0;
+}
+
+/* resolve the first len characters of cmd, an exact name wins over longer
+ * ones it abbreviates, -1 if unknown, -2 if ambiguous */
+static int
+cmd_trie_lookup(const cmd_trie_t *trie, const char *cmd, size_t len)
+{
+    int16_t n = 0;
+    for (size_t i = 0; i < len; i++)
+        if ((n = cmd_trie_child(trie, n, cmd[i])) < 0)
+            return -1;
+
+    const cmd_node_t *node = &trie->nodes[n];
+    if (node->node_cmd >= 0)
+        return node->node_cmd;
+    return node->node_count == 1 ? node->node_last : -2;
+}
+
+
 parser_t *
 parser_init(FILE *outf)
 {
     static parser_t parser;
 
+    for (size_t i = 0; i < CTX_COUNT; i++)
+        if (cmd_trie_build(&cmd_tries[i], cmds[i]) < 0)
+            fprintf(stderr, "[ERROR parser] command table %zu too large\n",
+                i);
+
     parser.state.enabled = 0;
     parser.state.ctx = CTX_BASE;
 
@@ -116,7 +226,7 @@ parser_parse_cmd(parser_t *parser, char *cmd)
     const cmd_def_t *ctx_cmds = cmds[parser->state.ctx];
 
     int no = 0;
-    if (strcmp("no", cmd) == 0) {
+    if (strncmp(cmd, "no", 2) == 0 && (cmd[2] == ' ' || cmd[2] == '\t')) {
         no = 1;
         cmd = strip(cmd + 2);
     }
@@ -127,12 +237,14 @@ parser_parse_cmd(parser_t *parser, char *cmd)
         return -1;
     }
 
-    for (size_t i = 0; ctx_cmds[i].cmd; i++)
-        if (strncmp(cmd, ctx_cmds[i].cmd, strlen(ctx_cmds[i].cmd)) == 0)
-            return ctx_cmds[i].cmd_handler(parser, no,
-                cmd + strlen(ctx_cmds[i].cmd));
+    /* commands are whole words, so "peers" is not "peer" */
+    size_t len = strcspn(cmd, " \t");
+    int i = cmd_trie_lookup(&cmd_tries[parser->state.ctx], cmd, len);
+    if (i >= 0)
+        return ctx_cmds[i].cmd_handler(parser, no, cmd + len);
 
-    fprintf(parser->outf, "unknown command: %s\n", cmd);
+    fprintf(parser->outf, "%s command: %.*s\n",
+        i == -2 ? "ambiguous" : "unknown", (int)len, cmd);
     return -1;
 }
 
@@ -152,3 +264,59 @@ parser_parse_file(parser_t *parser, FILE *f)
     return 0;
 }
 
+
+int
+parser_reload(parser_t *parser, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(parser->outf, "reload: could not open %s\n", path);
+        return -1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* the file is parsed as at startup, definitions are diffed against the
+     * running ones as they complete or when the pass ends */
+    parser_state_t saved = parser->state;
+    parser->state.enabled = 1;
+    parser->state.ctx = CTX_CONFIG;
+    parser->state.reloading = 1;
+
+    prefixlist_reload_begin();
+    routemap_reload_begin();
+    if (parser->manager)
+        manager_reload_begin(parser->manager);
+
+    parser_parse_file(parser, f);
+    fclose(f);
+
+    /* a file may end inside a block */
+    if (parser->state.ctx == CTX_PREFIXLIST)
+        cmd_exit(parser, 0, "");
+
+    int plists = prefixlist_reload_end();
+    int rmaps = routemap_reload_end();
+    manager_reload_t summary = { 0 };
+    int origins = 0;
+    if (parser->manager) {
+        manager_reload_end(parser->manager, &summary);
+        origins = rib_originate(parser->manager->rib,
+            prefixlist_get(PREFIXLIST_LOCAL));
+    }
+
+    parser->state = saved;
+    parser->state.reloading = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fprintf(parser->outf, "reload: %zu peers added, %zu removed, "
+        "%zu peer changes, %zu peers refreshed, %d prefix-lists removed, "
+        "%d route-maps changed, %d local routes changed, %.3f ms\n",
+        summary.peers_added, summary.peers_removed, summary.peer_changes,
+        summary.peers_refreshed, plists, rmaps, origins,
+        (end.tv_sec - start.tv_sec) * 1e3 +
+        (end.tv_nsec - start.tv_nsec) / 1e6);
+
+    return 0;
+}
@@ -22,6 +22,8 @@
 #define _PARSER_H
 
 #include <functions/manager.h>
+#include <functions/prefixlist.h>
+#include <functions/routemap.h>
 
 #include <stdio.h>
 
@@ -32,6 +34,7 @@ typedef enum {
     CTX_CONFIG,     /* config context */
     CTX_PREFIXLIST, /* prefix list context */
     CTX_TRIP,       /* TRIP routing context */
+    CTX_ROUTEMAP,   /* route-map clause context */
 } cmd_context_t;
 
 /* parser state */
@@ -40,11 +43,15 @@ typedef struct {
     cmd_context_t       ctx;
 
     uint32_t            itad; /* trip context itad */
+    prefixlist_t       *plist; /* prefix list context list */
+    routemap_t         *rmap; /* route-map context map */
+    int                 reloading; /* diff against the running config */
 } parser_state_t;
 
 typedef struct {
     parser_state_t      state;
     FILE               *outf;
+    const char         *config_path; /* reloaded by default */
 
     struct sockaddr_in6 listen_addr;
     manager_t          *manager;
@@ -57,6 +64,10 @@ parser_t *parser_init(FILE *outf);
 int parser_parse_cmd(parser_t *parser, char *cmd);
 int parser_parse_file(parser_t *parser, FILE *f);
 
+/* parse the configuration again and apply only what changed, sessions of
+ * peers whose configuration is unchanged keep running */
+int parser_reload(parser_t *parser, const char *path);
+
 
 #endif /* _PARSER_H */
 
@@ -0,0 +1,152 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    adjout.c: compact record of the routes advertised to a peer
+
+*/
+
+#include "adjout.h"
+
+#include <stdlib.h>
+
+
+/* utils */
+
+static inline uint64_t
+key_of(uint64_t hash)
+{
+    return hash ? hash : 1;
+}
+
+/* the route hash is FNV, fold the high half in before masking */
+static inline size_t
+slot_of(const adjout_t *adj, uint64_t key)
+{
+    return (key ^ key >> 29) & adj->mask;
+}
+
+static int
+adjout_grow(adjout_t *adj)
+{
+    size_t slots = adj->mask ? (adj->mask + 1) * 2 : ADJOUT_INIT_SIZE;
+    uint64_t *keys = calloc(slots, sizeof(uint64_t));
+    uint32_t *states = malloc(slots * sizeof(uint32_t));
+    if (!keys || !states) {
+        free(keys);
+        free(states);
+        return -1;
+    }
+
+    adjout_t grown = { keys, states, slots - 1, adj->size };
+    for (size_t i = 0; adj->mask && i <= adj->mask; i++) {
+        if (!adj->keys[i])
+            continue;
+        size_t s = slot_of(&grown, adj->keys[i]);
+        while (keys[s])
+            s = (s + 1) & grown.mask;
+        keys[s] = adj->keys[i];
+        states[s] = adj->states[i];
+    }
+
+    free(adj->keys);
+    free(adj->states);
+    *adj = grown;
+    return 0;
+}
+
+
+/* public */
+
+uint32_t
+adjout_get(const adjout_t *adj, uint64_t hash)
+{
+    if (!adj->size)
+        return 0;
+
+    uint64_t key = key_of(hash);
+    for (size_t s = slot_of(adj, key); adj->keys[s]; s = (s + 1) & adj->mask)
+        if (adj->keys[s] == key)
+            return adj->states[s];
+    return 0;
+}
+
+int
+adjout_set(adjout_t *adj, uint64_t hash, uint32_t digest)
+{
+    /* kept at most three quarters full */
+    if ((adj->size + 1) * 4 > (adj->mask + 1) * 3 && adjout_grow(adj) < 0)
+        return -1;
+
+    uint64_t key = key_of(hash);
+    size_t s = slot_of(adj, key);
+    while (adj->keys[s] && adj->keys[s] != key)
+        s = (s + 1) & adj->mask;
+
+    if (!adj->keys[s]) {
+        adj->keys[s] = key;
+        adj->size++;
+    }
+    adj->states[s] = digest ? digest : 1;
+    return 0;
+}
+
+void
+adjout_del(adjout_t *adj, uint64_t hash)
+{
+    if (!adj->size)
+        return;
+
+    uint64_t key = key_of(hash);
+    size_t s = slot_of(adj, key);
+    while (adj->keys[s] != key) {
+        if (!adj->keys[s])
+            return;
+        s = (s + 1) & adj->mask;
+    }
+
+    /* pull back the rest of the run over the hole, unless a key would end
+     * up before its home slot */
+    size_t hole = s;
+    for (s = (s + 1) & adj->mask; adj->keys[s]; s = (s + 1) & adj->mask) {
+        size_t home = slot_of(adj, adj->keys[s]);
+        if (((s - home) & adj->mask) < ((s - hole) & adj->mask))
+            continue;
+        adj->keys[hole] = adj->keys[s];
+        adj->states[hole] = adj->states[s];
+        hole = s;
+    }
+    adj->keys[hole] = 0;
+    adj->size--;
+}
+
+size_t
+adjout_bytes(const adjout_t *adj)
+{
+    return adj->mask ? (adj->mask + 1) *
+        (sizeof(uint64_t) + sizeof(uint32_t)) : 0;
+}
+
+void
+adjout_free(adjout_t *adj)
+{
+    free(adj->keys);
+    free(adj->states);
+    adj->keys = NULL;
+    adj->states = NULL;
+    adj->mask = adj->size = 0;
+}
@@ -0,0 +1,62 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ADJOUT_H
+#define _ADJOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* what was advertised to one peer
+ * instead of a copy of every route and attribute sent, each advertised route
+ * keeps 12 bytes: its hash and a digest of the path it was sent with, an
+ * open addressing table with linear probing, deletions shift the probe run
+ * back so no tombstones build up; enough to tell whether a route is the
+ * same as what the peer has, or must be withdrawn
+ * hash and digest 0 are stored as 1, a digest of 0 means not advertised
+ */
+
+#define ADJOUT_INIT_SIZE    1024    /* slots, power of 2 */
+
+typedef struct {
+    uint64_t   *keys;       /* route hashes, 0 empty */
+    uint32_t   *states;     /* path digests */
+    size_t      mask;       /* slots - 1, 0 before the first route */
+    size_t      size;
+} adjout_t;
+
+
+/* digest route was last advertised with, 0 if it is not */
+uint32_t adjout_get(const adjout_t *adj, uint64_t hash);
+
+/* route is now advertised with digest, -1 if the table could not grow */
+int adjout_set(adjout_t *adj, uint64_t hash, uint32_t digest);
+
+/* route was withdrawn */
+void adjout_del(adjout_t *adj, uint64_t hash);
+
+size_t adjout_bytes(const adjout_t *adj);
+
+/* forget everything, the table is empty and usable again */
+void adjout_free(adjout_t *adj);
+
+
+#endif /* _ADJOUT_H */
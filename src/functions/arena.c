@@ -0,0 +1,114 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    arena.c: per-worker bump arena with chained overflow blocks
+
+*/
+
+#include "arena.h"
+
+#include "pool.h"
+
+
+/* utils */
+
+static arena_block_t *
+block_new(size_t size)
+{
+    arena_block_t *blk = pool_alloc(sizeof(arena_block_t) + size);
+    if (!blk)
+        return NULL;
+    blk->blk_next = NULL;
+    blk->blk_size = size;
+    blk->blk_used = 0;
+    return blk;
+}
+
+static void
+block_free(arena_block_t *blk)
+{
+    pool_free(blk, sizeof(arena_block_t) + blk->blk_size);
+}
+
+
+/* public */
+
+void
+arena_init(arena_t *arena)
+{
+    arena->head = NULL;
+    arena->cur = NULL;
+    arena->stat_chained = 0;
+}
+
+void *
+arena_alloc(arena_t *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_block_t *blk = arena->cur;
+    if (!blk) {
+        if (!arena->head &&
+            !(arena->head = block_new(ARENA_BLOCK - sizeof(arena_block_t))))
+        {
+            return NULL;
+        }
+        blk = arena->cur = arena->head;
+    }
+
+    if (blk->blk_size - blk->blk_used < size) {
+        /* oversized messages, the rest of this block is left unused */
+        size_t blk_size = ARENA_BLOCK - sizeof(arena_block_t);
+        arena_block_t *next = block_new(size > blk_size ? size : blk_size);
+        if (!next)
+            return NULL;
+        blk->blk_next = next;
+        blk = arena->cur = next;
+        arena->stat_chained++;
+    }
+
+    void *ptr = blk->blk_data + blk->blk_used;
+    blk->blk_used += size;
+    return ptr;
+}
+
+void
+arena_reset(arena_t *arena)
+{
+    if (!arena->head)
+        return;
+
+    arena_block_t *blk = arena->head->blk_next;
+    while (blk) {
+        arena_block_t *next = blk->blk_next;
+        block_free(blk);
+        blk = next;
+    }
+    arena->head->blk_next = NULL;
+    arena->head->blk_used = 0;
+    arena->cur = arena->head;
+}
+
+void
+arena_destroy(arena_t *arena)
+{
+    arena_reset(arena);
+    if (arena->head)
+        block_free(arena->head);
+    arena->head = arena->cur = NULL;
+}
@@ -0,0 +1,72 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* per-worker bump arena
+ * transient state of one message, decoded attribute arrays, canonical
+ * attribute sets and policy temporaries, is bumped out of the worker's
+ * arena and all of it dropped at once by a reset when the message is done;
+ * the first block stays with the arena, a message that outgrows it chains
+ * more blocks from the pools, returned on reset
+ */
+
+#define ARENA_BLOCK         8192    /* bytes per block, header included */
+#define ARENA_ALIGN         16
+
+typedef struct arena_block_s {
+    struct arena_block_s *blk_next;
+    size_t              blk_size;       /* bytes in blk_data */
+    size_t              blk_used;
+    uint8_t             blk_data[] __attribute__((aligned(ARENA_ALIGN)));
+} arena_block_t;
+
+typedef struct {
+    arena_block_t      *head;           /* kept across resets */
+    arena_block_t      *cur;            /* chained after head */
+    uint64_t            stat_chained;   /* blocks chained, ever */
+} arena_t;
+
+
+/* empty arena, nothing is allocated before the first use */
+void arena_init(arena_t *arena);
+
+/* size bytes aligned to ARENA_ALIGN, valid until the next reset */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/* same, for allocators taking an opaque argument */
+static inline void *
+arena_alloc_fn(void *arena, size_t size)
+{
+    return arena_alloc(arena, size);
+}
+
+/* drop everything allocated, chained blocks go back to the pools */
+void arena_reset(arena_t *arena);
+
+void arena_destroy(arena_t *arena);
+
+
+#endif /* _ARENA_H */
@@ -0,0 +1,318 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    attrset.c: hash-consed UPDATE attribute sets
+
+*/
+
+#include "attrset.h"
+
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define ATTRSET_INIT_BUCKETS    1024
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static attrset_t **g_buckets = NULL;
+static size_t g_buckets_size = 0;
+static size_t g_sets = 0;
+static uint32_t g_next_id = 1;  /* 0 is never a set */
+static uint64_t g_interned = 0, g_hits = 0;
+
+/* attributes that make up a set, routes and link-state are per UPDATE */
+static const uint8_t set_types[] = {
+    ATTR_TYPE_NEXTHOPSERVER,
+    ATTR_TYPE_ADVERTISEMENTPATH,
+    ATTR_TYPE_ROUTEDPATH,
+    ATTR_TYPE_ATOMICAGGREGATE,
+    ATTR_TYPE_LOCALPREFERENCE,
+    ATTR_TYPE_MULTIEXITDISC,
+    ATTR_TYPE_COMMUNITIES,
+    ATTR_TYPE_CONVERTEDROUTE
+};
+
+
+/* utils */
+
+static inline size_t
+attr_size(const msg_update_attr_t *attr)
+{
+    return (IS_ATTR_FLAG_LSENCAP(attr->attr_flags) ?
+        sizeof(msg_update_attr_lsencap_t) : sizeof(msg_update_attr_t)) +
+        attr->attr_len;
+}
+
+static uint64_t
+hash_bytes(const uint8_t *p, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void
+attrset_grow()
+{
+    size_t size = g_buckets_size ? g_buckets_size * 2 : ATTRSET_INIT_BUCKETS;
+    attrset_t **buckets = calloc(size, sizeof(attrset_t*));
+    if (!buckets)
+        return;
+
+    for (size_t i = 0; i < g_buckets_size; i++) {
+        attrset_t *set = g_buckets[i];
+        while (set) {
+            attrset_t *next = set->set_next;
+            size_t b = set->set_hash & (size - 1);
+            set->set_next = buckets[b];
+            buckets[b] = set;
+            set = next;
+        }
+    }
+
+    free(g_buckets);
+    g_buckets = buckets;
+    g_buckets_size = size;
+}
+
+/* position of type in the canonical order, pass-through ones go last */
+static size_t
+type_rank(uint8_t type)
+{
+    for (size_t i = 0; i < sizeof(set_types); i++)
+        if (set_types[i] == type)
+            return i;
+    return sizeof(set_types);
+}
+
+static int
+passthru_cmp(const void *a, const void *b)
+{
+    const msg_update_attr_t *x = *(const msg_update_attr_t**)a;
+    const msg_update_attr_t *y = *(const msg_update_attr_t**)b;
+    return (int)x->attr_type - (int)y->attr_type;
+}
+
+
+/* find or add the set for canonical attributes, new reference */
+static attrset_t *
+attrset_insert(const uint8_t *canon, size_t len, const void *path_val,
+    size_t path_len, arena_t *arena)
+{
+    uint64_t hash = hash_bytes(canon, len);
+
+    pthread_mutex_lock(&g_lock);
+
+    g_interned++;
+
+    if (g_sets + 1 > g_buckets_size)
+        attrset_grow();
+    if (!g_buckets) {
+        pthread_mutex_unlock(&g_lock);
+        return NULL;
+    }
+
+    size_t b = hash & (g_buckets_size - 1);
+    for (attrset_t *set = g_buckets[b]; set; set = set->set_next) {
+        if (set->set_hash == hash && set->set_len == len &&
+            memcmp(set->set_attrs, canon, len) == 0)
+        {
+            __atomic_add_fetch(&set->set_refs, 1, __ATOMIC_RELAXED);
+            g_hits++;
+            pthread_mutex_unlock(&g_lock);
+            return set;
+        }
+    }
+
+    attrset_t *set = pool_alloc(sizeof(attrset_t) + len);
+    if (!set) {
+        pthread_mutex_unlock(&g_lock);
+        return NULL;
+    }
+
+    set->set_refs = 1;
+    set->set_id = g_next_id++;
+    set->set_hash = hash;
+    set->set_len = len;
+    memcpy(set->set_attrs, canon, len);
+    set->set_path = path_val ? path_intern(path_val, path_len, arena) :
+        NULL;
+
+    set->set_next = g_buckets[b];
+    g_buckets[b] = set;
+    g_sets++;
+
+    pthread_mutex_unlock(&g_lock);
+
+    return set;
+}
+
+
+/* public */
+
+attrset_t *
+attrset_intern(const void *body, size_t body_len, const update_index_t *index,
+    arena_t *arena)
+{
+    /* canonical form, never larger than the UPDATE it comes from */
+    uint8_t *canon = arena_alloc(arena, body_len);
+    if (!canon)
+        return NULL;
+    size_t len = 0;
+
+    for (size_t i = 0; i < sizeof(set_types); i++) {
+        if (!UPDATE_INDEX_HAS(index, set_types[i]))
+            continue;
+        const msg_update_attr_t *attr = body + index->attr_off[set_types[i]];
+        memcpy(canon + len, attr, attr_size(attr));
+        len += attr_size(attr);
+    }
+
+    const msg_update_attr_t **passthru = arena_alloc(arena,
+        index->passthru_size * sizeof(msg_update_attr_t*));
+    if (!passthru)
+        return NULL;
+    for (size_t i = 0; i < index->passthru_size; i++)
+        passthru[i] = body + index->passthru_off[i];
+    qsort(passthru, index->passthru_size, sizeof(msg_update_attr_t*),
+        &passthru_cmp);
+
+    for (size_t i = 0; i < index->passthru_size; i++) {
+        memcpy(canon + len, passthru[i], attr_size(passthru[i]));
+        /* RFC3219: unrecognized transitive attributes are relayed as
+         * partial */
+        ((msg_update_attr_t*)(canon + len))->attr_flags |= ATTR_FLAG_PARTIAL;
+        len += attr_size(passthru[i]);
+    }
+
+    return attrset_insert(canon, len,
+        UPDATE_INDEX_HAS(index, ATTR_TYPE_ADVERTISEMENTPATH) ?
+        body + index->attr_val_off[ATTR_TYPE_ADVERTISEMENTPATH] : NULL,
+        index->attr_val_len[ATTR_TYPE_ADVERTISEMENTPATH], arena);
+}
+
+attrset_t *
+attrset_intern_canon(const void *attrs, size_t len, arena_t *arena)
+{
+    /* the path is the only attribute the set decodes */
+    const void *path_val = NULL;
+    size_t path_len = 0;
+    for (size_t off = 0; off < len;) {
+        const msg_update_attr_t *attr = attrs + off;
+        if (attr->attr_type == ATTR_TYPE_ADVERTISEMENTPATH) {
+            path_val = attr->attr_val;
+            path_len = attr->attr_len;
+        }
+        off += attr_size(attr);
+    }
+
+    return attrset_insert(attrs, len, path_val, path_len, arena);
+}
+
+attrset_t *
+attrset_replace(const attrset_t *set, const msg_update_attr_t **attrs,
+    size_t size, arena_t *arena)
+{
+    size_t len = set->set_len;
+    for (size_t j = 0; j < size; j++)
+        len += attr_size(attrs[j]);
+    if (len > UINT16_MAX)
+        return NULL;
+    uint8_t *canon = arena_alloc(arena, len);
+    if (!canon)
+        return NULL;
+
+    /* merge, both are in canonical order */
+    size_t off = 0, j = 0;
+    for (size_t i = 0; i < set->set_len;) {
+        const msg_update_attr_t *attr = (const void *)set->set_attrs + i;
+        size_t rank = type_rank(attr->attr_type);
+        for (; j < size && type_rank(attrs[j]->attr_type) <= rank; j++) {
+            memcpy(canon + off, attrs[j], attr_size(attrs[j]));
+            off += attr_size(attrs[j]);
+        }
+        int replaced = j && attrs[j - 1]->attr_type == attr->attr_type;
+        if (!replaced) {
+            memcpy(canon + off, attr, attr_size(attr));
+            off += attr_size(attr);
+        }
+        i += attr_size(attr);
+    }
+    for (; j < size; j++) {
+        memcpy(canon + off, attrs[j], attr_size(attrs[j]));
+        off += attr_size(attrs[j]);
+    }
+
+    return attrset_intern_canon(canon, off, arena);
+}
+
+attrset_t *
+attrset_ref(attrset_t *set)
+{
+    if (set)
+        __atomic_add_fetch(&set->set_refs, 1, __ATOMIC_RELAXED);
+    return set;
+}
+
+void
+attrset_unref(attrset_t *set)
+{
+    if (!set)
+        return;
+
+    /* only the last reference needs the table */
+    uint32_t refs = __atomic_load_n(&set->set_refs, __ATOMIC_RELAXED);
+    while (refs > 1) {
+        if (__atomic_compare_exchange_n(&set->set_refs, &refs, refs - 1, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&g_lock);
+    if (__atomic_sub_fetch(&set->set_refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+
+    attrset_t **prev = &g_buckets[set->set_hash & (g_buckets_size - 1)];
+    while (*prev != set)
+        prev = &(*prev)->set_next;
+    *prev = set->set_next;
+    g_sets--;
+    pthread_mutex_unlock(&g_lock);
+
+    path_unref(set->set_path);
+    pool_free(set, sizeof(attrset_t) + set->set_len);
+}
+
+void
+attrset_print(FILE *outf)
+{
+    pthread_mutex_lock(&g_lock);
+    fprintf(outf, "attribute sets: %zu sets, %zu buckets, %llu interned, "
+        "%llu shared\n", g_sets, g_buckets_size,
+        (unsigned long long)g_interned, (unsigned long long)g_hits);
+    pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,73 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ATTRSET_H
+#define _ATTRSET_H
+
+#include <protocol/protocol.h>
+
+#include "arena.h"
+#include "pathtab.h"
+
+#include <stdio.h>
+
+
+/* interned attribute sets
+ * everything in an UPDATE except the routes and link-state attributes,
+ * kept in canonical wire form (known attributes by type, then pass-through
+ * ones by type with the Partial flag set), equal sets are the same object,
+ * set_id is a serial that is never reused so it can key caches that
+ * outlive the set
+ */
+
+typedef struct attrset_s {
+    struct attrset_s   *set_next;       /* hash chain */
+    uint32_t            set_refs;
+    uint32_t            set_id;
+    uint64_t            set_hash;
+    path_t             *set_path;       /* interned AdvertisementPath */
+    uint16_t            set_len;
+    uint8_t             set_attrs[];    /* canonical attributes */
+} attrset_t;
+
+
+/* intern the attributes of a validated UPDATE of len bytes, the canonical
+ * form is built in arena, new reference */
+attrset_t *attrset_intern(const void *body, size_t len,
+    const update_index_t *index, arena_t *arena);
+
+/* intern attributes built locally, in canonical order, an AdvertisementPath
+ * among them is decoded in arena, NULL if there is none, new reference */
+attrset_t *attrset_intern_canon(const void *attrs, size_t len,
+    arena_t *arena);
+
+/* set with attrs in place of its attributes of the same types, the others
+ * added, attrs are known ones in canonical order, new reference */
+attrset_t *attrset_replace(const attrset_t *set,
+    const msg_update_attr_t **attrs, size_t size, arena_t *arena);
+
+attrset_t *attrset_ref(attrset_t *set);
+
+void attrset_unref(attrset_t *set);
+
+void attrset_print(FILE *outf);
+
+
+#endif /* _ATTRSET_H */
@@ -0,0 +1,220 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    compress.c: session long zlib streams
+
+*/
+
+#include "compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef COMPRESS_ENABLED
+#include <zlib.h>
+#endif
+
+
+static compress_stats_t g_stats = { 0 };
+
+#ifdef COMPRESS_ENABLED
+
+struct compress_s {
+    z_stream    c_out, c_in;
+    uint8_t    *c_obuff;
+    size_t      c_ocap;
+    uint8_t     c_ibuff[COMPRESS_IN_SIZE];
+};
+
+
+/* public */
+
+int
+compress_supported()
+{
+    return 1;
+}
+
+compress_t *
+compress_new()
+{
+    compress_t *c = calloc(1, sizeof(compress_t));
+    if (!c)
+        return NULL;
+
+    if (deflateInit(&c->c_out, COMPRESS_LEVEL) != Z_OK) {
+        free(c);
+        return NULL;
+    }
+    if (inflateInit(&c->c_in) != Z_OK) {
+        deflateEnd(&c->c_out);
+        free(c);
+        return NULL;
+    }
+    c->c_in.next_in = c->c_ibuff;
+
+    __atomic_add_fetch(&g_stats.streams, 1, __ATOMIC_RELAXED);
+    return c;
+}
+
+void
+compress_free(compress_t *c)
+{
+    if (!c)
+        return;
+    deflateEnd(&c->c_out);
+    inflateEnd(&c->c_in);
+    free(c->c_obuff);
+    free(c);
+}
+
+ssize_t
+compress_deflate(compress_t *c, const void *buff, size_t len,
+    const void **out)
+{
+    z_stream *z = &c->c_out;
+
+    /* room for all of it in one go, plus the flush marker */
+    size_t bound = deflateBound(z, len) + 16;
+    if (c->c_ocap < bound) {
+        uint8_t *obuff = realloc(c->c_obuff, bound);
+        if (!obuff)
+            return -1;
+        c->c_obuff = obuff;
+        c->c_ocap = bound;
+    }
+
+    z->next_in = (Bytef*)buff;
+    z->avail_in = len;
+    z->next_out = c->c_obuff;
+    z->avail_out = c->c_ocap;
+
+    if (deflate(z, Z_SYNC_FLUSH) != Z_OK || z->avail_in || !z->avail_out)
+        return -1;
+
+    size_t wire = c->c_ocap - z->avail_out;
+    __atomic_add_fetch(&g_stats.raw_out, len, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_stats.wire_out, wire, __ATOMIC_RELAXED);
+
+    *out = c->c_obuff;
+    return wire;
+}
+
+ssize_t
+compress_inflate(compress_t *c, void *buff, size_t len)
+{
+    z_stream *z = &c->c_in;
+    z->next_out = buff;
+    z->avail_out = len;
+
+    while (1) {
+        uInt avail_in = z->avail_in;
+        /* the peer never ends its stream, Z_STREAM_END is corrupt too */
+        int r = inflate(z, Z_SYNC_FLUSH);
+        if (r != Z_OK && r != Z_BUF_ERROR)
+            return -1;
+
+        size_t raw = len - z->avail_out;
+        if (raw) {
+            __atomic_add_fetch(&g_stats.raw_in, raw, __ATOMIC_RELAXED);
+            return raw;
+        }
+
+        /* flush markers are consumed without output, go on past them */
+        if (z->avail_in == avail_in)
+            return z->avail_in == COMPRESS_IN_SIZE ? -1 : 0;
+    }
+}
+
+void *
+compress_in_space(compress_t *c, size_t *len)
+{
+    z_stream *z = &c->c_in;
+
+    /* a partial block stays, moved to the front */
+    if (z->next_in != c->c_ibuff) {
+        memmove(c->c_ibuff, z->next_in, z->avail_in);
+        z->next_in = c->c_ibuff;
+    }
+
+    *len = COMPRESS_IN_SIZE - z->avail_in;
+    return c->c_ibuff + z->avail_in;
+}
+
+void
+compress_in_fed(compress_t *c, size_t len)
+{
+    c->c_in.avail_in += len;
+    __atomic_add_fetch(&g_stats.wire_in, len, __ATOMIC_RELAXED);
+}
+
+#else
+
+int
+compress_supported()
+{
+    return 0;
+}
+
+compress_t *
+compress_new()
+{
+    return NULL;
+}
+
+void
+compress_free(compress_t *c)
+{
+}
+
+ssize_t
+compress_deflate(compress_t *c, const void *buff, size_t len,
+    const void **out)
+{
+    return -1;
+}
+
+ssize_t
+compress_inflate(compress_t *c, void *buff, size_t len)
+{
+    return -1;
+}
+
+void *
+compress_in_space(compress_t *c, size_t *len)
+{
+    *len = 0;
+    return NULL;
+}
+
+void
+compress_in_fed(compress_t *c, size_t len)
+{
+}
+
+#endif /* COMPRESS_ENABLED */
+
+void
+compress_get_stats(compress_stats_t *stats)
+{
+    stats->raw_out = __atomic_load_n(&g_stats.raw_out, __ATOMIC_RELAXED);
+    stats->wire_out = __atomic_load_n(&g_stats.wire_out, __ATOMIC_RELAXED);
+    stats->wire_in = __atomic_load_n(&g_stats.wire_in, __ATOMIC_RELAXED);
+    stats->raw_in = __atomic_load_n(&g_stats.raw_in, __ATOMIC_RELAXED);
+    stats->streams = __atomic_load_n(&g_stats.streams, __ATOMIC_RELAXED);
+}
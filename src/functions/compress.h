@@ -0,0 +1,78 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* compressed session streams
+ * one zlib stream per direction lasts as long as the session, so digit
+ * strings and attributes repeated across UPDATEs compress against
+ * everything sent before them, every message is flushed on its own so the
+ * peer can decode it as soon as it arrives
+ * the send side is used under the session's send lock, the receive side by
+ * the session thread only
+ * built without zlib (cmake -DCOMPRESS=OFF) compress_new() always fails and
+ * the capability is never advertised
+ */
+
+#define COMPRESS_LEVEL      1       /* zlib level, speed over ratio */
+#define COMPRESS_IN_SIZE    16384   /* compressed bytes received at a time */
+
+typedef struct compress_s compress_t;
+
+typedef struct {
+    uint64_t    raw_out, wire_out;      /* bytes before and after deflate */
+    uint64_t    wire_in, raw_in;        /* before and after inflate */
+    uint64_t    streams;                /* ever created */
+} compress_stats_t;
+
+
+/* whether compress_new() can succeed */
+int compress_supported();
+
+compress_t *compress_new();
+
+void compress_free(compress_t *c);
+
+/* compress len bytes and flush them, *out holds the result until the next
+ * call, returns its length or -1 */
+ssize_t compress_deflate(compress_t *c, const void *buff, size_t len,
+    const void **out);
+
+/* decompress what was fed so far into up to len bytes of buff, returns the
+ * bytes written, 0 when more input is needed, -1 on a corrupt stream */
+ssize_t compress_inflate(compress_t *c, void *buff, size_t len);
+
+/* where to receive more compressed input into, and up to how much */
+void *compress_in_space(compress_t *c, size_t *len);
+
+/* len bytes were received at compress_in_space() */
+void compress_in_fed(compress_t *c, size_t len);
+
+/* totals over all sessions */
+void compress_get_stats(compress_stats_t *stats);
+
+
+#endif /* _COMPRESS_H */
@@ -0,0 +1,545 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    flood.c: intra-domain link-state attribute flooding
+
+*/
+
+#include "flood.h"
+
+#include "pool.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+
+static flood_t *g_flood = NULL;
+
+static const uint8_t ls_types[] = {
+    ATTR_TYPE_WITHDRAWNROUTES,
+    ATTR_TYPE_REACHABLEROUTES,
+    ATTR_TYPE_ITADTOPOLOGY
+};
+
+#define LS_TYPES_SIZE   (sizeof(ls_types) / sizeof(ls_types[0]))
+
+/* sequence numbers wrap, compare in serial number arithmetic */
+#define SEQ_NEWER(a, b) ((int32_t)((a) - (b)) > 0)
+
+
+/* utils */
+
+static inline size_t
+lsa_hash(uint32_t id, uint8_t type)
+{
+    uint64_t h = ((uint64_t)id << 8) | type;
+    h *= 0x9e3779b97f4a7c15ULL;
+    return h >> 32;
+}
+
+static flood_msg_t *
+flood_msg_ref(flood_msg_t *fmsg)
+{
+    __atomic_add_fetch(&fmsg->fmsg_refs, 1, __ATOMIC_RELAXED);
+    return fmsg;
+}
+
+static void
+flood_msg_unref(flood_msg_t *fmsg)
+{
+    if (fmsg && __atomic_sub_fetch(&fmsg->fmsg_refs, 1, __ATOMIC_ACQ_REL) == 0)
+        pool_free(fmsg, fmsg->fmsg_size);
+}
+
+/* neighbors that did not agree on a large enough message size in OPEN
+ * cannot be sent it, received from one that did */
+static int
+flood_send(flood_t *flood, session_t *session, const flood_msg_t *fmsg)
+{
+    if (fmsg->fmsg_len > session->session_msg_size) {
+        __atomic_add_fetch(&flood->stat_oversize, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return session_send(session, fmsg->fmsg_buff, fmsg->fmsg_len);
+}
+
+static flood_lsa_t *
+flood_find(flood_t *flood, uint32_t id, uint8_t type)
+{
+    size_t mask = flood->db_capacity - 1;
+    for (size_t i = lsa_hash(id, type) & mask;; i = (i + 1) & mask) {
+        flood_lsa_t *lsa = &flood->db[i];
+        if (!lsa->lsa_used)
+            return NULL;
+        if (lsa->lsa_id == id && lsa->lsa_type == type)
+            return lsa;
+    }
+}
+
+static void
+flood_grow(flood_t *flood)
+{
+    flood_lsa_t *old = flood->db;
+    size_t old_capacity = flood->db_capacity;
+
+    flood->db_capacity *= 2;
+    flood->db = calloc(flood->db_capacity, sizeof(flood_lsa_t));
+
+    size_t mask = flood->db_capacity - 1;
+    for (size_t j = 0; j < old_capacity; j++) {
+        if (!old[j].lsa_used)
+            continue;
+        size_t i = lsa_hash(old[j].lsa_id, old[j].lsa_type) & mask;
+        while (flood->db[i].lsa_used)
+            i = (i + 1) & mask;
+        flood->db[i] = old[j];
+    }
+
+    free(old);
+}
+
+/* find or insert, inserted entries have lsa_seq 0 and no message */
+static flood_lsa_t *
+flood_get(flood_t *flood, uint32_t id, uint8_t type, int *created)
+{
+    *created = 0;
+    flood_lsa_t *lsa = flood_find(flood, id, type);
+    if (lsa)
+        return lsa;
+
+    if ((flood->db_size + 1) * 2 > flood->db_capacity)
+        flood_grow(flood);
+
+    size_t mask = flood->db_capacity - 1;
+    size_t i = lsa_hash(id, type) & mask;
+    while (flood->db[i].lsa_used)
+        i = (i + 1) & mask;
+
+    lsa = &flood->db[i];
+    lsa->lsa_used = 1;
+    lsa->lsa_id = id;
+    lsa->lsa_type = type;
+    lsa->lsa_seq = 0;
+    lsa->lsa_has = 0;
+    lsa->lsa_msg = NULL;
+    flood->db_size++;
+
+    *created = 1;
+    return lsa;
+}
+
+/* rebuild the UPDATE without the link-state attributes in skip */
+static flood_msg_t *
+flood_msg_new(const void *body, const update_index_t *index, uint32_t skip)
+{
+    size_t body_len = 0;
+    const msg_update_attr_t *attrs[ATTR_TYPE_MAX + 1 +
+        UPDATE_INDEX_MAX_PASSTHRU];
+    size_t attrs_size = 0;
+
+    for (uint8_t t = ATTR_TYPE_WITHDRAWNROUTES; t <= ATTR_TYPE_MAX; t++) {
+        if (!UPDATE_INDEX_HAS(index, t) || ((skip >> t) & 1))
+            continue;
+        attrs[attrs_size++] = body + index->attr_off[t];
+        body_len += index->attr_val_off[t] - index->attr_off[t] +
+            index->attr_val_len[t];
+    }
+
+    for (size_t i = 0; i < index->passthru_size; i++) {
+        const msg_update_attr_t *attr = body + index->passthru_off[i];
+        attrs[attrs_size++] = attr;
+        body_len += (IS_ATTR_FLAG_LSENCAP(attr->attr_flags) ?
+            sizeof(msg_update_attr_lsencap_t) : sizeof(msg_update_attr_t)) +
+            attr->attr_len;
+    }
+
+    size_t size = sizeof(flood_msg_t) + MSG_HDR_LEN + body_len;
+    flood_msg_t *fmsg = pool_alloc(size);
+    if (!fmsg)
+        return NULL;
+
+    int r = new_msg_update(fmsg->fmsg_buff, MSG_HDR_LEN + body_len, attrs,
+        attrs_size);
+    if (r < 0) {
+        pool_free(fmsg, size);
+        return NULL;
+    }
+
+    fmsg->fmsg_size = size;
+    fmsg->fmsg_refs = 1;
+    fmsg->fmsg_len = r;
+    fmsg->fmsg_sync = 0;
+    return fmsg;
+}
+
+static int
+flood_pending_push(flood_t *flood, const flood_pending_t *pend)
+{
+    if (flood->pending_size + 1 > flood->pending_capacity) {
+        flood_pending_t *pending = realloc(flood->pending,
+            flood->pending_capacity * 2 * sizeof(flood_pending_t));
+        if (!pending)
+            return -1;
+        flood->pending = pending;
+        flood->pending_capacity *= 2;
+    }
+    if (flood->pending_size == 0)
+        pthread_cond_signal(&flood->wake);
+    flood->pending[flood->pending_size++] = *pend;
+    TRACE(TRACE_MSG_QUEUED, MSG_TYPE_UPDATE, pend->pend_msg->fmsg_len);
+    return 0;
+}
+
+/* fan out what was received over the last batch period */
+static void
+flood_flush(flood_t *flood)
+{
+    typedef struct { session_t *session; flood_msg_t *fmsg; } send_t;
+
+    pthread_mutex_lock(&flood->lock);
+
+    size_t sends_size = 0;
+    size_t sends_bytes = sizeof(send_t) * (flood->pending_size *
+        FLOOD_MAX_NEIGHBORS + 1);
+    send_t *sends = pool_alloc(sends_bytes);
+    if (!sends) {
+        /* kept for the next batch */
+        pthread_mutex_unlock(&flood->lock);
+        return;
+    }
+
+    for (size_t p = 0; p < flood->pending_size; p++) {
+        flood_pending_t *pend = &flood->pending[p];
+
+        /* neighbors that echoed every attribute already have the update */
+        uint64_t acked = ~0ULL;
+        int live = 0;
+        for (size_t i = 0; i < pend->pend_lsas_size; i++) {
+            const flood_lsa_t *lsa = flood_find(flood, pend->pend_ids[i],
+                pend->pend_types[i]);
+            if (!lsa || lsa->lsa_seq != pend->pend_seqs[i])
+                continue; /* superseded, newer copy is pending too */
+            acked &= lsa->lsa_has;
+            live++;
+        }
+
+        uint64_t targets = pend->pend_targets & flood->neighbors_mask;
+        if (live) {
+            flood->stat_acked += __builtin_popcountll(targets & acked);
+            targets &= ~acked;
+
+            /* a neighbor is one until it is removed, with the lock, so the
+             * reference is taken before its session can end and be reused */
+            for (int n = 0; n < FLOOD_MAX_NEIGHBORS; n++) {
+                if (!((targets >> n) & 1) ||
+                    !session_tryget(flood->neighbors[n]))
+                {
+                    continue;
+                }
+                sends[sends_size].session = flood->neighbors[n];
+                sends[sends_size].fmsg = flood_msg_ref(pend->pend_msg);
+                sends_size++;
+            }
+        }
+
+        flood_msg_unref(pend->pend_msg);
+    }
+    flood->pending_size = 0;
+
+    pthread_mutex_unlock(&flood->lock);
+
+    for (size_t i = 0; i < sends_size; i++) {
+        if (flood_send(flood, sends[i].session, sends[i].fmsg) >= 0)
+            __atomic_add_fetch(&flood->stat_sent, 1, __ATOMIC_RELAXED);
+        session_put(sends[i].session);
+        flood_msg_unref(sends[i].fmsg);
+    }
+
+    pool_free(sends, sends_bytes);
+}
+
+static void *
+flood_loop(void *arg)
+{
+    flood_t *flood = arg;
+
+    trace_thread_name("flood");
+
+    struct timespec ts = { 0, FLOOD_BATCH_MS * 1000000L };
+    while (1) {
+        pthread_mutex_lock(&flood->lock);
+        while (!flood->pending_size)
+            pthread_cond_wait(&flood->wake, &flood->lock);
+        pthread_mutex_unlock(&flood->lock);
+
+        /* what arrives meanwhile goes out with it */
+        nanosleep(&ts, NULL);
+        flood_flush(flood);
+    }
+
+    return NULL;
+}
+
+
+/* public */
+
+flood_t *
+flood_new()
+{
+    if (g_flood != NULL)
+        return NULL;
+
+    g_flood = calloc(1, sizeof(flood_t));
+    pthread_mutex_init(&g_flood->lock, NULL);
+    pthread_cond_init(&g_flood->wake, NULL);
+
+    g_flood->db_capacity = 256;
+    g_flood->db = calloc(g_flood->db_capacity, sizeof(flood_lsa_t));
+
+    g_flood->pending_capacity = 64;
+    g_flood->pending = malloc(g_flood->pending_capacity *
+        sizeof(flood_pending_t));
+
+    return g_flood;
+}
+
+void
+flood_run(flood_t *flood)
+{
+    pthread_create(&flood->thread, NULL, &flood_loop, flood);
+    pthread_detach(flood->thread);
+}
+
+int
+flood_add_neighbor(flood_t *flood, session_t *session)
+{
+    pthread_mutex_lock(&flood->lock);
+
+    if (~flood->neighbors_mask == 0) {
+        pthread_mutex_unlock(&flood->lock);
+        fprintf(stderr, "[WARNING flood] more than %d internal peers, "
+            "not flooding to %d\n", FLOOD_MAX_NEIGHBORS,
+            session->session_peer_id);
+        return -1;
+    }
+
+    /* the caller's, held until the database went out all the same */
+    if (!session_tryget(session)) {
+        pthread_mutex_unlock(&flood->lock);
+        return -1;
+    }
+
+    int slot = __builtin_ctzll(~flood->neighbors_mask);
+    flood->neighbors[slot] = session;
+    flood->neighbors_mask |= 1ULL << slot;
+    session->session_flood_slot = slot;
+
+    /* database synchronization, each stored UPDATE once */
+    uint32_t gen = ++flood->sync_gen;
+    size_t msgs_size = 0;
+    flood_msg_t **msgs = malloc(sizeof(flood_msg_t*) * (flood->db_size + 1));
+    if (!msgs) {
+        flood->neighbors[slot] = NULL;
+        flood->neighbors_mask &= ~(1ULL << slot);
+        session->session_flood_slot = -1;
+        pthread_mutex_unlock(&flood->lock);
+        session_put(session);
+        return -1;
+    }
+    for (size_t i = 0; i < flood->db_capacity; i++) {
+        flood_msg_t *fmsg = flood->db[i].lsa_msg;
+        if (!flood->db[i].lsa_used || !fmsg || fmsg->fmsg_sync == gen)
+            continue;
+        fmsg->fmsg_sync = gen;
+        msgs[msgs_size++] = flood_msg_ref(fmsg);
+    }
+
+    pthread_mutex_unlock(&flood->lock);
+
+    for (size_t i = 0; i < msgs_size; i++) {
+        flood_send(flood, session, msgs[i]);
+        flood_msg_unref(msgs[i]);
+    }
+    free(msgs);
+    session_put(session);
+
+    return slot;
+}
+
+void
+flood_remove_neighbor(flood_t *flood, session_t *session)
+{
+    int slot = session->session_flood_slot;
+    if (slot < 0)
+        return;
+
+    pthread_mutex_lock(&flood->lock);
+    flood->neighbors[slot] = NULL;
+    flood->neighbors_mask &= ~(1ULL << slot);
+    for (size_t i = 0; i < flood->db_capacity; i++)
+        flood->db[i].lsa_has &= ~(1ULL << slot);
+    pthread_mutex_unlock(&flood->lock);
+
+    session->session_flood_slot = -1;
+}
+
+void
+flood_forget(flood_t *flood, uint32_t id, uint8_t type)
+{
+    pthread_mutex_lock(&flood->lock);
+
+    flood_lsa_t *lsa = flood_find(flood, id, type);
+    if (!lsa) {
+        pthread_mutex_unlock(&flood->lock);
+        return;
+    }
+    flood_msg_unref(lsa->lsa_msg);
+
+    /* pull back the rest of the run over the hole, unless an entry would
+     * end up before its home slot */
+    size_t mask = flood->db_capacity - 1;
+    size_t hole = lsa - flood->db;
+    for (size_t i = (hole + 1) & mask; flood->db[i].lsa_used;
+        i = (i + 1) & mask)
+    {
+        size_t home = lsa_hash(flood->db[i].lsa_id, flood->db[i].lsa_type) &
+            mask;
+        if (((i - home) & mask) < ((i - hole) & mask))
+            continue;
+        flood->db[hole] = flood->db[i];
+        hole = i;
+    }
+    memset(&flood->db[hole], 0, sizeof(flood_lsa_t));
+    flood->db_size--;
+
+    pthread_mutex_unlock(&flood->lock);
+}
+
+int
+flood_receive(flood_t *flood, session_t *from, const void *body,
+    const update_index_t *index)
+{
+    uint64_t from_bit = from->session_flood_slot >= 0 ?
+        1ULL << from->session_flood_slot : 0;
+
+    uint32_t ls_present = 0, skip = 0;
+    flood_pending_t pend = { 0 };
+
+    pthread_mutex_lock(&flood->lock);
+
+    for (size_t i = 0; i < LS_TYPES_SIZE; i++) {
+        uint8_t t = ls_types[i];
+        if (!UPDATE_INDEX_HAS(index, t))
+            continue;
+
+        const msg_update_attr_lsencap_t *attr = body + index->attr_off[t];
+        if (!IS_ATTR_FLAG_LSENCAP(attr->attr_flags))
+            continue;
+        ls_present |= 1u << t;
+
+        int created;
+        flood_lsa_t *lsa = flood_get(flood, attr->attr_id, t, &created);
+
+        if (created || SEQ_NEWER(attr->attr_seq, lsa->lsa_seq)) {
+            lsa->lsa_seq = attr->attr_seq;
+            lsa->lsa_has = from_bit;
+            pend.pend_ids[pend.pend_lsas_size] = attr->attr_id;
+            pend.pend_types[pend.pend_lsas_size] = t;
+            pend.pend_seqs[pend.pend_lsas_size++] = attr->attr_seq;
+            flood->stat_fresh++;
+        } else if (attr->attr_seq == lsa->lsa_seq) {
+            lsa->lsa_has |= from_bit;   /* implicit acknowledgement */
+            skip |= 1u << t;
+            flood->stat_dup++;
+        } else {
+            skip |= 1u << t;
+            flood->stat_stale++;
+        }
+    }
+
+    if (pend.pend_lsas_size) {
+        pend.pend_msg = flood_msg_new(body, index, skip);
+        if (pend.pend_msg) {
+            for (size_t i = 0; i < pend.pend_lsas_size; i++) {
+                flood_lsa_t *lsa = flood_find(flood, pend.pend_ids[i],
+                    pend.pend_types[i]);
+                flood_msg_unref(lsa->lsa_msg);
+                lsa->lsa_msg = flood_msg_ref(pend.pend_msg);
+            }
+            pend.pend_targets = ~from_bit;
+            /* out of memory, stored but not passed on, neighbors only get
+             * it by a database sync when they come up again */
+            if (flood_pending_push(flood, &pend) < 0)
+                flood_msg_unref(pend.pend_msg);
+        }
+    }
+
+    pthread_mutex_unlock(&flood->lock);
+
+    return skip & ls_present;
+}
+
+void
+flood_print(flood_t *flood, FILE *outf)
+{
+    char abuff[INET_ADDRSTRLEN];
+
+    pthread_mutex_lock(&flood->lock);
+
+    fprintf(outf, "flooding: %d internal neighbors, %zu attributes\n",
+        __builtin_popcountll(flood->neighbors_mask), flood->db_size);
+    fprintf(outf, "  fresh %llu, duplicate %llu, stale %llu, "
+        "implicitly acked %llu, sent %llu, too large for peer %llu\n",
+        (unsigned long long)flood->stat_fresh,
+        (unsigned long long)flood->stat_dup,
+        (unsigned long long)flood->stat_stale,
+        (unsigned long long)flood->stat_acked,
+        (unsigned long long)flood->stat_sent,
+        (unsigned long long)flood->stat_oversize);
+
+    for (size_t i = 0; i < flood->db_capacity; i++) {
+        const flood_lsa_t *lsa = &flood->db[i];
+        if (!lsa->lsa_used)
+            continue;
+        fprintf(outf, "  %-15s type %2d seq %10u\n",
+            inet_ntop(AF_INET, &lsa->lsa_id, abuff, sizeof(abuff)),
+            lsa->lsa_type, lsa->lsa_seq);
+    }
+
+    pthread_mutex_unlock(&flood->lock);
+}
+
+void
+flood_destroy(flood_t *flood)
+{
+    if (flood != g_flood)
+        return;
+
+    for (size_t i = 0; i < flood->db_capacity; i++)
+        flood_msg_unref(flood->db[i].lsa_msg);
+    for (size_t i = 0; i < flood->pending_size; i++)
+        flood_msg_unref(flood->pending[i].pend_msg);
+
+    free(flood->db);
+    free(flood->pending);
+    free(flood);
+    g_flood = NULL;
+}
@@ -0,0 +1,120 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _FLOOD_H
+#define _FLOOD_H
+
+#include <protocol/protocol.h>
+
+#include "session.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+
+/* intra-domain flooding of link-state encapsulated attributes
+ * (WithdrawnRoutes, ReachableRoutes, ITADTopology) between internal peers
+ *
+ * the database is keyed by (originator, type) and keeps the newest sequence
+ * number, so duplicates and stale copies are dropped with one lookup
+ * floods are held for FLOOD_BATCH_MS before fan-out, a neighbor that sends
+ * us the same copy meanwhile has implicitly acknowledged it and is skipped,
+ * the first one pending opens the batch, with none the flusher sleeps
+ */
+
+#define FLOOD_MAX_NEIGHBORS     64      /* bits in a neighbor mask */
+#define FLOOD_BATCH_MS          10
+
+/* refcounted UPDATE to be flooded */
+typedef struct {
+    uint32_t    fmsg_refs;
+    uint32_t    fmsg_len;
+    uint32_t    fmsg_sync;              /* last database sync that sent it */
+    uint32_t    fmsg_size;              /* allocated */
+    uint8_t     fmsg_buff[];
+} flood_msg_t;
+
+typedef struct {
+    int         lsa_used;
+    uint8_t     lsa_type;
+    uint32_t    lsa_id;                 /* originator */
+    uint32_t    lsa_seq;
+    uint64_t    lsa_has;                /* neighbors that sent us lsa_seq */
+    flood_msg_t *lsa_msg;               /* newest UPDATE carrying it */
+} flood_lsa_t;
+
+typedef struct {
+    flood_msg_t *pend_msg;
+    uint64_t    pend_targets;           /* neighbors at receive time */
+    size_t      pend_lsas_size;         /* attributes this flood carries */
+    uint32_t    pend_ids[3];
+    uint8_t     pend_types[3];
+    uint32_t    pend_seqs[3];
+} flood_pending_t;
+
+typedef struct flood_s {
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      wake;           /* a batch opened */
+
+    flood_lsa_t        *db;
+    size_t              db_size, db_capacity;   /* open addressing, 2^n */
+
+    session_t          *neighbors[FLOOD_MAX_NEIGHBORS];
+    uint64_t            neighbors_mask;
+    uint32_t            sync_gen;
+
+    flood_pending_t    *pending;
+    size_t              pending_size, pending_capacity;
+
+    /* counters */
+    uint64_t            stat_fresh, stat_dup, stat_stale, stat_sent,
+                        stat_acked, stat_oversize;
+} flood_t;
+
+
+/* initialize singleton flooding engine */
+flood_t *flood_new();
+
+/* run batch flusher in thread */
+void flood_run(flood_t *flood);
+
+/* internal peer reached ESTABLISHED, sends it the database */
+int flood_add_neighbor(flood_t *flood, session_t *session);
+
+void flood_remove_neighbor(flood_t *flood, session_t *session);
+
+/* drop what is stored of an originator's attribute, so the next copy is
+ * taken as new whatever its sequence number */
+void flood_forget(flood_t *flood, uint32_t id, uint8_t type);
+
+/* process the link-state encapsulated attributes of a validated UPDATE from
+ * an internal neighbor, returns a mask of bits by attr_type of those that
+ * were duplicate or stale, which the caller must not apply again, 0 if all
+ * of them were new */
+int flood_receive(flood_t *flood, session_t *from, const void *body,
+    const update_index_t *index);
+
+void flood_print(flood_t *flood, FILE *outf);
+
+void flood_destroy(flood_t *flood);
+
+
+#endif /* _FLOOD_H */
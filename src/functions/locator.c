@@ -28,68 +28,428 @@
 
 #include <arpa/inet.h>
 
+#define LOCATOR_INIT_PEERS  64
+#define INDEX_TABLES        3   /* address, ITAD, LS-id */
+
 static locator_t *g_locator = NULL;
 
 
+/* utils */
+
+static inline uint32_t
+addr_scope(const struct sockaddr_in6 *addr)
+{
+    return IN6_IS_ADDR_LINKLOCAL(&addr->sin6_addr) ? addr->sin6_scope_id : 0;
+}
+
+static inline uint64_t
+mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t
+addr_hash(const struct in6_addr *addr, uint32_t scope)
+{
+    uint64_t hi, lo;
+    memcpy(&hi, addr->s6_addr, 8);
+    memcpy(&lo, addr->s6_addr + 8, 8);
+    return mix(hi ^ mix(lo ^ scope));
+}
+
+static inline int
+addr_match(const peer_t *peer, const struct in6_addr *addr, uint32_t scope)
+{
+    return memcmp(&peer->addr.sin6_addr, addr, sizeof(struct in6_addr)) == 0
+        && addr_scope(&peer->addr) == scope;
+}
+
+/* sequence counter, readers retry while a writer is or was in */
+
+static inline uint32_t
+read_begin(locator_t *locator)
+{
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&locator->seq, __ATOMIC_ACQUIRE)) & 1)
+        ;
+    return seq;
+}
+
+static inline int
+read_retry(locator_t *locator, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&locator->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void
+write_begin(locator_t *locator)
+{
+    pthread_mutex_lock(&locator->lock);
+    __atomic_store_n(&locator->seq, locator->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+write_end(locator_t *locator)
+{
+    __atomic_store_n(&locator->seq, locator->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&locator->lock);
+}
+
+static void
+retire(locator_t *locator, void *mem)
+{
+    if (!mem)
+        return;
+    if (locator->retired_size == locator->retired_capacity) {
+        size_t capacity = locator->retired_capacity ?
+            locator->retired_capacity * 2 : 8;
+        void **retired = realloc(locator->retired, capacity * sizeof(void*));
+        if (!retired)
+            return;     /* leaked rather than freed under a reader */
+        locator->retired = retired;
+        locator->retired_capacity = capacity;
+    }
+    locator->retired[locator->retired_size++] = mem;
+}
+
+/* the pointer is published before the bound, so a reader that sees the new
+ * bound also sees the array it applies to */
+
+static int
+peers_reserve(locator_t *locator, size_t size)
+{
+    if (size <= locator->peers_capacity)
+        return 0;
+
+    size_t capacity = locator->peers_capacity * 2;
+    while (capacity < size)
+        capacity *= 2;
+    peer_t *peers = malloc(capacity * sizeof(peer_t));
+    if (!peers)
+        return -1;
+    memcpy(peers, locator->peers, locator->peers_size * sizeof(peer_t));
+
+    retire(locator, locator->peers);
+    __atomic_store_n(&locator->peers, peers, __ATOMIC_RELEASE);
+    __atomic_store_n(&locator->peers_capacity, capacity, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void
+index_insert(locator_t *locator, uint32_t idx)
+{
+    locator_index_t *index = &locator->index;
+    size_t size = index->slots_mask + 1;
+    uint32_t *addr_slots = index->slots;
+    uint32_t *itad_slots = index->slots + size;
+    uint32_t *id_slots = index->slots + 2 * size;
+    peer_t *peer = &locator->peers[idx];
+
+    size_t s = addr_hash(&peer->addr.sin6_addr, addr_scope(&peer->addr)) &
+        index->slots_mask;
+    while (addr_slots[s] != LOCATOR_NONE)
+        s = (s + 1) & index->slots_mask;
+    addr_slots[s] = idx;
+
+    /* one slot per ITAD heading a list through the peers */
+    s = mix(peer->itad) & index->slots_mask;
+    while (itad_slots[s] != LOCATOR_NONE &&
+        locator->peers[itad_slots[s]].itad != peer->itad)
+    {
+        s = (s + 1) & index->slots_mask;
+    }
+    peer->itad_next = itad_slots[s];
+    itad_slots[s] = idx;
+
+    if (!peer->id)
+        return;
+    s = mix(peer->id) & index->slots_mask;
+    while (id_slots[s] != LOCATOR_NONE)
+        s = (s + 1) & index->slots_mask;
+    id_slots[s] = idx;
+}
+
+/* rebuild the indexes from the peers, growing them to stay half empty */
+static int
+index_rebuild(locator_t *locator)
+{
+    locator_index_t *index = &locator->index;
+    size_t size = index->slots ? index->slots_mask + 1 : 0;
+
+    if (size < 2 * locator->peers_capacity) {
+        size = 2 * locator->peers_capacity;
+        uint32_t *slots = malloc(INDEX_TABLES * size * sizeof(uint32_t));
+        if (!slots)
+            return -1;
+        memset(slots, 0xff, INDEX_TABLES * size * sizeof(uint32_t));
+
+        retire(locator, index->slots);
+        __atomic_store_n(&index->slots, slots, __ATOMIC_RELEASE);
+        __atomic_store_n(&index->slots_mask, size - 1, __ATOMIC_RELEASE);
+    } else {
+        memset(index->slots, 0xff, INDEX_TABLES * size * sizeof(uint32_t));
+    }
+
+    for (size_t i = 0; i < locator->peers_size; i++)
+        index_insert(locator, i);
+    return 0;
+}
+
+/* reader side, the caller retries if the sequence moved */
+static int
+find_addr(locator_t *locator, const struct in6_addr *addr, uint32_t scope)
+{
+    size_t mask = __atomic_load_n(&locator->index.slots_mask,
+        __ATOMIC_ACQUIRE);
+    const uint32_t *slots = __atomic_load_n(&locator->index.slots,
+        __ATOMIC_ACQUIRE);
+    size_t capacity = __atomic_load_n(&locator->peers_capacity,
+        __ATOMIC_ACQUIRE);
+    const peer_t *peers = __atomic_load_n(&locator->peers, __ATOMIC_ACQUIRE);
+    if (!slots)
+        return -1;
+
+    size_t s = addr_hash(addr, scope) & mask;
+    for (size_t n = 0; n <= mask; n++, s = (s + 1) & mask) {
+        uint32_t idx = slots[s];
+        if (idx == LOCATOR_NONE)
+            return -1;
+        if (idx < capacity && addr_match(&peers[idx], addr, scope))
+            return idx;
+    }
+    return -1;
+}
+
+static int
+find_id(locator_t *locator, uint32_t id)
+{
+    size_t mask = __atomic_load_n(&locator->index.slots_mask,
+        __ATOMIC_ACQUIRE);
+    const uint32_t *slots = __atomic_load_n(&locator->index.slots,
+        __ATOMIC_ACQUIRE);
+    size_t capacity = __atomic_load_n(&locator->peers_capacity,
+        __ATOMIC_ACQUIRE);
+    const peer_t *peers = __atomic_load_n(&locator->peers, __ATOMIC_ACQUIRE);
+    if (!slots)
+        return -1;
+
+    const uint32_t *id_slots = slots + 2 * (mask + 1);
+    size_t s = mix(id) & mask;
+    for (size_t n = 0; n <= mask; n++, s = (s + 1) & mask) {
+        uint32_t idx = id_slots[s];
+        if (idx == LOCATOR_NONE)
+            return -1;
+        if (idx < capacity && peers[idx].id == id)
+            return idx;
+    }
+    return -1;
+}
+
+static void
+copy_peer(locator_t *locator, peer_t *peer, int idx)
+{
+    if (peer && idx >= 0)
+        *peer = __atomic_load_n(&locator->peers, __ATOMIC_ACQUIRE)[idx];
+}
+
+
+/* public */
+
 locator_t *
 locator_new()
 {
     if (g_locator != NULL)
         return NULL;
 
-    g_locator = malloc(sizeof(locator_t));
-    /* test peer */
-    g_locator->peers_capacity = 64;
-    g_locator->peers = malloc(g_locator->peers_capacity * sizeof(peer_t));
-    g_locator->peers_size = 0;
+    locator_t *locator = calloc(1, sizeof(locator_t));
+    if (!locator)
+        return NULL;
+    pthread_mutex_init(&locator->lock, NULL);
+
+    locator->peers_capacity = LOCATOR_INIT_PEERS;
+    locator->peers = malloc(locator->peers_capacity * sizeof(peer_t));
+    if (!locator->peers || index_rebuild(locator) < 0) {
+        free(locator->peers);
+        free(locator);
+        return NULL;
+    }
 
-    return g_locator;
+    g_locator = locator;
+    return locator;
 }
 
-void
+int
 locator_add(locator_t *locator, const struct sockaddr_in6 *addr,
     uint32_t itad, uint16_t hold, capinfo_transmode_t transmode)
 {
-    if (locator->peers_size + 1 > locator->peers_capacity) {
-        locator->peers_capacity *= 2;
-        locator->peers = realloc(locator->peers,
-            locator->peers_capacity * sizeof(peer_t));
+    write_begin(locator);
+
+    if (peers_reserve(locator, locator->peers_size + 1) < 0) {
+        write_end(locator);
+        return -1;
     }
 
     peer_t *peer = &locator->peers[locator->peers_size++];
     memcpy(&peer->addr, addr, sizeof(struct sockaddr_in6));
     peer->itad = itad;
+    peer->id = 0;
     peer->hold = hold;
     peer->transmode = transmode;
+    peer->plist_in = peer->plist_out = NULL;
+    peer->rmap_in = peer->rmap_out = NULL;
+    peer->reload = 0;
+    peer->dynamic = 0;
+    peer->idle_since = 0;
+
+    /* the indexes are kept at most half full, also after a rebuild failed */
+    if (locator->index.slots_mask + 1 < 2 * locator->peers_capacity) {
+        if (index_rebuild(locator) < 0) {
+            locator->peers_size--;
+            write_end(locator);
+            return -1;
+        }
+    } else {
+        index_insert(locator, locator->peers_size - 1);
+    }
+
+    write_end(locator);
+    return 0;
+}
+
+void
+locator_remove(locator_t *locator, size_t idx)
+{
+    write_begin(locator);
+
+    if (idx < locator->peers_size) {
+        memmove(&locator->peers[idx], &locator->peers[idx + 1],
+            (locator->peers_size - idx - 1) * sizeof(peer_t));
+        locator->peers_size--;
+        /* indexes shifted, removals are rare enough to start over */
+        index_rebuild(locator);
+    }
+
+    write_end(locator);
+}
+
+void
+locator_set_id(locator_t *locator, const struct sockaddr_in6 *addr,
+    uint32_t id)
+{
+    write_begin(locator);
+
+    int idx = find_addr(locator, &addr->sin6_addr, addr_scope(addr));
+    if (idx < 0 && addr_scope(addr))
+        idx = find_addr(locator, &addr->sin6_addr, 0);
+
+    if (idx >= 0 && locator->peers[idx].id != id) {
+        int known = locator->peers[idx].id != 0;
+        locator->peers[idx].id = id;
+        if (known)
+            index_rebuild(locator);     /* drop the stale slot */
+        else
+            index_insert(locator, idx);
+    }
+
+    write_end(locator);
 }
 
 int
-locator_lookup(locator_t *locator, const peer_t **peer,
+locator_lookup(locator_t *locator, peer_t *peer,
     const struct sockaddr_in6 *addr)
 {
-    peer_t *p = NULL;
-    size_t i = 0;
-    for (; i < locator->peers_size; i++) {
-        if (memcmp(&addr->sin6_addr,
-            &locator->peers[i].addr.sin6_addr,
-            sizeof(addr->sin6_addr)) == 0)
+    uint32_t scope = addr_scope(addr);
+    uint32_t seq;
+    int idx;
+
+    do {
+        seq = read_begin(locator);
+        idx = find_addr(locator, &addr->sin6_addr, scope);
+        if (idx < 0 && scope)
+            idx = find_addr(locator, &addr->sin6_addr, 0);
+        copy_peer(locator, peer, idx);
+    } while (read_retry(locator, seq));
+
+    return idx;
+}
+
+size_t
+locator_lookup_itad(locator_t *locator, uint32_t itad, int *idxs,
+    size_t max)
+{
+    uint32_t seq;
+    size_t count;
+
+    do {
+        seq = read_begin(locator);
+        count = 0;
+
+        size_t mask = __atomic_load_n(&locator->index.slots_mask,
+            __ATOMIC_ACQUIRE);
+        const uint32_t *slots = __atomic_load_n(&locator->index.slots,
+            __ATOMIC_ACQUIRE);
+        size_t capacity = __atomic_load_n(&locator->peers_capacity,
+            __ATOMIC_ACQUIRE);
+        const peer_t *peers = __atomic_load_n(&locator->peers,
+            __ATOMIC_ACQUIRE);
+
+        const uint32_t *itad_slots = slots + mask + 1;
+        size_t s = mix(itad) & mask;
+        uint32_t idx = LOCATOR_NONE;
+        for (size_t n = 0; n <= mask; n++, s = (s + 1) & mask) {
+            idx = itad_slots[s];
+            if (idx == LOCATOR_NONE ||
+                (idx < capacity && peers[idx].itad == itad))
+            {
+                break;
+            }
+        }
+
+        /* bounded, a torn list is caught by the retry */
+        for (; idx < capacity && count <= capacity;
+            idx = peers[idx].itad_next)
         {
-            p = &locator->peers[i];
+            if (count < max)
+                idxs[count] = idx;
+            count++;
         }
-    }
+    } while (read_retry(locator, seq));
 
-    *peer = p;
-    return p ? (int)i : -1;
+    return count;
 }
 
+int
+locator_lookup_id(locator_t *locator, peer_t *peer, uint32_t id)
+{
+    uint32_t seq;
+    int idx;
+
+    do {
+        seq = read_begin(locator);
+        idx = id ? find_id(locator, id) : -1;
+        copy_peer(locator, peer, idx);
+    } while (read_retry(locator, seq));
+
+    return idx;
+}
 
 void
 locator_destroy(locator_t *locator)
 {
     if (locator != g_locator)
         return;
+
+    for (size_t i = 0; i < locator->retired_size; i++)
+        free(locator->retired[i]);
+    free(locator->retired);
+    free(locator->index.slots);
+    free(locator->peers);
+    pthread_mutex_destroy(&locator->lock);
     free(locator);
     g_locator = NULL;
 }
-
-
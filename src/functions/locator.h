@@ -23,33 +23,86 @@
 
 #include <protocol/protocol.h>
 
+#include "prefixlist.h"
+#include "routemap.h"
+
 #include <netinet/in.h>
+#include <pthread.h>
+#include <time.h>
+
+
+/* configured peers
+ * kept in a dense array the manager indexes its sessions by, with open
+ * addressing indexes over it by address (sin6_addr and scope id), ITAD and
+ * LS-id; writers are serialized and bump a sequence counter around every
+ * change, lookups run without a lock and retry if one overlapped them,
+ * arrays replaced by growth are retired rather than freed, so a lookup
+ * never reads freed memory
+ */
 
+#define LOCATOR_NONE    UINT32_MAX
 
 typedef struct {
     struct sockaddr_in6     addr;
     uint32_t                itad;
+    uint32_t                id;         /* LS-id from its OPEN, 0 unknown */
     uint16_t                hold;
     capinfo_transmode_t     transmode;
+    prefixlist_t           *plist_in, *plist_out;
+    routemap_t             *rmap_in, *rmap_out;
+    uint8_t                 reload;     /* PEER_RELOAD_*, see manager */
+    uint8_t                 dynamic;    /* let in by a listen range */
+    time_t                  idle_since; /* dynamic, without session */
+    uint32_t                itad_next;  /* next peer of the same ITAD */
 } peer_t;
 
+/* address, ITAD and LS-id tables back to back in one block, each slot
+ * holds a peer index, LOCATOR_NONE if empty */
 typedef struct {
+    uint32_t   *slots;
+    size_t      slots_mask;
+} locator_index_t;
+
+typedef struct locator_s {
+    pthread_mutex_t lock;       /* writers */
+    uint32_t    seq;            /* odd while a writer is changing things */
+
     peer_t     *peers;
     size_t      peers_size, peers_capacity;
+    locator_index_t index;
+
+    void      **retired;        /* replaced arrays, freed on destroy */
+    size_t      retired_size, retired_capacity;
 } locator_t;
 
 
 /* initialize singleton locator known peer list */
 locator_t *locator_new();
 
-/* add a peer */
-void locator_add(locator_t *locator, const struct sockaddr_in6 *addr,
+/* add a peer, -1 if out of memory */
+int locator_add(locator_t *locator, const struct sockaddr_in6 *addr,
     uint32_t itad, uint16_t hold, capinfo_transmode_t transmode);
 
-/* lookup by address */
-int locator_lookup(locator_t *locator, const peer_t **peer,
+/* remove peer at index, later peers move down one */
+void locator_remove(locator_t *locator, size_t idx);
+
+/* record the LS-id a peer announced */
+void locator_set_id(locator_t *locator, const struct sockaddr_in6 *addr,
+    uint32_t id);
+
+/* lookup by address, a link-local address configured without a scope
+ * matches any, copies the peer into peer if not NULL, returns its index
+ * or -1 */
+int locator_lookup(locator_t *locator, peer_t *peer,
     const struct sockaddr_in6 *addr);
 
+/* peers of an ITAD, up to max indexes into idxs, returns how many there are */
+size_t locator_lookup_itad(locator_t *locator, uint32_t itad, int *idxs,
+    size_t max);
+
+/* lookup by LS-id, as locator_lookup */
+int locator_lookup_id(locator_t *locator, peer_t *peer, uint32_t id);
+
 void locator_destroy(locator_t *locator);
 
 
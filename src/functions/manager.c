@@ -20,46 +20,255 @@
 
 */
 
+#define _GNU_SOURCE     /* accept4() */
+
 #include "manager.h"
 
+#include "compress.h"
 #include "locator.h"
 #include "session.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <pthread.h>
 
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 
+#define PEER_RELOAD_SEEN        0x01
+#define PEER_RELOAD_PLIST_IN    0x02
+#define PEER_RELOAD_PLIST_OUT   0x04
+#define PEER_RELOAD_RMAP_IN     0x08
+#define PEER_RELOAD_RMAP_OUT    0x10
+
+/* lock held */
+static peer_t *
+manager_find_peer(manager_t *m, const struct sockaddr_in6 *addr)
+{
+    int idx = locator_lookup(m->locator, NULL, addr);
+    return idx >= 0 ? &m->locator->peers[idx] : NULL;
+}
+
+
+/* lock held */
+static void
+manager_remove_peer(manager_t *m, size_t idx)
+{
+    char addr_buff[INET6_ADDRSTRLEN];
+    printf("[INFO manager] removing peer %s\n",
+        inet_ntop(AF_INET6, &m->locator->peers[idx].addr.sin6_addr,
+        addr_buff, INET6_ADDRSTRLEN));
+
+    session_t *session = registry_remove(m->sessions,
+        &m->locator->peers[idx].addr, NULL);
+    if (session)
+        session_stop(session);
+
+    locator_remove(m->locator, idx);
+}
+
+/* lock held, returns the new peer's index or -1 */
+static int
+manager_push_peer(manager_t *m, const struct sockaddr_in6 *addr,
+    uint32_t itad)
+{
+    size_t size = m->locator->peers_size;
+    if (locator_add(m->locator, addr, itad, m->hold,
+        CAPINFO_TRANS_SEND_RECV) < 0)
+    {
+        fprintf(stderr, "[ERROR manager] could not add peer\n");
+        return -1;
+    }
+    return (int)size;
+}
+
+/* lock held, registers an initiated or accepted session, stops it if the
+ * peer has one already */
+static void
+manager_register(manager_t *m, const peer_t *peer, session_t *session)
+{
+    __atomic_store_n(&session->session_plist_in, peer->plist_in,
+        __ATOMIC_RELEASE);
+    __atomic_store_n(&session->session_plist_out, peer->plist_out,
+        __ATOMIC_RELEASE);
+    __atomic_store_n(&session->session_rmap_in, peer->rmap_in,
+        __ATOMIC_RELEASE);
+    __atomic_store_n(&session->session_rmap_out, peer->rmap_out,
+        __ATOMIC_RELEASE);
+
+    if (registry_insert(m->sessions, &peer->addr, session) < 0)
+        session_stop(session);
+}
+
+static void
+addr_mask(struct in6_addr *addr, uint8_t len)
+{
+    for (int i = 0; i < 16; i++) {
+        int bits = (int)len - i * 8;
+        if (bits <= 0)
+            addr->s6_addr[i] = 0;
+        else if (bits < 8)
+            addr->s6_addr[i] &= 0xff << (8 - bits);
+    }
+}
+
+static int
+range_cmp(const void *a, const void *b)
+{
+    const manager_range_t *x = a, *y = b;
+    if (x->range_len != y->range_len)
+        return x->range_len > y->range_len ? -1 : 1;
+    return memcmp(&x->range_addr, &y->range_addr, sizeof(struct in6_addr));
+}
+
+/* lock held, longest range covering addr, one binary search per distinct
+ * prefix length */
+static manager_range_t *
+range_match(manager_t *m, const struct in6_addr *addr)
+{
+    manager_range_t key;
+    size_t i = 0;
+    while (i < m->ranges_size) {
+        key.range_len = m->ranges[i].range_len;
+        key.range_addr = *addr;
+        addr_mask(&key.range_addr, key.range_len);
+
+        manager_range_t *range = bsearch(&key, m->ranges + i,
+            m->ranges_size - i, sizeof(manager_range_t), &range_cmp);
+        if (range)
+            return range;
+
+        /* first range of the next, shorter, length */
+        size_t lo = i, hi = m->ranges_size;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (m->ranges[mid].range_len >= key.range_len)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        i = lo;
+    }
+    return NULL;
+}
+
+/* lock held, remove dynamic peers no range lets in any more, returns how
+ * many */
+static size_t
+range_prune(manager_t *m)
+{
+    size_t pruned = 0;
+    for (size_t i = m->locator->peers_size; i-- > 0;) {
+        peer_t *peer = &m->locator->peers[i];
+        if (!peer->dynamic)
+            continue;
+
+        const manager_range_t *range = range_match(m, &peer->addr.sin6_addr);
+        if (!range || range->range_itad != peer->itad) {
+            manager_remove_peer(m, i);
+            pruned++;
+        }
+    }
+    return pruned;
+}
+
+/* stopped sessions are dropped so the peer may connect again, dynamic
+ * peers without one for long enough are removed */
 static void *
-manager_loop(void *arg)
+manager_reap_loop(void *arg)
 {
     manager_t *m = arg;
 
+    trace_thread_name("reaper");
+
+    while (1) {
+        sleep(MANAGER_REAP_INTERVAL);
+
+        pthread_mutex_lock(&m->lock);
+        time_t now = time(NULL);
+        for (size_t i = m->locator->peers_size; i-- > 0;) {
+            peer_t *peer = &m->locator->peers[i];
+            session_t *session = registry_find(m->sessions, &peer->addr);
+
+            if (session && session_is_closed(session)) {
+                session_t *removed = registry_remove(m->sessions,
+                    &peer->addr, session);
+                if (removed)
+                    session_stop(removed);
+                session_put(session);
+                session = NULL;
+            }
+            if (session)
+                session_put(session);
+
+            if (!peer->dynamic)
+                continue;
+            if (session)
+                peer->idle_since = 0;
+            else if (!peer->idle_since)
+                peer->idle_since = now;
+            else if (now - peer->idle_since >= MANAGER_DYNAMIC_IDLE)
+                manager_remove_peer(m, i);
+        }
+        pthread_mutex_unlock(&m->lock);
+    }
+
+    return NULL;
+}
+
+static void *
+manager_loop(void *arg)
+{
+    manager_acceptor_t *acc = arg;
+    manager_t *m = acc->acc_manager;
+
+    trace_thread_name("acceptor");
+
     struct sockaddr_in6 peer_addr;
     socklen_t peer_addr_size;
     char addr_buff[INET6_ADDRSTRLEN];
 
     while (1) {
-        /* accept connection (block) */
-        int session_fd = accept(m->fd, (struct sockaddr*)&peer_addr,
-            &peer_addr_size);
+        /* accept connection (block), sessions wait in poll() for more */
+        peer_addr_size = sizeof(peer_addr);
+        int session_fd = accept4(acc->acc_fd, (struct sockaddr*)&peer_addr,
+            &peer_addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (session_fd < 0) {
-            fprintf(stderr, "[ERROR manager] could not accept peer: %s",
-                strerror(errno));
+            /* the connection went away, or descriptors ran out and the
+             * backlog has to wait for sessions to close */
+            if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+                continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+                errno == ENOMEM)
+            {
+                fprintf(stderr, "[ERROR manager] could not accept peer: %s\n",
+                    strerror(errno));
+                usleep(100000);
+                continue;
+            }
+            /* shut down by manager_stop() */
+            if (errno != EINVAL)
+                fprintf(stderr, "[ERROR manager] could not accept peer: %s\n",
+                    strerror(errno));
             return NULL;
         }
+        __atomic_add_fetch(&acc->acc_accepted, 1, __ATOMIC_RELAXED);
 
         /* check that connection comes from peer, and that this peer does not
-         * have an active session */
-        const peer_t *peer = NULL;
-        int idx = locator_lookup(m->locator, &peer, &peer_addr);
-        if (!peer) {
+         * have an active session, strangers are turned away without taking
+         * the lock unless there are ranges to check */
+        peer_t peer;
+        if (locator_lookup(m->locator, NULL, &peer_addr) < 0 &&
+            !__atomic_load_n(&m->ranges_size, __ATOMIC_RELAXED))
+        {
             printf("[INFO manager] rejecting unknown peer connection: %s\n",
                 inet_ntop(AF_INET6, &peer_addr.sin6_addr, addr_buff,
                 INET6_ADDRSTRLEN));
@@ -67,7 +276,34 @@ manager_loop(void *arg)
             continue;
         }
 
-        if (m->sessions[idx]) {
+        /* the peer may have moved or gone before the lock was taken */
+        pthread_mutex_lock(&m->lock);
+        int idx = locator_lookup(m->locator, &peer, &peer_addr);
+        if (idx < 0) {
+            const manager_range_t *range = range_match(m,
+                &peer_addr.sin6_addr);
+            if (range)
+                idx = manager_push_peer(m, &peer_addr, range->range_itad);
+            if (idx < 0) {
+                pthread_mutex_unlock(&m->lock);
+                printf("[INFO manager] rejecting unknown peer connection: "
+                    "%s\n", inet_ntop(AF_INET6, &peer_addr.sin6_addr,
+                    addr_buff, INET6_ADDRSTRLEN));
+                close(session_fd);
+                continue;
+            }
+
+            m->locator->peers[idx].dynamic = 1;
+            locator_lookup(m->locator, &peer, &peer_addr);
+            printf("[INFO manager] dynamic peer %s, itad %u\n",
+                inet_ntop(AF_INET6, &peer_addr.sin6_addr, addr_buff,
+                INET6_ADDRSTRLEN), peer.itad);
+        }
+
+        session_t *existing = registry_find(m->sessions, &peer.addr);
+        if (existing) {
+            session_put(existing);
+            pthread_mutex_unlock(&m->lock);
             printf("[INFO manager] rejecting existing peer connection: %s\n",
                 inet_ntop(AF_INET6, &peer_addr.sin6_addr, addr_buff,
                 INET6_ADDRSTRLEN));
@@ -76,16 +312,72 @@ manager_loop(void *arg)
         }
 
         /* create session (run session thread */
-        session_t *session = session_new_peer(m->itad, m->id,
-            peer->hold, peer->transmode, &peer_addr, session_fd);
+        session_t *session = session_new_peer(&m->env, m->itad, m->id,
+            peer.hold, peer.transmode, &peer_addr, session_fd, peer.itad);
+        if (!session) {
+            pthread_mutex_unlock(&m->lock);
+            close(session_fd);
+            continue;
+        }
 
-        m->sessions[idx] = session; /* save session */
+        manager_register(m, &peer, session);
+        pthread_mutex_unlock(&m->lock);
     }
 
     return NULL;
 }
 
 
+/* bound, listening member of the SO_REUSEPORT group of addr, or -1 */
+static int
+listen_socket(const struct sockaddr_in6 *addr)
+{
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+    if (fd < 0) {
+        fprintf(stderr, "[ERROR manager] could not create listen socket: %s\n",
+            strerror(errno));
+        return -1;
+    }
+
+    /* restarts must not wait for TIME_WAIT to clear, and the connection
+     * is only accepted once the OPEN is in */
+    int one = 1, defer = MANAGER_DEFER_ACCEPT;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+    {
+        fprintf(stderr, "[ERROR manager] could not set listen socket "
+            "options: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer,
+        sizeof(defer)) < 0)
+    {
+        fprintf(stderr, "[WARNING manager] TCP_DEFER_ACCEPT: %s\n",
+            strerror(errno));
+    }
+
+    if (bind(fd, (const struct sockaddr*)addr,
+        sizeof(struct sockaddr_in6)) < 0)
+    {
+        fprintf(stderr, "[ERROR manager] could not bind() listen socket: %s\n",
+            strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, MANAGER_BACKLOG) < 0) {
+        fprintf(stderr,
+            "[ERROR manager] could not listen() listen socket: %s\n",
+            strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
 manager_t *
 manager_new(const struct sockaddr_in6 *listen_addr)
 {
@@ -96,81 +388,448 @@ manager_new(const struct sockaddr_in6 *listen_addr)
 
     manager_t *m = &manager;
 
-    m->thread = 0;
+    m->running = 0;
     m->itad = 0;
     m->id = 0;
 
+    pthread_mutex_init(&m->lock, NULL);
     m->locator = locator_new();
+    m->flood = flood_new();
+    m->env.env_flood = m->flood;
+    m->topology = topology_new();
+    m->env.env_topology = m->topology;
+    m->rib = rib_new();
+    m->env.env_rib = m->rib;
+    m->env.env_locator = m->locator;
+    m->env.env_compress = 0;
+
+    m->sessions = registry_new();
+
+    /* create listen sockets, one per CPU, the first one must work */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = cpus < 1 ? 1 : cpus > MANAGER_ACCEPTORS_MAX ?
+        MANAGER_ACCEPTORS_MAX : (size_t)cpus;
+
+    m->acceptors_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        int fd = listen_socket(listen_addr);
+        if (fd < 0) {
+            if (i == 0)
+                return NULL;
+            break;
+        }
+        manager_acceptor_t *acc = &m->acceptors[m->acceptors_size++];
+        acc->acc_manager = m;
+        acc->acc_fd = fd;
+        acc->acc_accepted = 0;
+    }
+
+    return m;
+}
 
-    m->sessions = malloc(m->locator->peers_size * sizeof(session_t*));
-    memset(m->sessions, 0, m->locator->peers_size * sizeof(session_t*));
 
-    /* create listen socket */
-    m->fd = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
-    if (m->fd < 0) {
-        fprintf(stderr, "[ERROR manager] could not create listen socket: %s\n",
-            strerror(errno));
-        return NULL;
+int
+manager_add_peer(manager_t *manager, const struct sockaddr_in6 *addr,
+    uint32_t itad)
+{
+    pthread_mutex_lock(&manager->lock);
+
+    peer_t *peer = manager_find_peer(manager, addr);
+    if (peer && peer->itad == itad) {
+        peer->reload |= PEER_RELOAD_SEEN;
+        peer->dynamic = 0;      /* configured from now on */
+        pthread_mutex_unlock(&manager->lock);
+        return 0;
     }
+    if (peer)
+        manager_remove_peer(manager, peer - manager->locator->peers);
 
-    if (bind(m->fd, (const struct sockaddr*)listen_addr,
-        sizeof(struct sockaddr_in6)) < 0)
+    int idx = manager_push_peer(manager, addr, itad);
+    if (idx < 0) {
+        pthread_mutex_unlock(&manager->lock);
+        return -1;
+    }
+    manager->locator->peers[idx].reload = PEER_RELOAD_SEEN;
+
+    session_t *session = session_new_initiate(&manager->env, manager->itad,
+        manager->id, manager->hold, CAPINFO_TRANS_SEND_RECV, addr, itad);
+    if (session)
+        manager_register(manager, &manager->locator->peers[idx], session);
+
+    if (manager->reloading)
+        manager->reload.peers_added++;
+
+    pthread_mutex_unlock(&manager->lock);
+    return 1;
+}
+
+int
+manager_peer_prefixlist(manager_t *manager, const struct sockaddr_in6 *addr,
+    prefixlist_t *plist, int out)
+{
+    pthread_mutex_lock(&manager->lock);
+
+    peer_t *peer = manager_find_peer(manager, addr);
+    if (!peer) {
+        pthread_mutex_unlock(&manager->lock);
+        return -1;
+    }
+
+    prefixlist_t **slot = out ? &peer->plist_out : &peer->plist_in;
+    peer->reload |= out ? PEER_RELOAD_PLIST_OUT : PEER_RELOAD_PLIST_IN;
+    if (manager->reloading && *slot != plist)
+        manager->reload.peer_changes++;
+    *slot = plist;
+
+    session_t *session = registry_find(manager->sessions, &peer->addr);
+    if (session) {
+        __atomic_store_n(out ? &session->session_plist_out :
+            &session->session_plist_in, plist, __ATOMIC_RELEASE);
+        session_put(session);
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+    return 0;
+}
+
+int
+manager_peer_routemap(manager_t *manager, const struct sockaddr_in6 *addr,
+    routemap_t *rmap, int out)
+{
+    pthread_mutex_lock(&manager->lock);
+
+    peer_t *peer = manager_find_peer(manager, addr);
+    if (!peer) {
+        pthread_mutex_unlock(&manager->lock);
+        return -1;
+    }
+
+    routemap_t **slot = out ? &peer->rmap_out : &peer->rmap_in;
+    peer->reload |= out ? PEER_RELOAD_RMAP_OUT : PEER_RELOAD_RMAP_IN;
+    if (manager->reloading && *slot != rmap)
+        manager->reload.peer_changes++;
+    *slot = rmap;
+
+    session_t *session = registry_find(manager->sessions, &peer->addr);
+    if (session) {
+        __atomic_store_n(out ? &session->session_rmap_out :
+            &session->session_rmap_in, rmap, __ATOMIC_RELEASE);
+        session_put(session);
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+    return 0;
+}
+
+int
+manager_add_range(manager_t *manager, const struct in6_addr *addr,
+    uint8_t len, uint32_t itad)
+{
+    manager_range_t key = { .range_addr = *addr, .range_len = len };
+    addr_mask(&key.range_addr, len);
+
+    pthread_mutex_lock(&manager->lock);
+
+    manager_range_t *range = bsearch(&key, manager->ranges,
+        manager->ranges_size, sizeof(manager_range_t), &range_cmp);
+    if (range) {
+        range->range_reload = 1;
+        if (range->range_itad == itad) {
+            pthread_mutex_unlock(&manager->lock);
+            return 0;
+        }
+        range->range_itad = itad;
+    } else {
+        if (manager->ranges_size == manager->ranges_capacity) {
+            size_t capacity = manager->ranges_capacity ?
+                manager->ranges_capacity * 2 : 16;
+            manager_range_t *ranges = realloc(manager->ranges,
+                capacity * sizeof(manager_range_t));
+            if (!ranges) {
+                pthread_mutex_unlock(&manager->lock);
+                return -1;
+            }
+            manager->ranges = ranges;
+            manager->ranges_capacity = capacity;
+        }
+
+        key.range_itad = itad;
+        key.range_reload = 1;
+        manager->ranges[manager->ranges_size] = key;
+        qsort(manager->ranges, manager->ranges_size + 1,
+            sizeof(manager_range_t), &range_cmp);
+        __atomic_store_n(&manager->ranges_size, manager->ranges_size + 1,
+            __ATOMIC_RELAXED);
+    }
+
+    /* a reload prunes once at the end */
+    if (!manager->reloading)
+        range_prune(manager);
+
+    pthread_mutex_unlock(&manager->lock);
+    return 1;
+}
+
+int
+manager_remove_range(manager_t *manager, const struct in6_addr *addr,
+    uint8_t len)
+{
+    manager_range_t key = { .range_addr = *addr, .range_len = len };
+    addr_mask(&key.range_addr, len);
+
+    pthread_mutex_lock(&manager->lock);
+
+    manager_range_t *range = bsearch(&key, manager->ranges,
+        manager->ranges_size, sizeof(manager_range_t), &range_cmp);
+    if (!range) {
+        pthread_mutex_unlock(&manager->lock);
+        return -1;
+    }
+
+    memmove(range, range + 1, (manager->ranges + manager->ranges_size -
+        range - 1) * sizeof(manager_range_t));
+    __atomic_store_n(&manager->ranges_size, manager->ranges_size - 1,
+        __ATOMIC_RELAXED);
+    range_prune(manager);
+
+    pthread_mutex_unlock(&manager->lock);
+    return 0;
+}
+
+typedef struct {
+    manager_t  *manager;
+    size_t      refreshed;
+} refresh_arg_t;
+
+/* filters changed over a reload apply to the routes already exchanged too,
+ * without resetting the session */
+static int
+refresh_policy(session_t *session, void *arg)
+{
+    refresh_arg_t *refresh = arg;
+    if (session_get_state(session) != STATE_ESTABLISHED)
+        return 0;
+
+    int refreshed = 0;
+    uint64_t policy = session_policy(session, 1);
+    if (__atomic_exchange_n(&session->session_policy_out, policy,
+        __ATOMIC_RELAXED) != policy)
     {
-        fprintf(stderr, "[ERROR manager] could not bind() listen socket: %s\n",
-            strerror(errno));
-        return NULL;
+        refreshed = rib_refresh_peer(refresh->manager->rib, session, 0) == 0;
     }
 
-    if (listen(m->fd, SOMAXCONN) < 0) {
-        fprintf(stderr,
-            "[ERROR manager] could not listen() listen socket: %s\n",
-            strerror(errno));
-        return NULL;
+    policy = session_policy(session, 0);
+    if (__atomic_exchange_n(&session->session_policy_in, policy,
+        __ATOMIC_RELAXED) != policy)
+    {
+        if (session_request_refresh(session) == 0)
+            refreshed = 1;
+        else
+            printf("[INFO manager] peer %d:%d cannot refresh, the new import "
+                "filters apply to the routes it sends from now on\n",
+                session->session_peer_itad, session->session_peer_id);
     }
 
-    return m;
+    refresh->refreshed += refreshed;
+    return 0;
 }
 
+/* states, and in the slot past the last one the compressed sessions */
+static int
+count_state(session_t *session, void *arg)
+{
+    size_t *states = arg;
+    states[session_get_state(session)]++;
+    states[STATE_ESTABLISHED + 1] += session->session_zrecv;
+    return 0;
+}
 
 void
-manager_add_peer(manager_t *manager, const struct sockaddr_in6 *addr,
-    uint32_t itad)
+manager_print(manager_t *manager, FILE *outf)
 {
-    locator_add(manager->locator, addr, itad, manager->hold,
-        CAPINFO_TRANS_SEND_RECV);
-    
-    if (manager->sessions_size + 1 == manager->locator->peers_size) {
-        manager->sessions = realloc(manager->sessions,
-            manager->locator->peers_size * sizeof(session_t*));
-    } else {
-        fprintf(stderr, "[WARNING manager] manager session vector "
-            "inconsistent with locator\n");
-        return;
+    char addr_buff[INET6_ADDRSTRLEN];
+    size_t live, pooled;
+    session_pool_stats(&live, &pooled);
+
+    /* without the lock, a busy accept loop is not held up by this */
+    size_t states[STATE_ESTABLISHED + 2] = { 0 };
+    registry_foreach(manager->sessions, &count_state, states);
+
+    pthread_mutex_lock(&manager->lock);
+
+    size_t dynamic = 0, active = registry_size(manager->sessions);
+    for (size_t i = 0; i < manager->locator->peers_size; i++)
+        dynamic += manager->locator->peers[i].dynamic;
+
+    fprintf(outf, "peers: %zu configured, %zu dynamic, %zu with a session\n",
+        manager->locator->peers_size - dynamic, dynamic, active);
+    fprintf(outf, "sessions: %zu live, %zu pooled, %zu established, "
+        "%zu opening, %zu idle\n", live, pooled, states[STATE_ESTABLISHED],
+        states[STATE_CONNECT] + states[STATE_ACTIVE] + states[STATE_OPENSENT] +
+        states[STATE_OPENCONFIRM], states[STATE_IDLE]);
+
+    uint64_t accepted = 0;
+    for (size_t i = 0; i < manager->acceptors_size; i++)
+        accepted += __atomic_load_n(&manager->acceptors[i].acc_accepted,
+            __ATOMIC_RELAXED);
+    fprintf(outf, "acceptors: %zu, %llu connections accepted\n",
+        manager->acceptors_size, (unsigned long long)accepted);
+
+    compress_stats_t zstats;
+    compress_get_stats(&zstats);
+    fprintf(outf, "compression: %s, %zu sessions, %llu KiB sent as %llu KiB, "
+        "%llu KiB received as %llu KiB\n",
+        manager->env.env_compress ? "offered" : "off",
+        states[STATE_ESTABLISHED + 1],
+        (unsigned long long)zstats.raw_out / 1024,
+        (unsigned long long)zstats.wire_out / 1024,
+        (unsigned long long)zstats.raw_in / 1024,
+        (unsigned long long)zstats.wire_in / 1024);
+
+    for (size_t i = 0; i < manager->ranges_size; i++) {
+        const manager_range_t *range = &manager->ranges[i];
+        size_t peers = 0;
+        for (size_t j = 0; j < manager->locator->peers_size; j++)
+            peers += manager->locator->peers[j].dynamic &&
+                range_match(manager,
+                &manager->locator->peers[j].addr.sin6_addr) == range;
+        fprintf(outf, "listen-range %s/%u remote-itad %u: %zu peers\n",
+            inet_ntop(AF_INET6, &range->range_addr, addr_buff,
+            INET6_ADDRSTRLEN), range->range_len, range->range_itad, peers);
     }
 
-    manager->sessions[manager->sessions_size - 1] =
-        session_new_initiate(manager->itad, manager->id, manager->hold,
-            CAPINFO_TRANS_SEND_RECV, addr, itad);
+    pthread_mutex_unlock(&manager->lock);
+}
+
+void
+manager_reload_begin(manager_t *manager)
+{
+    pthread_mutex_lock(&manager->lock);
+    for (size_t i = 0; i < manager->locator->peers_size; i++)
+        manager->locator->peers[i].reload = 0;
+    for (size_t i = 0; i < manager->ranges_size; i++)
+        manager->ranges[i].range_reload = 0;
+    memset(&manager->reload, 0, sizeof(manager_reload_t));
+    /* off unless given again, from the next OPEN on */
+    __atomic_store_n(&manager->env.env_compress, 0, __ATOMIC_RELAXED);
+    manager->reloading = 1;
+    pthread_mutex_unlock(&manager->lock);
+}
+
+void
+manager_reload_end(manager_t *manager, manager_reload_t *summary)
+{
+    pthread_mutex_lock(&manager->lock);
+
+    for (size_t i = manager->locator->peers_size; i-- > 0;) {
+        peer_t *peer = &manager->locator->peers[i];
+        if (peer->dynamic)
+            continue;   /* their ranges decide, below */
+        if (!(peer->reload & PEER_RELOAD_SEEN)) {
+            manager_remove_peer(manager, i);
+            manager->reload.peers_removed++;
+            continue;
+        }
+
+        /* a changed hold time applies from the next OPEN on */
+        int updated = peer->hold != manager->hold;
+        peer->hold = manager->hold;
+
+        /* bindings not given again are cleared */
+        session_t *session = registry_find(manager->sessions, &peer->addr);
+        if (!(peer->reload & PEER_RELOAD_PLIST_IN) && peer->plist_in) {
+            peer->plist_in = NULL;
+            if (session)
+                __atomic_store_n(&session->session_plist_in, NULL,
+                    __ATOMIC_RELEASE);
+            updated = 1;
+        }
+        if (!(peer->reload & PEER_RELOAD_PLIST_OUT) && peer->plist_out) {
+            peer->plist_out = NULL;
+            if (session)
+                __atomic_store_n(&session->session_plist_out, NULL,
+                    __ATOMIC_RELEASE);
+            updated = 1;
+        }
+        if (!(peer->reload & PEER_RELOAD_RMAP_IN) && peer->rmap_in) {
+            peer->rmap_in = NULL;
+            if (session)
+                __atomic_store_n(&session->session_rmap_in, NULL,
+                    __ATOMIC_RELEASE);
+            updated = 1;
+        }
+        if (!(peer->reload & PEER_RELOAD_RMAP_OUT) && peer->rmap_out) {
+            peer->rmap_out = NULL;
+            if (session)
+                __atomic_store_n(&session->session_rmap_out, NULL,
+                    __ATOMIC_RELEASE);
+            updated = 1;
+        }
+
+        if (session)
+            session_put(session);
+        manager->reload.peer_changes += updated;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < manager->ranges_size; i++)
+        if (manager->ranges[i].range_reload)
+            manager->ranges[kept++] = manager->ranges[i];
+    __atomic_store_n(&manager->ranges_size, kept, __ATOMIC_RELAXED);
+    manager->reload.peers_removed += range_prune(manager);
+
+    manager->reloading = 0;
+    pthread_mutex_unlock(&manager->lock);
+
+    /* without the lock, refresh requests are sent from here */
+    refresh_arg_t refresh = { manager, 0 };
+    registry_foreach(manager->sessions, &refresh_policy, &refresh);
+
+    manager->reload.peers_refreshed = refresh.refreshed;
+    if (summary)
+        *summary = manager->reload;
 }
 
 void
 manager_run(manager_t *manager)
 {
-    pthread_create(&manager->thread, NULL, &manager_loop, manager);
-    pthread_detach(manager->thread);
+    for (size_t i = 0; i < manager->acceptors_size; i++) {
+        manager_acceptor_t *acc = &manager->acceptors[i];
+        pthread_create(&acc->acc_thread, NULL, &manager_loop, acc);
+        pthread_detach(acc->acc_thread);
+    }
+    manager->running = 1;
+    pthread_create(&manager->reaper, NULL, &manager_reap_loop, manager);
+    pthread_detach(manager->reaper);
+
+    flood_run(manager->flood);
 }
 
 void
 manager_stop(manager_t *manager)
 {
-    shutdown(manager->fd, SHUT_RDWR);
+    for (size_t i = 0; i < manager->acceptors_size; i++)
+        shutdown(manager->acceptors[i].acc_fd, SHUT_RDWR);
 }
 
 void
 manager_destroy(manager_t *manager)
 {
+    pthread_mutex_lock(&manager->lock);
+    for (size_t i = 0; i < manager->locator->peers_size; i++) {
+        session_t *session = registry_remove(manager->sessions,
+            &manager->locator->peers[i].addr, NULL);
+        if (session)
+            session_stop(session);
+    }
+    pthread_mutex_unlock(&manager->lock);
+
+    registry_destroy(manager->sessions);
     locator_destroy(manager->locator);
-    free(manager->sessions);
+    flood_destroy(manager->flood);
+    topology_destroy(manager->topology);
+    rib_destroy(manager->rib);
+    free(manager->ranges);
     manager->itad = 0;
 }
 
@@ -22,31 +22,118 @@
 #define _MANAGER_H
 
 #include <netinet/in.h>
+#include <stdio.h>
 
 #include "session.h"
 #include "locator.h"
+#include "flood.h"
+#include "registry.h"
+#include "rib.h"
+#include "topology.h"
 
 
+#define MANAGER_REAP_INTERVAL   10      /* seconds between reaper passes */
+#define MANAGER_DYNAMIC_IDLE    60      /* dynamic peer kept without session */
+#define MANAGER_ACCEPTORS_MAX   16
+#define MANAGER_BACKLOG         4096    /* per acceptor, capped by somaxconn */
+#define MANAGER_DEFER_ACCEPT    5       /* seconds to wait for the OPEN */
+
+struct manager_s;
+
+/* one listen socket of the SO_REUSEPORT group and the thread accepting on
+ * it, the kernel spreads inbound connections over the group so a burst of
+ * reconnects is not serialized behind a single accept() */
+typedef struct {
+    struct manager_s *acc_manager;
+    int         acc_fd;
+    pthread_t   acc_thread;
+    uint64_t    acc_accepted;
+} manager_acceptor_t;
+
+/* address range inbound connections are accepted from without the peer
+ * being configured, the peer is created when it connects and removed once
+ * its session has been gone for MANAGER_DYNAMIC_IDLE */
+typedef struct {
+    struct in6_addr range_addr;     /* host bits cleared */
+    uint8_t     range_len;
+    uint8_t     range_reload;       /* given again since reload began */
+    uint32_t    range_itad;
+} manager_range_t;
+
+/* what a configuration reload changed */
 typedef struct {
-    pthread_t   thread;
-    int         fd;
+    size_t      peers_added;
+    size_t      peers_removed;
+    size_t      peer_changes;   /* bindings or timers */
+    size_t      peers_refreshed;    /* routes sent again, either way */
+} manager_reload_t;
+
+typedef struct manager_s {
+    manager_acceptor_t acceptors[MANAGER_ACCEPTORS_MAX];
+    size_t      acceptors_size;
+    int         running;
 
     uint32_t    itad;
     uint32_t    id;
     uint16_t    hold;
     locator_t  *locator;
+    flood_t    *flood;
+    topology_t *topology;
+    rib_t      *rib;
+
+    session_env_t env;      /* handed to every session */
+
+    pthread_mutex_t lock;   /* locator and ranges, against accept */
+    registry_t *sessions;   /* by peer address */
 
-    session_t **sessions;
-    size_t      sessions_size;
+    /* sorted longest first, then by address, so the first match is the
+     * longest and each length is one sorted run */
+    manager_range_t *ranges;
+    size_t      ranges_size, ranges_capacity;
+    pthread_t   reaper;
+
+    int         reloading;
+    manager_reload_t reload;
 } manager_t;
 
-/* create manager and bind socket */
+/* create manager and bind a listen socket per online CPU */
 manager_t *manager_new(const struct sockaddr_in6 *listen_addr);
 
-void manager_add_peer(manager_t *manager, const struct sockaddr_in6 *addr,
+/* bind prefix list to peer, -1 if unknown peer */
+int manager_peer_prefixlist(manager_t *manager,
+    const struct sockaddr_in6 *addr, prefixlist_t *plist, int out);
+
+/* bind route-map to peer, -1 if unknown peer */
+int manager_peer_routemap(manager_t *manager,
+    const struct sockaddr_in6 *addr, routemap_t *rmap, int out);
+
+/* add peer and start connecting, a peer already configured with the same
+ * itad is left alone and 0 returned, a different itad replaces it, -1 if
+ * out of memory */
+int manager_add_peer(manager_t *manager, const struct sockaddr_in6 *addr,
     uint32_t itad);
 
-/* run accept loop in thread */
+/* accept peers of itad from addr/len, an existing range is updated, its
+ * dynamic peers of another itad are removed */
+int manager_add_range(manager_t *manager, const struct in6_addr *addr,
+    uint8_t len, uint32_t itad);
+
+/* remove range and the dynamic peers it let in, -1 if unknown */
+int manager_remove_range(manager_t *manager, const struct in6_addr *addr,
+    uint8_t len);
+
+void manager_print(manager_t *manager, FILE *outf);
+
+/* configuration reload, peers and ranges that are not added again by the
+ * time it ends are removed and their sessions stopped, so are dynamic peers
+ * no remaining range covers, bindings not given again are cleared, sessions
+ * of unchanged peers are left running; established peers whose export
+ * filters changed are sent what they now get differently, those whose
+ * import filters changed are asked for a route refresh */
+void manager_reload_begin(manager_t *manager);
+void manager_reload_end(manager_t *manager, manager_reload_t *summary);
+
+/* run an accept loop per listen socket */
 void manager_run(manager_t *manager);
 
 void manager_stop(manager_t *manager);
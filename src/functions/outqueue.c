@@ -0,0 +1,217 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    outqueue.c: per peer queue of routes to send, one entry per route
+
+*/
+
+#include "outqueue.h"
+
+#include "pool.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* utils */
+
+static inline size_t
+route_size(const route_t *route)
+{
+    return sizeof(route_t) + route->route_len;
+}
+
+/* the route hash is FNV, fold the high half in before masking */
+static inline size_t
+slot_of(const outqueue_t *q, uint64_t hash)
+{
+    return (hash ^ hash >> 29) & q->mask;
+}
+
+static int
+outqueue_grow(outqueue_t *q)
+{
+    size_t slots = q->mask ? (q->mask + 1) * 2 : OUTQUEUE_INIT_SIZE;
+    outqueue_node_t **grown = calloc(slots, sizeof(outqueue_node_t*));
+    if (!grown)
+        return -1;
+
+    size_t mask = slots - 1;
+    for (size_t i = 0; q->mask && i <= q->mask; i++) {
+        if (!q->slots[i])
+            continue;
+        size_t s = (q->slots[i]->node_hash ^ q->slots[i]->node_hash >> 29) &
+            mask;
+        while (grown[s])
+            s = (s + 1) & mask;
+        grown[s] = q->slots[i];
+    }
+
+    free(q->slots);
+    q->slots = grown;
+    q->mask = mask;
+    return 0;
+}
+
+/* slot holding route, or the empty one ending its probe run */
+static size_t
+outqueue_find(const outqueue_t *q, const route_t *route, uint64_t hash)
+{
+    size_t s = slot_of(q, hash);
+    for (; q->slots[s]; s = (s + 1) & q->mask) {
+        const outqueue_node_t *node = q->slots[s];
+        if (node->node_hash == hash &&
+            node->node_route.route_len == route->route_len &&
+            memcmp(&node->node_route, route, route_size(route)) == 0)
+        {
+            break;
+        }
+    }
+    return s;
+}
+
+static void
+outqueue_link(outqueue_t *q, outqueue_node_t *node, int class)
+{
+    node->node_class = class;
+    node->node_next = NULL;
+    node->node_prev = q->tail[class];
+    if (q->tail[class])
+        q->tail[class]->node_next = node;
+    else
+        q->head[class] = node;
+    q->tail[class] = node;
+}
+
+static void
+outqueue_unlink(outqueue_t *q, outqueue_node_t *node)
+{
+    int class = node->node_class;
+    if (node->node_prev)
+        node->node_prev->node_next = node->node_next;
+    else
+        q->head[class] = node->node_next;
+    if (node->node_next)
+        node->node_next->node_prev = node->node_prev;
+    else
+        q->tail[class] = node->node_prev;
+    node->node_next = node->node_prev = NULL;
+}
+
+/* pull back the rest of the run over the hole, unless a node would end up
+ * before its home slot */
+static void
+outqueue_unindex(outqueue_t *q, size_t hole)
+{
+    for (size_t s = (hole + 1) & q->mask; q->slots[s];
+        s = (s + 1) & q->mask)
+    {
+        size_t home = slot_of(q, q->slots[s]->node_hash);
+        if (((s - home) & q->mask) < ((s - hole) & q->mask))
+            continue;
+        q->slots[hole] = q->slots[s];
+        hole = s;
+    }
+    q->slots[hole] = NULL;
+}
+
+
+/* public */
+
+int
+outqueue_push(outqueue_t *q, const route_t *route, uint64_t hash,
+    int class)
+{
+    /* kept at most three quarters full */
+    if ((q->size + 1) * 4 > (q->mask + 1) * 3 && outqueue_grow(q) < 0)
+        return -1;
+
+    size_t s = outqueue_find(q, route, hash);
+    if (q->slots[s]) {
+        q->merged++;
+        outqueue_node_t *node = q->slots[s];
+        if (node->node_class <= class)
+            return 0;
+        outqueue_unlink(q, node);
+        outqueue_link(q, node, class);
+        return 1;
+    }
+
+    outqueue_node_t *node = pool_alloc(sizeof(outqueue_node_t) +
+        route->route_len);
+    if (!node)
+        return -1;
+    node->node_hash = hash;
+    memcpy(&node->node_route, route, route_size(route));
+
+    q->slots[s] = node;
+    outqueue_link(q, node, class);
+    q->size++;
+    q->bytes += sizeof(outqueue_node_t) + route->route_len;
+    q->queued++;
+    TRACE(TRACE_MSG_QUEUED, MSG_TYPE_UPDATE, route->route_len);
+    return 1;
+}
+
+outqueue_node_t *
+outqueue_pop(outqueue_t *q, int class)
+{
+    outqueue_node_t *node = q->head[class];
+    if (!node)
+        return NULL;
+    outqueue_unlink(q, node);
+
+    size_t s = slot_of(q, node->node_hash);
+    while (q->slots[s] != node)
+        s = (s + 1) & q->mask;
+    outqueue_unindex(q, s);
+    q->size--;
+    q->bytes -= sizeof(outqueue_node_t) + node->node_route.route_len;
+    return node;
+}
+
+void
+outqueue_node_free(outqueue_node_t *node)
+{
+    pool_free(node, sizeof(outqueue_node_t) + node->node_route.route_len);
+}
+
+size_t
+outqueue_bytes(const outqueue_t *q)
+{
+    return (q->mask ? (q->mask + 1) * sizeof(outqueue_node_t*) : 0) +
+        q->bytes;
+}
+
+void
+outqueue_free(outqueue_t *q)
+{
+    for (int class = 0; class < OUTQUEUE_CLASSES; class++) {
+        outqueue_node_t *node = q->head[class];
+        while (node) {
+            outqueue_node_t *next = node->node_next;
+            outqueue_node_free(node);
+            node = next;
+        }
+        q->head[class] = q->tail[class] = NULL;
+    }
+    free(q->slots);
+    q->slots = NULL;
+    q->mask = q->size = q->bytes = 0;
+}
@@ -0,0 +1,87 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _OUTQUEUE_H
+#define _OUTQUEUE_H
+
+#include <protocol/protocol.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* routes waiting to be sent to one peer
+ * only the route is queued, not what to send for it, the sender looks the
+ * route up when it gets to it and sends it as it is then, so a route that
+ * changes again while queued keeps its place and is sent once; a copy of
+ * each route in the order it was first queued, indexed by hash in an open
+ * addressing table with linear probing, so the queue never holds more
+ * routes than there are in the table
+ * routes are queued in classes drained one after the other, a route queued
+ * again in an earlier class than it is in moves there, one that lost its
+ * path goes ahead of the announcements queued before it, still once
+ * zero-initialized is an empty queue
+ */
+
+#define OUTQUEUE_INIT_SIZE  1024    /* slots, power of 2 */
+
+/* in drain order */
+enum {
+    OUTQUEUE_WITHDRAW,              /* no path for the peer when queued */
+    OUTQUEUE_ANNOUNCE,
+    OUTQUEUE_CLASSES
+};
+
+typedef struct outqueue_node_s {
+    struct outqueue_node_s *node_next;  /* queued after, in its class */
+    struct outqueue_node_s *node_prev;
+    uint64_t            node_hash;
+    int                 node_class;
+    route_t             node_route;     /* address follows */
+} outqueue_node_t;
+
+typedef struct {
+    outqueue_node_t   **slots;      /* by hash, NULL empty */
+    size_t              mask;       /* slots - 1, 0 before the first route */
+    size_t              size, bytes;    /* routes queued, their nodes */
+    outqueue_node_t    *head[OUTQUEUE_CLASSES], *tail[OUTQUEUE_CLASSES];
+
+    uint64_t            queued, merged; /* routes pushed, already queued */
+} outqueue_t;
+
+
+/* queue route in class unless it already is, in that class or an earlier
+ * one, 1 if queued or moved, 0 if it was, -1 if out of memory */
+int outqueue_push(outqueue_t *q, const route_t *route, uint64_t hash,
+    int class);
+
+/* the route queued first in class, taken off the queue, NULL if none, free
+ * it with outqueue_node_free() */
+outqueue_node_t *outqueue_pop(outqueue_t *q, int class);
+
+void outqueue_node_free(outqueue_node_t *node);
+
+size_t outqueue_bytes(const outqueue_t *q);
+
+/* drop everything queued, the queue is empty and usable again */
+void outqueue_free(outqueue_t *q);
+
+
+#endif /* _OUTQUEUE_H */
@@ -0,0 +1,274 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    pathtab.c: hash-consed ITAD path nodes
+
+*/
+
+#include "pathtab.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define PATHTAB_INIT_BUCKETS    1024
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static path_t **g_buckets = NULL;
+static size_t g_buckets_size = 0;
+static size_t g_nodes = 0;
+static uint64_t g_interned = 0, g_hits = 0;
+
+
+/* utils */
+
+static inline size_t
+path_hash(const path_t *parent, uint32_t itad, uint8_t type, uint8_t flags)
+{
+    uint64_t h = (uintptr_t)parent;
+    h ^= ((uint64_t)itad << 16) | ((uint64_t)type << 8) | flags;
+    h *= 0x9e3779b97f4a7c15ULL;
+    return h >> 32;
+}
+
+static void
+pathtab_grow()
+{
+    size_t size = g_buckets_size ? g_buckets_size * 2 : PATHTAB_INIT_BUCKETS;
+    path_t **buckets = calloc(size, sizeof(path_t*));
+    if (!buckets)
+        return;
+
+    for (size_t i = 0; i < g_buckets_size; i++) {
+        path_t *node = g_buckets[i];
+        while (node) {
+            path_t *next = node->path_next;
+            size_t b = path_hash(node->path_parent, node->path_itad,
+                node->path_type, node->path_flags) & (size - 1);
+            node->path_next = buckets[b];
+            buckets[b] = node;
+            node = next;
+        }
+    }
+
+    free(g_buckets);
+    g_buckets = buckets;
+    g_buckets_size = size;
+}
+
+/* find or create node, new reference, lock held */
+static path_t *
+path_get_locked(path_t *parent, uint32_t itad, uint8_t type, uint8_t flags)
+{
+    if (g_nodes + 1 > g_buckets_size)
+        pathtab_grow();
+    if (!g_buckets)
+        return NULL;
+
+    size_t b = path_hash(parent, itad, type, flags) & (g_buckets_size - 1);
+    for (path_t *node = g_buckets[b]; node; node = node->path_next) {
+        if (node->path_parent == parent && node->path_itad == itad &&
+            node->path_type == type && node->path_flags == flags)
+        {
+            __atomic_add_fetch(&node->path_refs, 1, __ATOMIC_RELAXED);
+            return node;
+        }
+    }
+
+    path_t *node = malloc(sizeof(path_t));
+    if (!node)
+        return NULL;
+
+    node->path_parent = parent;
+    node->path_refs = 1;
+    node->path_itad = itad;
+    node->path_type = type;
+    node->path_flags = flags;
+    node->path_len = path_length(parent) + (type == ITADPATH_TYPE_AP_SET ?
+        ((flags & PATH_FLAG_SEG_END) != 0) : 1);
+    node->path_count = (parent ? parent->path_count : 0) + 1;
+    node->path_bloom = (parent ? parent->path_bloom : 0) |
+        path_bloom_bit(itad);
+
+    if (parent)
+        __atomic_add_fetch(&parent->path_refs, 1, __ATOMIC_RELAXED);
+
+    node->path_next = g_buckets[b];
+    g_buckets[b] = node;
+    g_nodes++;
+
+    return node;
+}
+
+/* drop reference, lock held, frees the node and its unshared tail at 0 */
+static void
+path_unref_locked(path_t *path)
+{
+    while (path && __atomic_sub_fetch(&path->path_refs, 1,
+        __ATOMIC_ACQ_REL) == 0)
+    {
+        size_t b = path_hash(path->path_parent, path->path_itad,
+            path->path_type, path->path_flags) & (g_buckets_size - 1);
+        path_t **prev = &g_buckets[b];
+        while (*prev != path)
+            prev = &(*prev)->path_next;
+        *prev = path->path_next;
+        g_nodes--;
+
+        path_t *parent = path->path_parent;
+        free(path);
+        path = parent;
+    }
+}
+
+
+/* public */
+
+path_t *
+path_intern(const void *val, size_t len, arena_t *arena)
+{
+    /* segment bounds were checked by parse_msg_update() */
+    size_t segs_size = 0;
+    const itadpath_t **segs = arena_alloc(arena,
+        (len / sizeof(itadpath_t) + 1) * sizeof(itadpath_t*));
+    if (!segs)
+        return NULL;
+    for (size_t off = 0; off < len;) {
+        const itadpath_t *seg = val + off;
+        segs[segs_size++] = seg;
+        off += sizeof(itadpath_t) + (sizeof(uint32_t) * seg->itadpath_len);
+    }
+
+    pthread_mutex_lock(&g_lock);
+
+    /* built from the origin end, which is where paths have most in common */
+    path_t *path = NULL;
+    int created = 0;
+    for (size_t s = segs_size; s-- > 0;) {
+        const itadpath_t *seg = segs[s];
+        for (size_t j = seg->itadpath_len; j-- > 0;) {
+            size_t nodes = g_nodes;
+            path_t *node = path_get_locked(path, seg->itadpath_segs[j],
+                seg->itadpath_type,
+                j == seg->itadpath_len - 1u ? PATH_FLAG_SEG_END : 0);
+            if (!node) {
+                path_unref_locked(path);
+                pthread_mutex_unlock(&g_lock);
+                return NULL;
+            }
+            created |= g_nodes != nodes;
+            path_unref_locked(path);
+            path = node;
+        }
+    }
+
+    g_interned++;
+    if (!created)
+        g_hits++;
+
+    pthread_mutex_unlock(&g_lock);
+
+    return path;
+}
+
+path_t *
+path_prepend(path_t *path, uint32_t itad)
+{
+    uint8_t flags = path && path->path_type == ITADPATH_TYPE_AP_SEQUENCE ?
+        0 : PATH_FLAG_SEG_END;
+
+    pthread_mutex_lock(&g_lock);
+    path_t *node = path_get_locked(path, itad, ITADPATH_TYPE_AP_SEQUENCE,
+        flags);
+    pthread_mutex_unlock(&g_lock);
+
+    return node;
+}
+
+path_t *
+path_ref(path_t *path)
+{
+    if (path)
+        __atomic_add_fetch(&path->path_refs, 1, __ATOMIC_RELAXED);
+    return path;
+}
+
+void
+path_unref(path_t *path)
+{
+    if (!path)
+        return;
+
+    /* only the last reference needs the table */
+    uint32_t refs = __atomic_load_n(&path->path_refs, __ATOMIC_RELAXED);
+    while (refs > 1) {
+        if (__atomic_compare_exchange_n(&path->path_refs, &refs, refs - 1, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&g_lock);
+    path_unref_locked(path);
+    pthread_mutex_unlock(&g_lock);
+}
+
+runtime_error_t
+path_write(const path_t *path, void *buff, size_t len)
+{
+    size_t off = 0;
+
+    while (path) {
+        if (off + sizeof(itadpath_t) > len)
+            return ERROR_BUFFLEN;
+
+        itadpath_t *seg = buff + off;
+        seg->itadpath_type = path->path_type;
+        seg->itadpath_len = 0;
+        off += sizeof(itadpath_t);
+
+        uint8_t type = path->path_type;
+        for (;;) {
+            if (off + sizeof(uint32_t) > len)
+                return ERROR_BUFFLEN;
+            seg->itadpath_segs[seg->itadpath_len++] = path->path_itad;
+            off += sizeof(uint32_t);
+
+            int end = path->path_flags & PATH_FLAG_SEG_END;
+            path = path->path_parent;
+            if (end || !path || path->path_type != type ||
+                seg->itadpath_len == UINT8_MAX)
+            {
+                break;
+            }
+        }
+    }
+
+    return off;
+}
+
+void
+pathtab_print(FILE *outf)
+{
+    pthread_mutex_lock(&g_lock);
+    fprintf(outf, "paths: %zu nodes, %zu buckets, %llu interned, "
+        "%llu fully shared\n", g_nodes, g_buckets_size,
+        (unsigned long long)g_interned, (unsigned long long)g_hits);
+    pthread_mutex_unlock(&g_lock);
+}
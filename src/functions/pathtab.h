@@ -0,0 +1,98 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _PATHTAB_H
+#define _PATHTAB_H
+
+#include <protocol/protocol.h>
+
+#include "arena.h"
+
+#include <stdio.h>
+
+
+/* interned ITAD paths
+ * a path is a chain of nodes from its first (most recent) ITAD towards the
+ * originating ITAD, nodes are hash-consed on (parent, itad, segment) so
+ * identical paths are the same pointer and paths with a common tail share
+ * it, every node carries the length and an ITAD bitmap of the whole path
+ * from itself to the origin, NULL is the empty path
+ */
+
+#define PATH_FLAG_SEG_END   0x01    /* last ITAD of its segment */
+
+typedef struct path_s {
+    struct path_s  *path_parent;    /* towards the origin */
+    struct path_s  *path_next;      /* hash chain */
+    uint32_t        path_refs;
+    uint32_t        path_itad;
+    uint8_t         path_type;      /* enum itadpath_type */
+    uint8_t         path_flags;
+    uint16_t        path_len;       /* path length, a set counts 1 */
+    uint16_t        path_count;     /* ITADs in the path */
+    uint64_t        path_bloom;     /* ITADs in the path, 1 bit each */
+} path_t;
+
+
+/* intern a validated AdvertisementPath/RoutedPath value, its segments are
+ * listed in arena, new reference */
+path_t *path_intern(const void *val, size_t len, arena_t *arena);
+
+/* path with itad in front, as a sequence, new reference */
+path_t *path_prepend(path_t *path, uint32_t itad);
+
+path_t *path_ref(path_t *path);
+
+void path_unref(path_t *path);
+
+/* write path back as segments, returns bytes or ERROR_BUFFLEN */
+runtime_error_t path_write(const path_t *path, void *buff, size_t len);
+
+void pathtab_print(FILE *outf);
+
+
+static inline uint64_t
+path_bloom_bit(uint32_t itad)
+{
+    return 1ULL << (((uint64_t)itad * 0x9e3779b97f4a7c15ULL) >> 58);
+}
+
+/* 1 if itad is in the path, the bitmap rules out almost every miss without
+ * walking the chain */
+static inline int
+path_contains(const path_t *path, uint32_t itad)
+{
+    if (!path || !(path->path_bloom & path_bloom_bit(itad)))
+        return 0;
+
+    for (; path; path = path->path_parent)
+        if (path->path_itad == itad)
+            return 1;
+    return 0;
+}
+
+static inline uint16_t
+path_length(const path_t *path)
+{
+    return path ? path->path_len : 0;
+}
+
+
+#endif /* _PATHTAB_H */
@@ -0,0 +1,342 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    pool.c: size-class pools with per-thread caches
+
+*/
+
+#include "pool.h"
+
+#include <protocol/protocol.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#define BENCH_LIVE      256     /* objects the benchmark keeps allocated */
+
+typedef struct pool_obj_s {
+    struct pool_obj_s *obj_next;
+} pool_obj_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pool_obj_t     *head;
+    uint64_t        size;       /* objects in head */
+    uint64_t        carved;
+    char           *slab;       /* remainder of the last slab */
+    size_t          slab_left;
+} pool_global_t;
+
+typedef struct {
+    pool_obj_t     *head;
+    uint32_t        count;
+} pool_cache_t;
+
+static pool_global_t g_classes[POOL_CLASSES];
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+static uint64_t g_sys_allocs = 0, g_sys_frees = 0, g_slab_bytes = 0;
+#ifdef POOL_COUNT_ENABLED
+static uint64_t g_allocs[POOL_CLASSES], g_frees[POOL_CLASSES];
+#endif
+
+static __thread pool_cache_t t_caches[POOL_CLASSES];
+static __thread int t_registered = 0;
+
+
+/* utils */
+
+/* 32, 48, 64, 96, ... 6144, 8192 */
+static inline int
+size_class(size_t size)
+{
+    if (size <= POOL_MIN_SIZE)
+        return 0;
+    int b = 64 - __builtin_clzll(size - 1);     /* 2^b >= size */
+    return size <= (size_t)3 << (b - 2) ? 2 * (b - 5) - 1 : 2 * (b - 5);
+}
+
+static inline size_t
+class_size(int c)
+{
+    return (c & 1 ? 48 : 32) << (c / 2);
+}
+
+static void
+thread_exit(void *arg)
+{
+    pool_thread_flush();
+}
+
+static void
+pool_init()
+{
+    for (int c = 0; c < POOL_CLASSES; c++)
+        pthread_mutex_init(&g_classes[c].lock, NULL);
+    pthread_key_create(&g_key, &thread_exit);
+}
+
+/* global lock held, cut up to POOL_BATCH objects into cache */
+static void
+carve(pool_global_t *g, int c, pool_cache_t *cache)
+{
+    size_t size = class_size(c);
+
+    if (g->slab_left < size) {
+        /* the tail of the old slab is too small for one, it is lost */
+        char *slab = malloc(POOL_SLAB_SIZE);
+        if (!slab)
+            return;
+        __atomic_add_fetch(&g_sys_allocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&g_slab_bytes, POOL_SLAB_SIZE, __ATOMIC_RELAXED);
+        g->slab = slab;
+        g->slab_left = POOL_SLAB_SIZE;
+    }
+
+    for (int i = 0; i < POOL_BATCH && g->slab_left >= size; i++) {
+        pool_obj_t *obj = (pool_obj_t*)g->slab;
+        g->slab += size;
+        g->slab_left -= size;
+        obj->obj_next = cache->head;
+        cache->head = obj;
+        cache->count++;
+        g->carved++;
+    }
+}
+
+/* first trade of the thread with the globals */
+static inline void
+thread_register()
+{
+    if (t_registered)
+        return;
+    /* the value only makes thread_exit() run for this thread */
+    pthread_once(&g_once, &pool_init);
+    pthread_setspecific(g_key, (void*)1);
+    t_registered = 1;
+}
+
+static void
+refill(int c, pool_cache_t *cache)
+{
+    thread_register();
+
+    pool_global_t *g = &g_classes[c];
+    pthread_mutex_lock(&g->lock);
+    for (int i = 0; i < POOL_BATCH && g->head; i++) {
+        pool_obj_t *obj = g->head;
+        g->head = obj->obj_next;
+        g->size--;
+        obj->obj_next = cache->head;
+        cache->head = obj;
+        cache->count++;
+    }
+    if (!cache->head)
+        carve(g, c, cache);
+    pthread_mutex_unlock(&g->lock);
+}
+
+/* hand count objects from the front of cache to the global list */
+static void
+drain(int c, pool_cache_t *cache, uint32_t count)
+{
+    if (!count)
+        return;
+    thread_register();
+
+    pool_obj_t *first = cache->head, *last = first;
+    for (uint32_t i = 1; i < count; i++)
+        last = last->obj_next;
+    cache->head = last->obj_next;
+    cache->count -= count;
+
+    pool_global_t *g = &g_classes[c];
+    pthread_mutex_lock(&g->lock);
+    last->obj_next = g->head;
+    g->head = first;
+    g->size += count;
+    pthread_mutex_unlock(&g->lock);
+}
+
+
+/* public */
+
+void *
+pool_alloc(size_t size)
+{
+    if (size > POOL_MAX_SIZE) {
+        __atomic_add_fetch(&g_sys_allocs, 1, __ATOMIC_RELAXED);
+        return malloc(size);
+    }
+
+    int c = size_class(size);
+    pool_cache_t *cache = &t_caches[c];
+    if (!cache->head) {
+        refill(c, cache);
+        if (!cache->head)
+            return NULL;
+    }
+
+    pool_obj_t *obj = cache->head;
+    cache->head = obj->obj_next;
+    cache->count--;
+
+#ifdef POOL_COUNT_ENABLED
+    __atomic_add_fetch(&g_allocs[c], 1, __ATOMIC_RELAXED);
+#endif
+    return obj;
+}
+
+void
+pool_free(void *ptr, size_t size)
+{
+    if (!ptr)
+        return;
+
+    if (size > POOL_MAX_SIZE) {
+        __atomic_add_fetch(&g_sys_frees, 1, __ATOMIC_RELAXED);
+        free(ptr);
+        return;
+    }
+
+    int c = size_class(size);
+    pool_cache_t *cache = &t_caches[c];
+    pool_obj_t *obj = ptr;
+    obj->obj_next = cache->head;
+    cache->head = obj;
+    cache->count++;
+
+#ifdef POOL_COUNT_ENABLED
+    __atomic_add_fetch(&g_frees[c], 1, __ATOMIC_RELAXED);
+#endif
+
+    /* keep some, so a thread alternating between allocating and freeing
+     * at the boundary does not trade every time */
+    if (cache->count > POOL_CACHE_MAX)
+        drain(c, cache, POOL_BATCH);
+}
+
+void
+pool_thread_flush()
+{
+    for (int c = 0; c < POOL_CLASSES; c++)
+        drain(c, &t_caches[c], t_caches[c].count);
+}
+
+void
+pool_get_stats(pool_stats_t *stats)
+{
+    pthread_once(&g_once, &pool_init);
+    memset(stats, 0, sizeof(pool_stats_t));
+
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        pool_global_t *g = &g_classes[c];
+        pool_class_stats_t *cs = &stats->classes[c];
+        cs->size = class_size(c);
+
+        pthread_mutex_lock(&g->lock);
+        cs->carved = g->carved;
+        cs->global = g->size;
+        pthread_mutex_unlock(&g->lock);
+
+#ifdef POOL_COUNT_ENABLED
+        cs->allocs = __atomic_load_n(&g_allocs[c], __ATOMIC_RELAXED);
+        cs->frees = __atomic_load_n(&g_frees[c], __ATOMIC_RELAXED);
+#endif
+    }
+
+    stats->sys_allocs = __atomic_load_n(&g_sys_allocs, __ATOMIC_RELAXED);
+    stats->sys_frees = __atomic_load_n(&g_sys_frees, __ATOMIC_RELAXED);
+    stats->slab_bytes = __atomic_load_n(&g_slab_bytes, __ATOMIC_RELAXED);
+}
+
+void
+pool_print(FILE *outf)
+{
+    pool_stats_t stats;
+    pool_get_stats(&stats);
+
+    fprintf(outf, "%6s %10s %10s %10s", "size", "carved", "global",
+        "out");
+#ifdef POOL_COUNT_ENABLED
+    fprintf(outf, " %12s %12s", "allocs", "frees");
+#endif
+    fprintf(outf, "\n");
+
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        const pool_class_stats_t *cs = &stats.classes[c];
+        if (!cs->carved)
+            continue;
+        /* out is in use or in a thread cache */
+        fprintf(outf, "%6zu %10llu %10llu %10llu", cs->size,
+            (unsigned long long)cs->carved, (unsigned long long)cs->global,
+            (unsigned long long)(cs->carved - cs->global));
+#ifdef POOL_COUNT_ENABLED
+        fprintf(outf, " %12llu %12llu", (unsigned long long)cs->allocs,
+            (unsigned long long)cs->frees);
+#endif
+        fprintf(outf, "\n");
+    }
+
+    fprintf(outf, "slabs: %llu KiB, malloc() calls: %llu, free() calls: "
+        "%llu\n", (unsigned long long)stats.slab_bytes / 1024,
+        (unsigned long long)stats.sys_allocs,
+        (unsigned long long)stats.sys_frees);
+#ifndef POOL_COUNT_ENABLED
+    fprintf(outf, "allocation counts not compiled in, rebuild with "
+        "-DPOOL_COUNT=ON\n");
+#endif
+}
+
+int
+pool_benchmark(size_t ops, double *rate, uint64_t *sys_allocs)
+{
+    /* session buffers, outbound UPDATEs, flooded messages, raw attributes */
+    static const size_t sizes[] = { MAX_MSG_SIZE, MAX_MSG_SIZE + 48, 512, 64 };
+    void *live[BENCH_LIVE];
+
+    /* one pass to carve the working set */
+    for (size_t i = 0; i < BENCH_LIVE; i++)
+        if (!(live[i] = pool_alloc(sizes[i % 4])))
+            return -1;
+
+    uint64_t sys0 = __atomic_load_n(&g_sys_allocs, __ATOMIC_RELAXED);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = (i * 7) % BENCH_LIVE;
+        pool_free(live[slot], sizes[slot % 4]);
+        live[slot] = pool_alloc(sizes[slot % 4]);
+        /* touched, like a message would be */
+        *(volatile char*)live[slot] = (char)i;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *sys_allocs = __atomic_load_n(&g_sys_allocs, __ATOMIC_RELAXED) - sys0;
+
+    for (size_t i = 0; i < BENCH_LIVE; i++)
+        pool_free(live[i], sizes[i % 4]);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    *rate = secs > 0 ? ops / secs : 0;
+    return 0;
+}
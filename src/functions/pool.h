@@ -0,0 +1,83 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+/* size-class object pools
+ * every size up to POOL_MAX_SIZE rounds up to one of 17 classes, 32 bytes
+ * to 8K in steps of a half power of 2, objects of a class are carved out of
+ * slabs that are never returned to the system; each thread keeps a cache
+ * per class and trades POOL_BATCH objects at a time with the class's global
+ * list, so once the working set is carved allocating and freeing is a list
+ * push or pop without a lock or a malloc()
+ * frees are sized, the caller passes the size it allocated, larger sizes go
+ * to malloc() directly
+ * compiled with -DPOOL_COUNT=ON (cmake) every allocation and free is
+ * counted too, the counters slabs and fallbacks are always kept
+ */
+
+#define POOL_CLASSES        17
+#define POOL_MIN_SIZE       32
+#define POOL_MAX_SIZE       8192
+#define POOL_SLAB_SIZE      65536   /* bytes carved at a time */
+#define POOL_BATCH          32      /* objects per trade with the global */
+#define POOL_CACHE_MAX      64      /* thread cache size that triggers one */
+
+typedef struct {
+    size_t      size;           /* object size */
+    uint64_t    carved;         /* objects cut out of slabs */
+    uint64_t    global;         /* in the global list */
+    uint64_t    allocs, frees;  /* POOL_COUNT only */
+} pool_class_stats_t;
+
+typedef struct {
+    pool_class_stats_t classes[POOL_CLASSES];
+    uint64_t    sys_allocs;     /* malloc() calls, slabs and fallbacks */
+    uint64_t    sys_frees;
+    uint64_t    slab_bytes;
+} pool_stats_t;
+
+
+void *pool_alloc(size_t size);
+
+/* size must be the one passed to pool_alloc() */
+void pool_free(void *ptr, size_t size);
+
+/* return the calling thread's caches to the global lists, done for every
+ * thread when it exits */
+void pool_thread_flush();
+
+void pool_get_stats(pool_stats_t *stats);
+
+void pool_print(FILE *outf);
+
+/* allocation and free loop sized like message processing, once its working
+ * set is carved, returns the operations per second and the malloc() calls
+ * made meanwhile by any thread, which should be none */
+int pool_benchmark(size_t ops, double *rate, uint64_t *sys_allocs);
+
+
+#endif /* _POOL_H */
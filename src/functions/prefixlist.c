@@ -0,0 +1,817 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    prefixlist.c: prefix lists compiled into immutable digit tries
+
+*/
+
+#include "prefixlist.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMPORT_LINE_MAX         512
+#define IMPORT_CHUNK_BYTES      (1 << 20)   /* per thread, at least */
+#define IMPORT_CHUNK_RECORDS    (1 << 15)
+
+/* one import worker's share of the file and what it parsed */
+typedef struct {
+    const char             *job_begin, *job_end;    /* text */
+    const prefixlist_import_rec_t *job_recs;        /* binary */
+    size_t                  job_recs_size;
+    const char            **job_servers;
+    size_t                  job_servers_size;
+
+    prefixlist_entry_t     *job_entries;
+    size_t                  job_size, job_capacity;
+    size_t                  job_bad;
+    int                     job_failed;
+} import_job_t;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER; /* registry */
+static prefixlist_t *g_lists = NULL;
+static uint32_t g_version = 0;
+
+
+/* utils */
+
+static inline int
+symbol(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'E')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'e')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static void
+entries_free(prefixlist_entry_t *entries, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        free(entries[i].entry_prefix);
+        free(entries[i].entry_server);
+    }
+    free(entries);
+}
+
+static int
+entry_cmp(const void *a, const void *b)
+{
+    const prefixlist_entry_t *x = a, *y = b;
+    int r = strcmp(x->entry_prefix, y->entry_prefix);
+    if (r)
+        return r;
+    return x->entry_seq < y->entry_seq ? -1 : x->entry_seq > y->entry_seq;
+}
+
+/* the first KEY_SYMBOLS symbols, one per nibble, 0 past the end, so keys
+ * order like the prefixes they come from as long as those are not longer */
+#define KEY_SYMBOLS     15
+
+typedef struct {
+    uint64_t    key;
+    uint32_t    idx;
+} sort_key_t;
+
+static inline uint64_t
+entry_key(const prefixlist_entry_t *entry)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < KEY_SYMBOLS; i++) {
+        key <<= 4;
+        if (i < entry->entry_len)
+            key |= symbol(entry->entry_prefix[i]) + 1;
+    }
+    return key;
+}
+
+/* sort by prefix then seq, staged entries are already in seq order, so a
+ * stable LSD radix sort on the keys does it but for ties, which are
+ * duplicates or longer prefixes and left to qsort */
+static int
+entries_sort(prefixlist_entry_t *entries, size_t size)
+{
+    if (size < 2)
+        return 0;
+
+    sort_key_t *keys = malloc(size * sizeof(sort_key_t));
+    sort_key_t *tmp = malloc(size * sizeof(sort_key_t));
+    size_t *counts = malloc(65536 * sizeof(size_t));
+    prefixlist_entry_t *sorted = malloc(size * sizeof(prefixlist_entry_t));
+    if (!keys || !tmp || !counts || !sorted) {
+        free(keys);
+        free(tmp);
+        free(counts);
+        free(sorted);
+        return -1;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        keys[i].key = entry_key(&entries[i]);
+        keys[i].idx = i;
+    }
+
+    for (int shift = 0; shift < 64; shift += 16) {
+        memset(counts, 0, 65536 * sizeof(size_t));
+        for (size_t i = 0; i < size; i++)
+            counts[(keys[i].key >> shift) & 0xffff]++;
+        if (counts[(keys[0].key >> shift) & 0xffff] == size)
+            continue;   /* all alike */
+
+        size_t sum = 0;
+        for (size_t d = 0; d < 65536; d++) {
+            size_t c = counts[d];
+            counts[d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < size; i++)
+            tmp[counts[(keys[i].key >> shift) & 0xffff]++] = keys[i];
+
+        sort_key_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        sorted[i] = entries[keys[i].idx];
+
+    for (size_t i = 0; i < size;) {
+        size_t j = i + 1;
+        while (j < size && keys[j].key == keys[i].key)
+            j++;
+        if (j - i > 1)
+            qsort(&sorted[i], j - i, sizeof(prefixlist_entry_t), &entry_cmp);
+        i = j;
+    }
+
+    memcpy(entries, sorted, size * sizeof(prefixlist_entry_t));
+
+    free(keys);
+    free(tmp);
+    free(counts);
+    free(sorted);
+    return 0;
+}
+
+/* validate and uppercase a prefix */
+static int
+entry_digits(char *digits)
+{
+    if (!*digits)
+        return -1;
+    for (char *c = digits; *c; c++) {
+        if (symbol(*c) < 0)
+            return -1;
+        *c = toupper(*c);
+    }
+    return strlen(digits) > UINT16_MAX ? -1 : 0;
+}
+
+/* one of "[proto] [permit|deny] [exact] [server]", server is not copied */
+static int
+entry_token(prefixlist_entry_t *entry, char *tok)
+{
+    uint16_t app_proto = app_proto_from_name(tok);
+
+    if (app_proto)
+        entry->entry_app_proto = app_proto;
+    else if (strcmp(tok, "permit") == 0)
+        entry->entry_action = PREFIXLIST_PERMIT;
+    else if (strcmp(tok, "deny") == 0)
+        entry->entry_action = PREFIXLIST_DENY;
+    else if (strcmp(tok, "exact") == 0)
+        entry->entry_exact = 1;
+    else if (!entry->entry_server)
+        entry->entry_server = tok;
+    else
+        return -1;
+    return 0;
+}
+
+static int
+staged_reserve(prefixlist_t *plist, size_t n)
+{
+    if (plist->staged_size + n <= plist->staged_capacity)
+        return 0;
+
+    size_t capacity = plist->staged_capacity ? plist->staged_capacity : 16;
+    while (capacity < plist->staged_size + n)
+        capacity *= 2;
+    prefixlist_entry_t *staged = realloc(plist->staged,
+        capacity * sizeof(prefixlist_entry_t));
+    if (!staged)
+        return -1;
+    plist->staged = staged;
+    plist->staged_capacity = capacity;
+    return 0;
+}
+
+static int
+job_push(import_job_t *job, const prefixlist_entry_t *entry)
+{
+    if (job->job_size == job->job_capacity) {
+        size_t capacity = job->job_capacity ? job->job_capacity * 2 : 1024;
+        prefixlist_entry_t *entries = realloc(job->job_entries,
+            capacity * sizeof(prefixlist_entry_t));
+        if (!entries)
+            return -1;
+        job->job_entries = entries;
+        job->job_capacity = capacity;
+    }
+
+    prefixlist_entry_t *e = &job->job_entries[job->job_size];
+    *e = *entry;
+    e->entry_prefix = strdup(entry->entry_prefix);
+    e->entry_server = entry->entry_server ? strdup(entry->entry_server) :
+        NULL;
+    if (!e->entry_prefix || (entry->entry_server && !e->entry_server)) {
+        free(e->entry_prefix);
+        free(e->entry_server);
+        return -1;
+    }
+    job->job_size++;
+    return 0;
+}
+
+/* "prefix[,token]...", tokens as for prefix, blank and # lines skipped */
+static void *
+import_csv(void *arg)
+{
+    import_job_t *job = arg;
+    char line[IMPORT_LINE_MAX];
+
+    for (const char *p = job->job_begin; p < job->job_end;) {
+        const char *nl = memchr(p, '\n', job->job_end - p);
+        const char *eol = nl ? nl : job->job_end;
+        size_t len = eol - p;
+        const char *next = nl ? nl + 1 : job->job_end;
+
+        if (len && p[len - 1] == '\r')
+            len--;
+        if (len == 0 || p[0] == '#') {
+            p = next;
+            continue;
+        }
+        if (len >= sizeof(line)) {
+            job->job_bad++;
+            p = next;
+            continue;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p = next;
+
+        prefixlist_entry_t entry = { 0 };
+        entry.entry_action = PREFIXLIST_PERMIT;
+
+        char *save = NULL;
+        char *digits = strtok_r(line, ", \t", &save);
+        int ok = digits && entry_digits(digits) == 0;
+        for (char *tok = strtok_r(NULL, ", \t", &save); ok && tok;
+            tok = strtok_r(NULL, ", \t", &save))
+        {
+            ok = entry_token(&entry, tok) == 0;
+        }
+        if (!ok) {
+            job->job_bad++;
+            continue;
+        }
+
+        entry.entry_prefix = digits;
+        entry.entry_len = strlen(digits);
+        if (job_push(job, &entry) < 0) {
+            job->job_failed = 1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void *
+import_binary(void *arg)
+{
+    import_job_t *job = arg;
+    char digits[PREFIXLIST_IMPORT_DIGITS + 1];
+
+    for (size_t i = 0; i < job->job_recs_size; i++) {
+        const prefixlist_import_rec_t *rec = &job->job_recs[i];
+        /* a NUL inside would make the entry shorter than rec_len */
+        if (rec->rec_len > PREFIXLIST_IMPORT_DIGITS ||
+            memchr(rec->rec_digits, '\0', rec->rec_len) ||
+            rec->rec_server > job->job_servers_size)
+        {
+            job->job_bad++;
+            continue;
+        }
+        memcpy(digits, rec->rec_digits, rec->rec_len);
+        digits[rec->rec_len] = '\0';
+        if (entry_digits(digits) < 0) {
+            job->job_bad++;
+            continue;
+        }
+
+        prefixlist_entry_t entry = { 0 };
+        entry.entry_prefix = digits;
+        entry.entry_server = (char *)job->job_servers[rec->rec_server];
+        entry.entry_len = rec->rec_len;
+        entry.entry_app_proto = rec->rec_app_proto;
+        entry.entry_action = rec->rec_flags & PREFIXLIST_REC_DENY ?
+            PREFIXLIST_DENY : PREFIXLIST_PERMIT;
+        entry.entry_exact = !!(rec->rec_flags & PREFIXLIST_REC_EXACT);
+        if (job_push(job, &entry) < 0) {
+            job->job_failed = 1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int
+str_equal(const char *a, const char *b)
+{
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+/* same match semantics, sequence numbers and counters aside, both sorted */
+static int
+entries_equal(const prefixlist_entry_t *a, size_t a_size,
+    const prefixlist_entry_t *b, size_t b_size)
+{
+    if (a_size != b_size)
+        return 0;
+    for (size_t i = 0; i < a_size; i++)
+        if (strcmp(a[i].entry_prefix, b[i].entry_prefix) != 0 ||
+            !str_equal(a[i].entry_server, b[i].entry_server) ||
+            a[i].entry_app_proto != b[i].entry_app_proto ||
+            a[i].entry_action != b[i].entry_action ||
+            a[i].entry_exact != b[i].entry_exact)
+        {
+            return 0;
+        }
+    return 1;
+}
+
+static void
+trie_swap(prefixlist_t *plist, prefixlist_trie_t *trie)
+{
+    pthread_mutex_lock(&plist->lock);
+    prefixlist_trie_t *old = plist->trie;
+    plist->trie = trie;
+    pthread_mutex_unlock(&plist->lock);
+
+    prefixlist_release(old);
+}
+
+/* build the subtree for entries [lo, hi), which share depth digits, into
+ * node n, siblings get contiguous slots so a child is found by popcount */
+static int
+trie_build(prefixlist_trie_t *trie, size_t *capacity, uint32_t n,
+    size_t lo, size_t hi, size_t depth)
+{
+    prefixlist_entry_t *entries = trie->trie_entries;
+
+    size_t i = lo;
+    while (i < hi && entries[i].entry_len == depth)
+        i++;
+    trie->trie_nodes[n].node_entry = lo;
+    trie->trie_nodes[n].node_entries = i - lo;
+
+    uint16_t map = 0;
+    for (size_t j = i; j < hi; j++)
+        map |= 1 << symbol(entries[j].entry_prefix[depth]);
+
+    size_t children = __builtin_popcount(map);
+    if (trie->trie_nodes_size + children > *capacity) {
+        while (trie->trie_nodes_size + children > *capacity)
+            *capacity *= 2;
+        prefixlist_node_t *nodes = realloc(trie->trie_nodes,
+            *capacity * sizeof(prefixlist_node_t));
+        if (!nodes)
+            return -1;
+        trie->trie_nodes = nodes;
+    }
+
+    uint32_t child = trie->trie_nodes_size;
+    trie->trie_nodes_size += children;
+    trie->trie_nodes[n].node_child = child;
+    trie->trie_nodes[n].node_map = map;
+
+    /* sorted, so each symbol is one run */
+    while (i < hi) {
+        char c = entries[i].entry_prefix[depth];
+        size_t j = i;
+        while (j < hi && entries[j].entry_prefix[depth] == c)
+            j++;
+        if (trie_build(trie, capacity, child++, i, j, depth + 1) < 0)
+            return -1;
+        i = j;
+    }
+
+    return 0;
+}
+
+static void
+trie_free(prefixlist_trie_t *trie)
+{
+    entries_free(trie->trie_entries, trie->trie_entries_size);
+    free(trie->trie_nodes);
+    free(trie);
+}
+
+
+/* public */
+
+prefixlist_t *
+prefixlist_find(const char *name)
+{
+    pthread_mutex_lock(&g_lock);
+    prefixlist_t *plist = g_lists;
+    while (plist && strcmp(plist->name, name) != 0)
+        plist = plist->next;
+    pthread_mutex_unlock(&g_lock);
+    return plist;
+}
+
+prefixlist_t *
+prefixlist_get(const char *name)
+{
+    prefixlist_t *plist = prefixlist_find(name);
+    if (plist)
+        return plist;
+
+    plist = calloc(1, sizeof(prefixlist_t));
+    if (!plist)
+        return NULL;
+    strncpy(plist->name, name, PREFIXLIST_NAME_MAX - 1);
+    pthread_mutex_init(&plist->lock, NULL);
+
+    /* lists are never freed, sessions keep plain pointers to them */
+    pthread_mutex_lock(&g_lock);
+    plist->next = g_lists;
+    g_lists = plist;
+    pthread_mutex_unlock(&g_lock);
+
+    return plist;
+}
+
+void
+prefixlist_begin(prefixlist_t *plist)
+{
+    entries_free(plist->staged, plist->staged_size);
+    plist->staged = NULL;
+    plist->staged_size = plist->staged_capacity = 0;
+    plist->reload_seen = 1;
+}
+
+int
+prefixlist_stage(prefixlist_t *plist, char *args)
+{
+    prefixlist_entry_t entry = { 0 };
+    entry.entry_action = PREFIXLIST_PERMIT;
+
+    char *digits = strtok(args, " ");
+    if (!digits || entry_digits(digits) < 0)
+        return -1;
+
+    for (char *tok = strtok(NULL, " "); tok; tok = strtok(NULL, " "))
+        if (entry_token(&entry, tok) < 0)
+            return -1;
+
+    if (staged_reserve(plist, 1) < 0)
+        return -1;
+
+    entry.entry_prefix = strdup(digits);
+    entry.entry_server = entry.entry_server ? strdup(entry.entry_server) :
+        NULL;
+    entry.entry_len = strlen(digits);
+    entry.entry_seq = plist->staged_size;
+    plist->staged[plist->staged_size++] = entry;
+
+    return 0;
+}
+
+int
+prefixlist_import(prefixlist_t *plist, const char *path, size_t *bad)
+{
+    *bad = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+    const char *end = map + st.st_size;
+    const prefixlist_import_hdr_t *hdr = (const void *)map;
+    int binary = (size_t)st.st_size >= sizeof(prefixlist_import_hdr_t) &&
+        hdr->imp_magic == PREFIXLIST_IMPORT_MAGIC;
+
+    /* binary records and server table, checked before anything is spawned */
+    const prefixlist_import_rec_t *recs = NULL;
+    const char **servers = NULL;
+    if (binary) {
+        recs = (const void *)(hdr + 1);
+        if ((size_t)(end - (const char *)recs) / sizeof(*recs) <
+            hdr->imp_records)
+        {
+            goto error;
+        }
+        /* every name takes at least its NUL */
+        const char *table = (const char *)(recs + hdr->imp_records);
+        if ((size_t)(end - table) < hdr->imp_servers)
+            goto error;
+        servers = malloc(((size_t)hdr->imp_servers + 1) * sizeof(char *));
+        if (!servers)
+            goto error;
+        servers[0] = NULL;
+        for (uint32_t i = 1; i <= hdr->imp_servers; i++) {
+            const char *nul = memchr(table, '\0', end - table);
+            if (!nul)
+                goto error;
+            servers[i] = table;
+            table = nul + 1;
+        }
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t work = binary ? hdr->imp_records / IMPORT_CHUNK_RECORDS :
+        (size_t)st.st_size / IMPORT_CHUNK_BYTES;
+    size_t threads = work + 1;
+    if (threads > (size_t)(cpus > 0 ? cpus : 1))
+        threads = cpus > 0 ? cpus : 1;
+    if (threads > PREFIXLIST_IMPORT_THREADS)
+        threads = PREFIXLIST_IMPORT_THREADS;
+
+    import_job_t jobs[PREFIXLIST_IMPORT_THREADS] = { 0 };
+    pthread_t tids[PREFIXLIST_IMPORT_THREADS];
+
+    /* text chunks end at a line boundary, each starts after the previous */
+    const char *pos = map;
+    for (size_t t = 0; t < threads; t++) {
+        import_job_t *job = &jobs[t];
+        if (binary) {
+            job->job_recs = recs + hdr->imp_records * t / threads;
+            job->job_recs_size = hdr->imp_records * (t + 1) / threads -
+                hdr->imp_records * t / threads;
+            job->job_servers = servers;
+            job->job_servers_size = hdr->imp_servers;
+        } else {
+            const char *chunk_end = t + 1 == threads ? end :
+                map + st.st_size * (t + 1) / threads;
+            if (chunk_end < pos)
+                chunk_end = pos;
+            const char *nl = chunk_end < end ?
+                memchr(chunk_end, '\n', end - chunk_end) : NULL;
+            chunk_end = nl ? nl + 1 : end;
+            job->job_begin = pos;
+            job->job_end = chunk_end;
+            pos = chunk_end;
+        }
+    }
+
+    size_t spawned = 0;
+    for (; spawned < threads; spawned++)
+        if (pthread_create(&tids[spawned], NULL, binary ? &import_binary :
+            &import_csv, &jobs[spawned]) != 0)
+        {
+            break;
+        }
+    /* whatever could not get a thread is parsed here */
+    for (size_t t = spawned; t < threads; t++)
+        binary ? import_binary(&jobs[t]) : import_csv(&jobs[t]);
+    for (size_t t = 0; t < spawned; t++)
+        pthread_join(tids[t], NULL);
+
+    size_t total = 0;
+    int failed = 0;
+    for (size_t t = 0; t < threads; t++) {
+        total += jobs[t].job_size;
+        *bad += jobs[t].job_bad;
+        failed |= jobs[t].job_failed;
+    }
+
+    if (failed || staged_reserve(plist, total) < 0) {
+        for (size_t t = 0; t < threads; t++)
+            entries_free(jobs[t].job_entries, jobs[t].job_size);
+        goto error;
+    }
+
+    /* in file order, as if typed */
+    for (size_t t = 0; t < threads; t++) {
+        for (size_t i = 0; i < jobs[t].job_size; i++) {
+            jobs[t].job_entries[i].entry_seq = plist->staged_size;
+            plist->staged[plist->staged_size++] = jobs[t].job_entries[i];
+        }
+        free(jobs[t].job_entries);
+    }
+
+    free(servers);
+    munmap((void *)map, st.st_size);
+    return total;
+
+error:
+    free(servers);
+    munmap((void *)map, st.st_size);
+    return -1;
+}
+
+int
+prefixlist_commit(prefixlist_t *plist)
+{
+    if (entries_sort(plist->staged, plist->staged_size) < 0)
+        return -1;
+
+    /* an unchanged definition keeps the running trie and its counters, only
+     * the configuration thread swaps tries so it may look without the lock */
+    prefixlist_trie_t *cur = plist->trie;
+    if (cur && entries_equal(cur->trie_entries, cur->trie_entries_size,
+        plist->staged, plist->staged_size))
+    {
+        prefixlist_begin(plist);
+        return cur->trie_entries_size;
+    }
+
+    prefixlist_trie_t *trie = calloc(1, sizeof(prefixlist_trie_t));
+    if (!trie)
+        return -1;
+
+    trie->trie_refs = 1;
+    trie->trie_version = __atomic_add_fetch(&g_version, 1, __ATOMIC_RELAXED);
+    trie->trie_entries = plist->staged;
+    trie->trie_entries_size = plist->staged_size;
+    plist->staged = NULL;
+    plist->staged_size = plist->staged_capacity = 0;
+
+    size_t capacity = 64;
+    trie->trie_nodes = malloc(capacity * sizeof(prefixlist_node_t));
+    trie->trie_nodes_size = 1;
+    if (!trie->trie_nodes || trie_build(trie, &capacity, 0, 0,
+        trie->trie_entries_size, 0) < 0)
+    {
+        trie_free(trie);
+        return -1;
+    }
+
+    size_t size = trie->trie_entries_size;
+    trie_swap(plist, trie);
+
+    return size;
+}
+
+void
+prefixlist_reload_begin()
+{
+    pthread_mutex_lock(&g_lock);
+    for (prefixlist_t *plist = g_lists; plist; plist = plist->next)
+        plist->reload_seen = 0;
+    pthread_mutex_unlock(&g_lock);
+}
+
+int
+prefixlist_reload_end()
+{
+    int removed = 0;
+
+    pthread_mutex_lock(&g_lock);
+    for (prefixlist_t *plist = g_lists; plist; plist = plist->next)
+        if (!plist->reload_seen && plist->trie) {
+            trie_swap(plist, NULL);
+            removed++;
+        }
+    pthread_mutex_unlock(&g_lock);
+
+    return removed;
+}
+
+prefixlist_trie_t *
+prefixlist_acquire(prefixlist_t *plist)
+{
+    if (!plist)
+        return NULL;
+
+    pthread_mutex_lock(&plist->lock);
+    prefixlist_trie_t *trie = plist->trie;
+    if (trie)
+        __atomic_add_fetch(&trie->trie_refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&plist->lock);
+
+    return trie;
+}
+
+void
+prefixlist_release(prefixlist_trie_t *trie)
+{
+    if (trie && __atomic_sub_fetch(&trie->trie_refs, 1, __ATOMIC_ACQ_REL) == 0)
+        trie_free(trie);
+}
+
+int
+prefixlist_match(prefixlist_trie_t *trie, const route_t *route)
+{
+    if (!trie)
+        return PREFIXLIST_PERMIT;
+
+    const prefixlist_node_t *node = &trie->trie_nodes[0];
+    prefixlist_entry_t *best = NULL;
+
+    for (size_t depth = 0;; depth++) {
+        for (uint32_t i = 0; i < node->node_entries; i++) {
+            prefixlist_entry_t *entry =
+                &trie->trie_entries[node->node_entry + i];
+            if ((entry->entry_app_proto == 0 ||
+                entry->entry_app_proto == route->route_app_proto) &&
+                (!entry->entry_exact || depth == route->route_len))
+            {
+                best = entry;
+                break;
+            }
+        }
+
+        if (depth == route->route_len)
+            break;
+
+        int sym = symbol(route->route_addr[depth]);
+        if (sym < 0 || !(node->node_map & (1 << sym)))
+            break;
+        node = &trie->trie_nodes[node->node_child +
+            __builtin_popcount(node->node_map & ((1 << sym) - 1))];
+    }
+
+    if (!best)
+        return PREFIXLIST_DENY;
+
+    __atomic_add_fetch(&best->entry_hits, 1, __ATOMIC_RELAXED);
+    return best->entry_action;
+}
+
+void
+prefixlist_print(FILE *outf, const char *name)
+{
+    pthread_mutex_lock(&g_lock);
+    prefixlist_t *lists = g_lists;
+    pthread_mutex_unlock(&g_lock);
+
+    for (prefixlist_t *plist = lists; plist; plist = plist->next) {
+        if (name && strcmp(plist->name, name) != 0)
+            continue;
+
+        prefixlist_trie_t *trie = prefixlist_acquire(plist);
+        if (!trie) {
+            fprintf(outf, "prefix-list %s: not committed\n", plist->name);
+            continue;
+        }
+
+        fprintf(outf, "prefix-list %s: version %u, %zu entries, %zu nodes\n",
+            plist->name, trie->trie_version, trie->trie_entries_size,
+            trie->trie_nodes_size);
+
+        for (size_t i = 0; i < trie->trie_entries_size; i++) {
+            const prefixlist_entry_t *entry = &trie->trie_entries[i];
+
+            fprintf(outf, "  %-6s %-20s %-11s %-5s %-24s %llu hits\n",
+                entry->entry_action == PREFIXLIST_PERMIT ? "permit" : "deny",
+                entry->entry_prefix, entry->entry_app_proto ?
+                    app_proto_name(entry->entry_app_proto) : "any",
+                entry->entry_exact ? "exact" : "",
+                entry->entry_server ? entry->entry_server : "",
+                (unsigned long long)__atomic_load_n(&entry->entry_hits,
+                    __ATOMIC_RELAXED));
+        }
+
+        prefixlist_release(trie);
+    }
+}
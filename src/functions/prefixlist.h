@@ -0,0 +1,152 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _PREFIXLIST_H
+#define _PREFIXLIST_H
+
+#include <protocol/protocol.h>
+
+#include <stdio.h>
+#include <pthread.h>
+
+
+/* named prefix lists
+ * entries are staged by the configuration and compiled on commit into an
+ * immutable digit trie, which replaces the previous one atomically, readers
+ * hold a reference to the trie they acquired, so a match never sees a
+ * half-built list, matching walks the route once, longest prefix wins
+ */
+
+#define PREFIXLIST_LOCAL        "local" /* unnamed list, originated routes */
+#define PREFIXLIST_NAME_MAX     32
+#define PREFIXLIST_SYMBOLS      15      /* 0-9 A-E */
+
+enum prefixlist_action {
+    PREFIXLIST_DENY,
+    PREFIXLIST_PERMIT
+};
+
+typedef struct {
+    char       *entry_prefix;       /* digits, uppercase */
+    char       *entry_server;       /* NextHopServer to originate with */
+    uint16_t    entry_len;
+    uint16_t    entry_app_proto;    /* 0 matches any */
+    uint8_t     entry_action;
+    uint8_t     entry_exact;        /* only routes of the same length */
+    uint32_t    entry_seq;          /* configuration order */
+    uint64_t    entry_hits;
+} prefixlist_entry_t;
+
+/* bulk import file, binary form: header, fixed size records, then the
+ * server table, imp_servers NUL terminated names, rec_server indexes it
+ * from 1, 0 is no server; anything else is read as text, one
+ * "prefix[,token]..." line per entry, tokens as for the prefix command */
+#define PREFIXLIST_IMPORT_MAGIC     0x3158465050495254ULL /* "TRIPPFX1" */
+#define PREFIXLIST_IMPORT_DIGITS    26
+#define PREFIXLIST_IMPORT_THREADS   16
+
+#define PREFIXLIST_REC_DENY         0x01
+#define PREFIXLIST_REC_EXACT        0x02
+
+typedef struct {
+    uint64_t    imp_magic;
+    uint32_t    imp_records;
+    uint32_t    imp_servers;
+} prefixlist_import_hdr_t;
+
+typedef struct {
+    uint8_t     rec_len;
+    uint8_t     rec_flags;          /* PREFIXLIST_REC_* */
+    uint16_t    rec_app_proto;      /* 0 matches any */
+    uint16_t    rec_server;
+    char        rec_digits[PREFIXLIST_IMPORT_DIGITS];
+} prefixlist_import_rec_t;
+
+typedef struct {
+    uint32_t    node_child;         /* first child, siblings contiguous */
+    uint16_t    node_map;           /* children present, bit per symbol */
+    uint16_t    node_entries;       /* entries ending here */
+    uint32_t    node_entry;         /* first of them */
+} prefixlist_node_t;
+
+/* compiled list, never modified after commit except for hit counters */
+typedef struct {
+    uint32_t            trie_refs;
+    uint32_t            trie_version;
+    prefixlist_node_t  *trie_nodes;
+    size_t              trie_nodes_size;
+    prefixlist_entry_t *trie_entries;   /* sorted by prefix */
+    size_t              trie_entries_size;
+} prefixlist_trie_t;
+
+typedef struct prefixlist_s {
+    struct prefixlist_s *next;
+    char                name[PREFIXLIST_NAME_MAX];
+
+    pthread_mutex_t     lock;           /* trie pointer and refs */
+    prefixlist_trie_t  *trie;           /* NULL until first commit */
+
+    /* configuration side only */
+    prefixlist_entry_t *staged;
+    size_t              staged_size, staged_capacity;
+    int                 reload_seen;    /* defined since reload began */
+} prefixlist_t;
+
+
+/* find list by name, creating an empty one */
+prefixlist_t *prefixlist_get(const char *name);
+
+/* find list by name, NULL if not defined */
+prefixlist_t *prefixlist_find(const char *name);
+
+/* start a new definition of the list, the current one stays in effect */
+void prefixlist_begin(prefixlist_t *plist);
+
+/* parse and stage "<digits> [proto] [permit|deny] [exact] [server]" */
+int prefixlist_stage(prefixlist_t *plist, char *args);
+
+/* map a bulk import file and stage its entries, parsed in parallel, after
+ * what is already staged, returns the number staged or -1, entries that do
+ * not parse are skipped and counted in bad */
+int prefixlist_import(prefixlist_t *plist, const char *path, size_t *bad);
+
+/* compile the staged definition and swap it in, returns entry count, a
+ * definition equal to the running one is dropped and the trie kept */
+int prefixlist_commit(prefixlist_t *plist);
+
+/* configuration reload, lists not defined again by the time it ends are
+ * undefined, returns how many */
+void prefixlist_reload_begin();
+int prefixlist_reload_end();
+
+/* current trie with a reference held, NULL if the list is not defined */
+prefixlist_trie_t *prefixlist_acquire(prefixlist_t *plist);
+
+void prefixlist_release(prefixlist_trie_t *trie);
+
+/* action for route, an undefined list permits everything, a defined one
+ * denies what it does not match */
+int prefixlist_match(prefixlist_trie_t *trie, const route_t *route);
+
+/* all lists if name is NULL */
+void prefixlist_print(FILE *outf, const char *name);
+
+
+#endif /* _PREFIXLIST_H */
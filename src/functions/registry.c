@@ -0,0 +1,325 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    registry.c: sharded session registry with lock-free iteration
+
+*/
+
+#include "registry.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_INIT      64
+
+
+/* utils */
+
+static inline uint32_t
+addr_scope(const struct sockaddr_in6 *addr)
+{
+    return IN6_IS_ADDR_LINKLOCAL(&addr->sin6_addr) ? addr->sin6_scope_id : 0;
+}
+
+static uint64_t
+addr_hash(const struct in6_addr *addr, uint32_t scope)
+{
+    uint64_t hi, lo;
+    memcpy(&hi, addr->s6_addr, 8);
+    memcpy(&lo, addr->s6_addr + 8, 8);
+    uint64_t h = hi ^ (lo * 0x9e3779b97f4a7c15ULL) ^ scope;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline registry_slot_t *
+slot_get(registry_shard_t *shard, uint32_t slot)
+{
+    return &shard->chunks[slot / REGISTRY_CHUNK][slot % REGISTRY_CHUNK];
+}
+
+/* shard lock held from here on */
+
+/* index position holding addr, or the empty one it would go in */
+static size_t
+index_probe(registry_shard_t *shard, const struct in6_addr *addr,
+    uint32_t scope, uint64_t hash)
+{
+    size_t i = (hash >> 8) & shard->index_mask;
+    while (shard->index[i]) {
+        const registry_slot_t *slot = slot_get(shard, shard->index[i] - 1);
+        if (slot->slot_scope == scope &&
+            memcmp(&slot->slot_addr, addr, sizeof(struct in6_addr)) == 0)
+        {
+            break;
+        }
+        i = (i + 1) & shard->index_mask;
+    }
+    return i;
+}
+
+static int
+index_grow(registry_shard_t *shard)
+{
+    size_t size = shard->index ? (shard->index_mask + 1) * 2 : INDEX_INIT;
+    uint32_t *index = calloc(size, sizeof(uint32_t));
+    if (!index)
+        return -1;
+
+    uint32_t *old = shard->index;
+    size_t old_size = old ? shard->index_mask + 1 : 0;
+    shard->index = index;
+    shard->index_mask = size - 1;
+
+    for (size_t i = 0; i < old_size; i++) {
+        if (!old[i])
+            continue;
+        const registry_slot_t *slot = slot_get(shard, old[i] - 1);
+        size_t j = index_probe(shard, &slot->slot_addr, slot->slot_scope,
+            addr_hash(&slot->slot_addr, slot->slot_scope));
+        index[j] = old[i];
+    }
+
+    free(old);
+    return 0;
+}
+
+/* linear probing delete, later entries of the cluster move back so no
+ * probe stops early */
+static void
+index_delete(registry_shard_t *shard, size_t i)
+{
+    size_t j = i;
+    shard->index[i] = 0;
+    while (1) {
+        j = (j + 1) & shard->index_mask;
+        if (!shard->index[j])
+            return;
+        const registry_slot_t *slot = slot_get(shard, shard->index[j] - 1);
+        size_t home = (addr_hash(&slot->slot_addr, slot->slot_scope) >> 8) &
+            shard->index_mask;
+        /* j stays if its home lies cyclically in (i, j] */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        shard->index[i] = shard->index[j];
+        shard->index[j] = 0;
+        i = j;
+    }
+}
+
+static int64_t
+slot_alloc(registry_shard_t *shard)
+{
+    if (shard->free_size)
+        return shard->free[--shard->free_size];
+
+    if (shard->slots_size == shard->chunks_size * REGISTRY_CHUNK) {
+        if (shard->chunks_size == REGISTRY_CHUNKS)
+            return -1;
+        registry_slot_t *chunk = calloc(REGISTRY_CHUNK,
+            sizeof(registry_slot_t));
+        if (!chunk)
+            return -1;
+        shard->chunks[shard->chunks_size] = chunk;
+        __atomic_store_n(&shard->chunks_size, shard->chunks_size + 1,
+            __ATOMIC_RELEASE);
+    }
+    return shard->slots_size++;
+}
+
+static void
+slot_free(registry_shard_t *shard, uint32_t slot)
+{
+    if (shard->free_size == shard->free_capacity) {
+        size_t capacity = shard->free_capacity ? shard->free_capacity * 2 :
+            REGISTRY_CHUNK;
+        uint32_t *free_slots = realloc(shard->free,
+            capacity * sizeof(uint32_t));
+        if (!free_slots)
+            return;     /* the slot is lost, not reused */
+        shard->free = free_slots;
+        shard->free_capacity = capacity;
+    }
+    shard->free[shard->free_size++] = slot;
+}
+
+
+/* public */
+
+registry_t *
+registry_new()
+{
+    registry_t *reg = calloc(1, sizeof(registry_t));
+    if (!reg)
+        return NULL;
+
+    for (size_t i = 0; i < REGISTRY_SHARDS; i++)
+        pthread_mutex_init(&reg->shards[i].lock, NULL);
+
+    return reg;
+}
+
+int
+registry_insert(registry_t *reg, const struct sockaddr_in6 *addr,
+    session_t *session)
+{
+    uint32_t scope = addr_scope(addr);
+    uint64_t hash = addr_hash(&addr->sin6_addr, scope);
+    registry_shard_t *shard = &reg->shards[hash & (REGISTRY_SHARDS - 1)];
+
+    pthread_mutex_lock(&shard->lock);
+
+    if ((shard->entries + 1) * 2 > (shard->index ? shard->index_mask + 1 : 0)
+        && index_grow(shard) < 0)
+    {
+        goto error;
+    }
+
+    size_t i = index_probe(shard, &addr->sin6_addr, scope, hash);
+    if (shard->index[i])
+        goto error;
+
+    int64_t s = slot_alloc(shard);
+    if (s < 0)
+        goto error;
+
+    registry_slot_t *slot = slot_get(shard, s);
+    slot->slot_addr = addr->sin6_addr;
+    slot->slot_scope = scope;
+    __atomic_store_n(&slot->slot_session, session, __ATOMIC_RELEASE);
+    shard->index[i] = s + 1;
+    shard->entries++;
+    __atomic_add_fetch(&reg->size, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+
+error:
+    pthread_mutex_unlock(&shard->lock);
+    return -1;
+}
+
+session_t *
+registry_find(registry_t *reg, const struct sockaddr_in6 *addr)
+{
+    uint32_t scope = addr_scope(addr);
+    uint64_t hash = addr_hash(&addr->sin6_addr, scope);
+    registry_shard_t *shard = &reg->shards[hash & (REGISTRY_SHARDS - 1)];
+    session_t *session = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    if (shard->index) {
+        size_t i = index_probe(shard, &addr->sin6_addr, scope, hash);
+        /* registered sessions hold the registry's reference */
+        if (shard->index[i]) {
+            session = slot_get(shard, shard->index[i] - 1)->slot_session;
+            session_tryget(session);
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return session;
+}
+
+session_t *
+registry_remove(registry_t *reg, const struct sockaddr_in6 *addr,
+    session_t *session)
+{
+    uint32_t scope = addr_scope(addr);
+    uint64_t hash = addr_hash(&addr->sin6_addr, scope);
+    registry_shard_t *shard = &reg->shards[hash & (REGISTRY_SHARDS - 1)];
+    session_t *removed = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    if (shard->index) {
+        size_t i = index_probe(shard, &addr->sin6_addr, scope, hash);
+        uint32_t s = shard->index[i];
+        registry_slot_t *slot = s ? slot_get(shard, s - 1) : NULL;
+
+        if (slot && (!session || slot->slot_session == session)) {
+            removed = slot->slot_session;
+            __atomic_store_n(&slot->slot_session, NULL, __ATOMIC_RELEASE);
+            index_delete(shard, i);
+            slot_free(shard, s - 1);
+            shard->entries--;
+            __atomic_sub_fetch(&reg->size, 1, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return removed;
+}
+
+void
+registry_foreach(registry_t *reg, registry_fn_t fn, void *arg)
+{
+    for (size_t i = 0; i < REGISTRY_SHARDS; i++) {
+        registry_shard_t *shard = &reg->shards[i];
+        uint32_t chunks = __atomic_load_n(&shard->chunks_size,
+            __ATOMIC_ACQUIRE);
+
+        for (uint32_t c = 0; c < chunks; c++) {
+            registry_slot_t *chunk = shard->chunks[c];
+            for (size_t j = 0; j < REGISTRY_CHUNK; j++) {
+                session_t *session = __atomic_load_n(
+                    &chunk[j].slot_session, __ATOMIC_ACQUIRE);
+                if (!session || !session_tryget(session))
+                    continue;
+
+                /* pooled and reused since it was loaded */
+                if (__atomic_load_n(&chunk[j].slot_session,
+                    __ATOMIC_ACQUIRE) != session)
+                {
+                    session_put(session);
+                    continue;
+                }
+
+                int stop = fn(session, arg);
+                session_put(session);
+                if (stop)
+                    return;
+            }
+        }
+    }
+}
+
+size_t
+registry_size(registry_t *reg)
+{
+    return __atomic_load_n(&reg->size, __ATOMIC_RELAXED);
+}
+
+void
+registry_destroy(registry_t *reg)
+{
+    for (size_t i = 0; i < REGISTRY_SHARDS; i++) {
+        registry_shard_t *shard = &reg->shards[i];
+        for (uint32_t c = 0; c < shard->chunks_size; c++) {
+            for (size_t j = 0; j < REGISTRY_CHUNK; j++)
+                if (shard->chunks[c][j].slot_session)
+                    session_put(shard->chunks[c][j].slot_session);
+            free(shard->chunks[c]);
+        }
+        free(shard->free);
+        free(shard->index);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(reg);
+}
@@ -0,0 +1,94 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _REGISTRY_H
+#define _REGISTRY_H
+
+#include "session.h"
+
+#include <netinet/in.h>
+#include <pthread.h>
+
+
+/* session registry
+ * running sessions by peer address, split into shards by address hash,
+ * each with its own writer lock, so inserts and removals from different
+ * threads rarely meet; slots live in chunks that never move and sessions
+ * are type-stable, so iteration takes no lock at all: a reader loads the
+ * slot, tries to take a reference and checks the slot still holds the
+ * session, a lookup by address takes the shard lock only
+ */
+
+#define REGISTRY_SHARDS     64      /* power of 2 */
+#define REGISTRY_CHUNK      256     /* slots per chunk */
+#define REGISTRY_CHUNKS     1024    /* chunks per shard, 16M sessions */
+
+typedef struct {
+    session_t          *slot_session;   /* NULL if free */
+    struct in6_addr     slot_addr;
+    uint32_t            slot_scope;
+} registry_slot_t;
+
+typedef struct {
+    pthread_mutex_t     lock;
+    registry_slot_t    *chunks[REGISTRY_CHUNKS];
+    uint32_t            chunks_size;    /* published after the chunk */
+    uint32_t            slots_size;     /* slots ever handed out */
+    uint32_t           *free;           /* released slots */
+    size_t              free_size, free_capacity;
+    uint32_t           *index;          /* slot + 1 by address, 0 empty */
+    size_t              index_mask, entries;
+} registry_shard_t;
+
+typedef struct {
+    registry_shard_t    shards[REGISTRY_SHARDS];
+    size_t              size;
+} registry_t;
+
+/* called with a reference held, return non zero to stop */
+typedef int (*registry_fn_t)(session_t *session, void *arg);
+
+
+registry_t *registry_new();
+
+/* register session under addr, the registry keeps the caller's reference,
+ * -1 if addr already has one */
+int registry_insert(registry_t *reg, const struct sockaddr_in6 *addr,
+    session_t *session);
+
+/* session under addr with a reference taken, NULL if none */
+session_t *registry_find(registry_t *reg, const struct sockaddr_in6 *addr);
+
+/* unregister the session under addr, only if it is session unless that is
+ * NULL, returns it with the registry's reference, NULL if none */
+session_t *registry_remove(registry_t *reg, const struct sockaddr_in6 *addr,
+    session_t *session);
+
+/* visit every registered session without locking, sessions registered or
+ * removed meanwhile may or may not be visited */
+void registry_foreach(registry_t *reg, registry_fn_t fn, void *arg);
+
+size_t registry_size(registry_t *reg);
+
+/* drops the references of what is still registered */
+void registry_destroy(registry_t *reg);
+
+
+#endif /* _REGISTRY_H */
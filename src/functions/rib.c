@@ -0,0 +1,1518 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    rib.c: Loc-RIB, decision process and local origination
+
+*/
+
+#include "rib.h"
+
+#include "pathtab.h"
+#include "pool.h"
+#include "routemap.h"
+#include "topology.h"
+#include "trace.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/socket.h>
+
+#define RIB_INIT_BUCKETS    4096
+#define RIB_ROUTE_MAX       255     /* originated address length */
+#define ORIGIN_APPS         8       /* application protocols per prefix */
+#define DIFF_PARALLEL_MIN   65536   /* entries before the diff is split */
+
+/* a route to originate or withdraw, pointing into the version it is from */
+typedef struct {
+    const prefixlist_entry_t *d_entry;
+    uint16_t            d_app_proto;
+    uint8_t             d_withdraw;
+} origin_delta_t;
+
+/* lockstep walk of a subtree of the old and new versions */
+typedef struct {
+    const prefixlist_trie_t *job_old, *job_new;
+    int64_t             job_o, job_n;   /* subtree roots, -1 if absent */
+    origin_delta_t     *job_deltas;
+    size_t              job_size, job_capacity;
+    int                 job_failed;
+} diff_job_t;
+
+/* UPDATE being packed for one peer */
+typedef struct {
+    session_t          *out_peer;
+    int                 out_internal;
+    const rib_path_t   *out_path;       /* attributes, NULL if withdrawing */
+    size_t              out_len;        /* 0 if none open */
+    size_t              out_routes_off; /* routes attribute header */
+    uint64_t            out_sent;
+    size_t              out_max;        /* peer's negotiated message size */
+    int                 out_failed;
+
+    /* UPDATEs packed, sent once the lock is released */
+    uint8_t            *out_pending;
+    size_t              out_pending_len, out_pending_capacity;
+
+    uint8_t             out_buff[];
+} rib_out_t;
+
+/* route of a batch, with what the export policy made of it */
+typedef struct {
+    rib_entry_t        *send_entry;
+    routemap_result_t   send_result;
+    rib_path_t          send_path;      /* as the peer gets it */
+    int                 send_applied;   /* send_path holds its set */
+} rib_send_t;
+
+static rib_t *g_rib = NULL;
+
+
+/* utils */
+
+static inline size_t
+route_size(const route_t *route)
+{
+    return sizeof(route_t) + route->route_len;
+}
+
+static uint64_t
+route_hash(const route_t *route)
+{
+    const uint8_t *p = (const uint8_t *)route;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < route_size(route); i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void
+rib_grow(rib_t *rib)
+{
+    size_t size = rib->buckets_size ? rib->buckets_size * 2 :
+        RIB_INIT_BUCKETS;
+    rib_entry_t **buckets = calloc(size, sizeof(rib_entry_t*));
+    if (!buckets)
+        return;
+
+    for (size_t i = 0; i < rib->buckets_size; i++) {
+        rib_entry_t *entry = rib->buckets[i];
+        while (entry) {
+            rib_entry_t *next = entry->re_next;
+            size_t b = entry->re_hash & (size - 1);
+            entry->re_next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+
+    free(rib->buckets);
+    rib->buckets = buckets;
+    rib->buckets_size = size;
+}
+
+static rib_entry_t *
+entry_find(rib_t *rib, const route_t *route, uint64_t hash)
+{
+    if (!rib->buckets)
+        return NULL;
+
+    for (rib_entry_t *entry = rib->buckets[hash & (rib->buckets_size - 1)];
+        entry; entry = entry->re_next)
+    {
+        if (entry->re_hash == hash &&
+            memcmp(&entry->re_route, route, route_size(route)) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static rib_entry_t *
+entry_get(rib_t *rib, const route_t *route)
+{
+    uint64_t hash = route_hash(route);
+    rib_entry_t *entry = entry_find(rib, route, hash);
+    if (entry)
+        return entry;
+
+    if (rib->entries + 1 > rib->buckets_size)
+        rib_grow(rib);
+    if (!rib->buckets)
+        return NULL;
+
+    entry = pool_alloc(sizeof(rib_entry_t) + route->route_len);
+    if (!entry)
+        return NULL;
+    memset(entry, 0, sizeof(rib_entry_t));
+    entry->re_hash = hash;
+    memcpy(&entry->re_route, route, route_size(route));
+
+    size_t b = hash & (rib->buckets_size - 1);
+    entry->re_next = rib->buckets[b];
+    rib->buckets[b] = entry;
+    rib->entries++;
+
+    return entry;
+}
+
+static void
+entry_free(rib_t *rib, rib_entry_t *entry)
+{
+    rib_entry_t **prev = &rib->buckets[entry->re_hash &
+        (rib->buckets_size - 1)];
+    while (*prev != entry)
+        prev = &(*prev)->re_next;
+    *prev = entry->re_next;
+    rib->entries--;
+    pool_free(entry, sizeof(rib_entry_t) + entry->re_route.route_len);
+}
+
+/* hops across the ITAD topology to the ITAD a learned route leaves
+ * through, the first of its AdvertisementPath, 0 for one of the local ITAD */
+static uint32_t
+path_distance(const rib_path_t *p)
+{
+    const path_t *path = p->rp_set->set_path;
+    if (!path || !p->rp_source->session_env ||
+        !p->rp_source->session_env->env_topology)
+    {
+        return 0;
+    }
+    return topology_distance(p->rp_source->session_env->env_topology,
+        path->path_itad);
+}
+
+/* RFC3219 section 10.3.1 in short: originated routes first, then the
+ * highest LocalPref, then the shortest AdvertisementPath, then the nearest
+ * exit ITAD by the link-state topology, then the lowest peer id so the
+ * pick is stable */
+static int
+path_better(const rib_path_t *a, const rib_path_t *b)
+{
+    if (!a->rp_source != !b->rp_source)
+        return !a->rp_source;
+    if (a->rp_localpref != b->rp_localpref)
+        return a->rp_localpref > b->rp_localpref;
+
+    uint16_t la = path_length(a->rp_set->set_path);
+    uint16_t lb = path_length(b->rp_set->set_path);
+    if (la != lb)
+        return la < lb;
+
+    if (!a->rp_source)
+        return 0;
+    uint32_t da = path_distance(a);
+    uint32_t db = path_distance(b);
+    if (da != db)
+        return da < db;
+    if (a->rp_source->session_peer_id != b->rp_source->session_peer_id)
+        return a->rp_source->session_peer_id < b->rp_source->session_peer_id;
+    return a->rp_source->session_peer_itad < b->rp_source->session_peer_itad;
+}
+
+/* rerun the decision for an entry, queue it if the outcome changed */
+static int
+entry_decide(rib_t *rib, rib_entry_t *entry, int changed)
+{
+    rib_path_t *best = entry->re_paths;
+    for (rib_path_t *path = best ? best->rp_next : NULL; path;
+        path = path->rp_next)
+    {
+        if (path_better(path, best))
+            best = path;
+    }
+
+    rib->stat_decisions++;
+    changed |= best != entry->re_best;
+    entry->re_best = best;
+
+    if (changed && !entry->re_queued) {
+        entry->re_queued = 1;
+        entry->re_dirty = rib->dirty;
+        rib->dirty = entry;
+        rib->dirty_size++;
+        rib->stat_changes++;
+    }
+    return changed;
+}
+
+static int
+update_locked(rib_t *rib, session_t *source, const route_t *route,
+    attrset_t *set, uint32_t localpref)
+{
+    rib_entry_t *entry = entry_get(rib, route);
+    if (!entry)
+        return -1;
+
+    rib_path_t *path = entry->re_paths;
+    while (path && path->rp_source != source)
+        path = path->rp_next;
+
+    int changed = 0;
+    if (path) {
+        if (path->rp_set == set && path->rp_localpref == localpref)
+            return 0;
+        attrset_unref(path->rp_set);
+        changed = path == entry->re_best;
+    } else {
+        path = pool_alloc(sizeof(rib_path_t));
+        if (!path)
+            return -1;
+        path->rp_source = source;
+        path->rp_next = entry->re_paths;
+        entry->re_paths = path;
+    }
+    path->rp_set = attrset_ref(set);
+    path->rp_localpref = localpref;
+
+    return entry_decide(rib, entry, changed);
+}
+
+static int
+withdraw_entry(rib_t *rib, rib_entry_t *entry, session_t *source)
+{
+    rib_path_t **prev = &entry->re_paths;
+    while (*prev && (*prev)->rp_source != source)
+        prev = &(*prev)->rp_next;
+    if (!*prev)
+        return 0;
+
+    rib_path_t *path = *prev;
+    *prev = path->rp_next;
+    attrset_unref(path->rp_set);
+    pool_free(path, sizeof(rib_path_t));
+
+    /* a route nobody has is freed once the flush withdrew it */
+    return entry_decide(rib, entry, 0);
+}
+
+static int
+withdraw_locked(rib_t *rib, session_t *source, const route_t *route)
+{
+    rib_entry_t *entry = entry_find(rib, route, route_hash(route));
+    return entry ? withdraw_entry(rib, entry, source) : 0;
+}
+
+
+/* outbound */
+
+static int
+export_to(const rib_path_t *best, session_t *peer)
+{
+    /* routes from internal peers go on to the other internal peers too,
+     * only link-state encapsulated attributes are flooded and the RIB
+     * sends none, never back to where they came from, so two LSs holding
+     * each other's copy withdraw it from each other once the source goes */
+    return best && best->rp_source != peer;
+}
+
+/* what the export policy left of the LocalPref */
+static inline uint32_t
+out_localpref(const rib_path_t *path, const routemap_result_t *result)
+{
+    return result->res_set & ROUTEMAP_SET_LOCALPREF ?
+        result->res_localpref : path->rp_localpref;
+}
+
+static int
+group_cmp(const void *a, const void *b)
+{
+    const rib_path_t *x = (*(const rib_entry_t **)a)->re_best;
+    const rib_path_t *y = (*(const rib_entry_t **)b)->re_best;
+    if (!x || !y)
+        return (x != NULL) - (y != NULL);   /* unreachable first */
+    if (x->rp_set->set_id != y->rp_set->set_id)
+        return x->rp_set->set_id < y->rp_set->set_id ? -1 : 1;
+    return x->rp_localpref < y->rp_localpref ? -1 :
+        x->rp_localpref > y->rp_localpref;
+}
+
+/* same for a batch, routes the export policy changed the same way end up
+ * next to each other too */
+static int
+send_cmp(const void *a, const void *b)
+{
+    const rib_send_t *x = a, *y = b;
+    const rib_path_t *px = x->send_entry->re_best;
+    const rib_path_t *py = y->send_entry->re_best;
+    if (px->rp_set->set_id != py->rp_set->set_id)
+        return px->rp_set->set_id < py->rp_set->set_id ? -1 : 1;
+
+    uint32_t lx = out_localpref(px, &x->send_result);
+    uint32_t ly = out_localpref(py, &y->send_result);
+    if (lx != ly)
+        return lx < ly ? -1 : 1;
+
+    const routemap_result_t *rx = &x->send_result, *ry = &y->send_result;
+    if ((rx->res_set & ROUTEMAP_SET_MED) != (ry->res_set & ROUTEMAP_SET_MED))
+        return (rx->res_set & ROUTEMAP_SET_MED) ? 1 : -1;
+    if ((rx->res_set & ROUTEMAP_SET_MED) && rx->res_med != ry->res_med)
+        return rx->res_med < ry->res_med ? -1 : 1;
+    if (rx->res_communities != ry->res_communities)
+        return (uintptr_t)rx->res_communities <
+            (uintptr_t)ry->res_communities ? -1 : 1;
+    return rx->res_communities_size < ry->res_communities_size ? -1 :
+        rx->res_communities_size > ry->res_communities_size;
+}
+
+/* the set's attributes as this peer gets them: external peers see the
+ * local ITAD in front of the AdvertisementPath and no LocalPref, internal
+ * ones the LocalPref the decision used */
+static runtime_error_t
+out_attrs(rib_t *rib, rib_out_t *out, void *buff, size_t len)
+{
+    const attrset_t *set = out->out_path->rp_set;
+    size_t off = 0;
+    int r = 0;
+
+    for (size_t i = 0; i < set->set_len;) {
+        const msg_update_attr_t *attr = (const void *)set->set_attrs + i;
+        size_t size = sizeof(msg_update_attr_t) + attr->attr_len;
+        i += size;
+
+        if (attr->attr_type == ATTR_TYPE_LOCALPREFERENCE ||
+            (attr->attr_type == ATTR_TYPE_ADVERTISEMENTPATH &&
+            !out->out_internal))
+        {
+            continue;   /* rewritten below */
+        }
+        if (off + size > len)
+            return ERROR_BUFFLEN;
+        memcpy(buff + off, attr, size);
+        off += size;
+    }
+
+    if (out->out_internal) {
+        r = new_attr_localpref(buff + off, len - off,
+            out->out_path->rp_localpref);
+        if (r < 0)
+            return r;
+        off += r;
+    } else {
+        if (off + sizeof(msg_update_attr_t) > len)
+            return ERROR_BUFFLEN;
+        msg_update_attr_t *attr = buff + off;
+        path_t *path = path_prepend(set->set_path, rib->itad);
+        r = path_write(path, attr->attr_val,
+            len - off - sizeof(msg_update_attr_t));
+        path_unref(path);
+        if (r < 0)
+            return r;
+        attr->attr_flags = ATTR_FLAG_WELL_KNOWN;
+        attr->attr_type = ATTR_TYPE_ADVERTISEMENTPATH;
+        attr->attr_len = r;
+        off += sizeof(msg_update_attr_t) + r;
+    }
+
+    return off;
+}
+
+static rib_out_t *
+out_new(rib_t *rib, session_t *peer)
+{
+    rib_out_t *out = pool_alloc(sizeof(rib_out_t) + peer->session_msg_size);
+    if (!out)
+        return NULL;
+    out->out_max = peer->session_msg_size;
+    out->out_peer = peer;
+    out->out_internal = peer->session_peer_itad == rib->itad;
+    out->out_path = NULL;
+    out->out_len = 0;
+    out->out_sent = 0;
+    out->out_failed = 0;
+    out->out_pending = NULL;
+    out->out_pending_len = out->out_pending_capacity = 0;
+    return out;
+}
+
+static void
+out_free(rib_out_t *out)
+{
+    free(out->out_pending);
+    pool_free(out, sizeof(rib_out_t) + out->out_max);
+}
+
+/* a whole message, kept to send later */
+static void
+out_write(rib_out_t *out, const void *buff, size_t len)
+{
+    if (out->out_pending_len + len > out->out_pending_capacity) {
+        size_t capacity = out->out_pending_capacity ?
+            out->out_pending_capacity * 2 : 65536;
+        while (capacity < out->out_pending_len + len)
+            capacity *= 2;
+        uint8_t *pending = realloc(out->out_pending, capacity);
+        if (!pending) {
+            out->out_failed = 1;
+            return;
+        }
+        out->out_pending = pending;
+        out->out_pending_capacity = capacity;
+    }
+    memcpy(out->out_pending + out->out_pending_len, buff, len);
+    out->out_pending_len += len;
+}
+
+static void
+out_send(rib_t *rib, rib_out_t *out)
+{
+    if (!out->out_len)
+        return;
+
+    msg_t *msg = (msg_t *)out->out_buff;
+    msg_update_attr_t *routes = (void *)out->out_buff + out->out_routes_off;
+    routes->attr_len = out->out_len - out->out_routes_off -
+        sizeof(msg_update_attr_t);
+    msg->msg_len = out->out_len - MSG_HDR_LEN;
+
+    out_write(out, out->out_buff, out->out_len);
+    out->out_sent++;
+    rib->stat_updates++;
+    out->out_len = 0;
+}
+
+/* append route to the open UPDATE, opening one if path differs from the
+ * open one's or the route does not fit */
+static void
+out_route(rib_t *rib, rib_out_t *out, const rib_path_t *path,
+    const route_t *route)
+{
+    int same = out->out_len && (path == out->out_path || (path &&
+        out->out_path && path->rp_set == out->out_path->rp_set &&
+        path->rp_localpref == out->out_path->rp_localpref));
+    if (same && out->out_len + route_size(route) <= out->out_max) {
+        memcpy(out->out_buff + out->out_len, route, route_size(route));
+        out->out_len += route_size(route);
+        return;
+    }
+
+    out_send(rib, out);
+
+    msg_t *msg = (msg_t *)out->out_buff;
+    msg->msg_type = MSG_TYPE_UPDATE;
+    out->out_len = MSG_HDR_LEN;
+    out->out_path = path;
+
+    if (path) {
+        int r = out_attrs(rib, out, out->out_buff + out->out_len,
+            out->out_max - out->out_len);
+        if (r < 0) {
+            out->out_len = 0;
+            return;
+        }
+        out->out_len += r;
+    }
+
+    msg_update_attr_t *attr = (void *)out->out_buff + out->out_len;
+    attr->attr_flags = ATTR_FLAG_WELL_KNOWN;
+    attr->attr_type = path ? ATTR_TYPE_REACHABLEROUTES :
+        ATTR_TYPE_WITHDRAWNROUTES;
+    out->out_routes_off = out->out_len;
+    out->out_len += sizeof(msg_update_attr_t);
+
+    if (out->out_len + route_size(route) > out->out_max) {
+        out->out_len = 0;   /* cannot be sent at all */
+        return;
+    }
+    memcpy(out->out_buff + out->out_len, route, route_size(route));
+    out->out_len += route_size(route);
+}
+
+static inline uint64_t
+mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* what peer should have of entry, the digest of its path as the export
+ * policy leaves it, whose outcome goes in result, or 0 if nothing, entry
+ * may be NULL */
+static uint32_t
+out_want(rib_t *rib, session_t *peer, prefixlist_trie_t *plist,
+    routemap_ctx_t *ctx, const rib_entry_t *entry, routemap_result_t *result)
+{
+    if (!entry || !export_to(entry->re_best, peer) ||
+        prefixlist_match(plist, &entry->re_route) != PREFIXLIST_PERMIT)
+    {
+        return 0;
+    }
+
+    /* a set that does not decode any more is not sent */
+    const rib_path_t *best = entry->re_best;
+    if (routemap_run_attrs(ctx, best->rp_set, &entry->re_route, result) < 0 ||
+        result->res_action != PREFIXLIST_PERMIT)
+    {
+        return 0;
+    }
+
+    /* set ids are never reused, so with what the policy set they name what
+     * was sent */
+    uint64_t x = mix64((uint64_t)best->rp_set->set_id << 32 |
+        out_localpref(best, result));
+    if (result->res_set & ROUTEMAP_SET_MED)
+        x = mix64(x ^ (1ULL << 32 | result->res_med));
+    for (size_t i = 0; i < result->res_communities_size; i++)
+        x = mix64(x ^ ((uint64_t)result->res_communities[i].community_itad <<
+            32 | result->res_communities[i].community_id));
+    return (uint32_t)x | 1;
+}
+
+static adjout_t *
+peer_adj(rib_t *rib, const session_t *peer)
+{
+    for (size_t p = 0; p < rib->peers_size; p++)
+        if (rib->peers[p] == peer)
+            return &rib->peers_out[p];
+    return NULL;
+}
+
+/* sender */
+
+static inline uint64_t
+rev64(uint64_t x)
+{
+    x = __builtin_bswap64(x);
+    x = (x & 0x0f0f0f0f0f0f0f0fULL) << 4 | (x >> 4 & 0x0f0f0f0f0f0f0f0fULL);
+    x = (x & 0x3333333333333333ULL) << 2 | (x >> 2 & 0x3333333333333333ULL);
+    x = (x & 0x5555555555555555ULL) << 1 | (x >> 1 & 0x5555555555555555ULL);
+    return x;
+}
+
+/* a bucket holds the hashes whose low bits are its index, read backwards
+ * they are one range, the cursor is where the next range starts, a finer
+ * table after growth only splits ranges, so what is below the cursor has
+ * been sent whatever the size of the table was then */
+static inline int
+dump_passed(const rib_dump_t *dump, const rib_entry_t *entry)
+{
+    return dump->dump_walked || rev64(entry->re_hash) < dump->dump_pos;
+}
+
+static rib_dump_t *
+dump_find(rib_t *rib, const session_t *peer)
+{
+    for (rib_dump_t *dump = rib->dumps; dump; dump = dump->dump_next)
+        if (dump->dump_peer == peer)
+            return dump;
+    return NULL;
+}
+
+static void
+dump_unlink(rib_t *rib, rib_dump_t *dump)
+{
+    rib_dump_t **prev = &rib->dumps;
+    while (*prev && *prev != dump)
+        prev = &(*prev)->dump_next;
+    if (*prev)
+        *prev = dump->dump_next;
+}
+
+/* flushed entries go on the peer's queue, those the peer gets no path for
+ * as withdrawals, announcements ahead of a running walk are left to it,
+ * withdrawals never are, a route that lost its last path is freed by the
+ * flush and the walk would not find it, -1 if one could not be queued */
+static int
+dump_queue(rib_t *rib, rib_dump_t *dump, rib_entry_t **entries, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        int class = export_to(entries[i]->re_best, dump->dump_peer) ?
+            OUTQUEUE_ANNOUNCE : OUTQUEUE_WITHDRAW;
+        if (class == OUTQUEUE_ANNOUNCE && !dump_passed(dump, entries[i]))
+            continue;
+        if (outqueue_push(&dump->dump_queue, &entries[i]->re_route,
+            entries[i]->re_hash, class) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+batch_push(rib_send_t **batch, size_t *size, size_t *capacity,
+    rib_entry_t *entry, const routemap_result_t *result)
+{
+    if (*size == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : RIB_DUMP_BATCH;
+        rib_send_t *new_batch = realloc(*batch,
+            new_capacity * sizeof(rib_send_t));
+        if (!new_batch)
+            return -1;
+        *batch = new_batch;
+        *capacity = new_capacity;
+    }
+    rib_send_t *send = &(*batch)[(*size)++];
+    send->send_entry = entry;
+    send->send_result = *result;
+    send->send_applied = 0;
+    return 0;
+}
+
+/* lock held, pack the batch grouped by the attributes the peer gets, the
+ * sets the policy changed are interned once per group */
+static void
+batch_send(rib_t *rib, rib_out_t *out, routemap_ctx_t *ctx,
+    rib_send_t *batch, size_t size)
+{
+    qsort(batch, size, sizeof(rib_send_t), &send_cmp);
+
+    for (size_t i = 0; i < size; i++) {
+        rib_send_t *send = &batch[i];
+        const rib_path_t *best = send->send_entry->re_best;
+        send->send_path = *best;
+        send->send_path.rp_localpref = out_localpref(best,
+            &send->send_result);
+        if ((send->send_result.res_set & ROUTEMAP_SET_MED) ||
+            send->send_result.res_communities_size)
+        {
+            send->send_path.rp_set = routemap_apply(ctx, best->rp_set,
+                &send->send_result);
+            if (!send->send_path.rp_set) {
+                out->out_failed = 1;
+                size = i;
+                break;
+            }
+            send->send_applied = 1;
+        }
+        out_route(rib, out, &send->send_path, &send->send_entry->re_route);
+    }
+    out_send(rib, out);
+
+    for (size_t i = 0; i < size; i++)
+        if (batch[i].send_applied)
+            attrset_unref(batch[i].send_path.rp_set);
+}
+
+/* lock held, next batch of routes or so from the cursor, whole buckets,
+ * grouped by attribute set, RIB_DUMP_BATCH per standard message size the
+ * peer takes so bigger UPDATEs still fill up */
+static void
+dump_walk(rib_t *rib, rib_dump_t *dump, rib_out_t *out, adjout_t *adj,
+    prefixlist_trie_t *plist, routemap_ctx_t *ctx, rib_send_t **batch,
+    size_t *capacity)
+{
+    size_t size = 0, limit = RIB_DUMP_BATCH * (out->out_max / MAX_MSG_SIZE);
+
+    if (!rib->buckets_size)
+        dump->dump_walked = 1;
+
+    while (!dump->dump_walked && size < limit) {
+        uint64_t mask = rib->buckets_size - 1;
+        uint64_t step = 1ULL << (64 - __builtin_ctzll(rib->buckets_size));
+        uint64_t pos = dump->dump_pos;
+
+        /* the chain of the next bucket, the slot of the one after */
+        __builtin_prefetch(rib->buckets[rev64(pos + step) & mask]);
+        __builtin_prefetch(&rib->buckets[rev64(pos + 2 * step) & mask]);
+
+        for (rib_entry_t *entry = rib->buckets[rev64(pos) & mask]; entry;
+            entry = entry->re_next)
+        {
+            if (entry->re_next)
+                __builtin_prefetch(entry->re_next);
+
+            routemap_result_t result;
+            uint32_t want = out_want(rib, dump->dump_peer, plist, ctx, entry,
+                &result);
+            uint32_t sent = adjout_get(adj, entry->re_hash);
+            if (!want && sent) {
+                /* withdrawals go out ahead of the batch */
+                adjout_del(adj, entry->re_hash);
+                out_route(rib, out, NULL, &entry->re_route);
+            } else if (want && (dump->dump_full || want != sent)) {
+                if (batch_push(batch, &size, capacity, entry, &result) < 0) {
+                    out->out_failed = 1;
+                    return;
+                }
+                adjout_set(adj, entry->re_hash, want);
+            }
+        }
+
+        dump->dump_pos = pos + step;
+        dump->dump_walked = dump->dump_pos == 0;
+    }
+
+    out_send(rib, out);
+    batch_send(rib, out, ctx, *batch, size);
+    dump->dump_routes += size;
+}
+
+/* lock held, the next queued routes up to class, as they are now, if they
+ * differ from what was sent, withdrawals in queue order ahead of the
+ * announcements */
+static void
+dump_drain(rib_t *rib, rib_dump_t *dump, rib_out_t *out, adjout_t *adj,
+    prefixlist_trie_t *plist, routemap_ctx_t *ctx, rib_send_t **batch,
+    size_t *capacity, int class)
+{
+    size_t size = 0, limit = RIB_DUMP_BATCH * (out->out_max / MAX_MSG_SIZE);
+    int c = 0;
+
+    for (size_t n = 0; n < limit && c <= class && !out->out_failed; n++) {
+        outqueue_node_t *node = outqueue_pop(&dump->dump_queue, c);
+        if (!node) {
+            c++;    /* this class is done, on with the next */
+            continue;
+        }
+        rib_entry_t *entry = entry_find(rib, &node->node_route,
+            node->node_hash);
+        routemap_result_t result;
+        uint32_t want = out_want(rib, dump->dump_peer, plist, ctx, entry,
+            &result);
+        uint32_t sent = adjout_get(adj, node->node_hash);
+        if (!want && sent) {
+            adjout_del(adj, node->node_hash);
+            out_route(rib, out, NULL, &node->node_route);
+        } else if (want && want != sent) {
+            if (batch_push(batch, &size, capacity, entry, &result) < 0)
+                out->out_failed = 1;
+            else
+                adjout_set(adj, node->node_hash, want);
+        }
+        outqueue_node_free(node);
+    }
+    out_send(rib, out);
+
+    batch_send(rib, out, ctx, *batch, size);
+}
+
+/* lock held, a walk is over */
+static void
+dump_report(const rib_dump_t *dump)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("[INFO rib] %s sent to peer %u:%u, %llu routes in %llu UPDATEs, "
+        "%llu batches, %.3f s\n", dump->dump_full ? "table" : "changes",
+        dump->dump_peer->session_peer_itad, dump->dump_peer->session_peer_id,
+        (unsigned long long)dump->dump_routes,
+        (unsigned long long)dump->dump_updates,
+        (unsigned long long)dump->dump_batches,
+        (t1.tv_sec - dump->dump_start.tv_sec) +
+        (t1.tv_nsec - dump->dump_start.tv_nsec) / 1e9);
+}
+
+static void *
+dump_loop(void *arg)
+{
+    rib_dump_t *dump = arg;
+    rib_t *rib = dump->dump_rib;
+    session_t *peer = dump->dump_peer;
+
+    trace_thread_name("sender");
+
+    rib_out_t *out = out_new(rib, peer);
+    rib_send_t *batch = NULL;
+    size_t capacity = 0;
+    arena_t arena;
+    arena_init(&arena);
+
+    pthread_mutex_lock(&rib->lock);
+    while (out && !dump->dump_stopped) {
+        const outqueue_t *q = &dump->dump_queue;
+        if (q->head[OUTQUEUE_WITHDRAW] || !dump->dump_walked ||
+            q->head[OUTQUEUE_ANNOUNCE])
+        {
+            /* a peer is in the list as long as its sender is not stopped */
+            adjout_t *adj = peer_adj(rib, peer);
+            prefixlist_trie_t *plist = prefixlist_acquire(
+                __atomic_load_n(&peer->session_plist_out, __ATOMIC_ACQUIRE));
+            routemap_prog_t *rmap = routemap_acquire(
+                __atomic_load_n(&peer->session_rmap_out, __ATOMIC_ACQUIRE));
+            routemap_ctx_t ctx;
+            arena_reset(&arena);
+            routemap_ctx_init(&ctx, rmap, &arena);
+            /* withdrawals go ahead of the rest of the walk too */
+            if (q->head[OUTQUEUE_WITHDRAW])
+                dump_drain(rib, dump, out, adj, plist, &ctx, &batch,
+                    &capacity, dump->dump_walked ? OUTQUEUE_ANNOUNCE :
+                    OUTQUEUE_WITHDRAW);
+            else if (!dump->dump_walked)
+                dump_walk(rib, dump, out, adj, plist, &ctx, &batch,
+                    &capacity);
+            else
+                dump_drain(rib, dump, out, adj, plist, &ctx, &batch,
+                    &capacity, OUTQUEUE_ANNOUNCE);
+            routemap_ctx_done(&ctx);
+            routemap_release(rmap);
+            prefixlist_release(plist);
+            dump->dump_batches++;
+        } else if (!dump->dump_eor) {
+            uint8_t eor[MSG_HDR_LEN];
+            int r = new_msg_update(eor, sizeof(eor), NULL, 0);
+            if (r > 0)
+                out_write(out, eor, r);
+            dump->dump_eor = 1;
+        } else if (!dump->dump_done) {
+            /* the walk and what changed meanwhile went out */
+            dump->dump_done = 1;
+            dump_report(dump);
+        } else if (!dump->dump_failed) {
+            /* everything went out, wait for the next flush */
+            pthread_cond_wait(&dump->dump_wake, &rib->lock);
+            continue;
+        }
+
+        dump->dump_updates += out->out_sent;
+        out->out_sent = 0;
+        pthread_mutex_unlock(&rib->lock);
+
+        /* blocks on a full socket, which holds up nothing else, changes
+         * meanwhile pile up on the queue once per route, KEEPALIVEs go in
+         * between chunks */
+        int r = 0;
+        if (!out->out_failed && out->out_pending_len)
+            r = session_send_bulk(peer, out->out_pending,
+                out->out_pending_len);
+        out->out_pending_len = 0;
+
+        pthread_mutex_lock(&rib->lock);
+        if (r < 0 || out->out_failed || dump->dump_failed) {
+            /* the peer is missing routes, make its session end */
+            if (!dump->dump_stopped) {
+                shutdown(peer->session_fd, SHUT_RDWR);
+                dump_unlink(rib, dump);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rib->lock);
+
+    if (out)
+        out_free(out);
+    free(batch);
+    arena_destroy(&arena);
+    outqueue_free(&dump->dump_queue);
+    pthread_cond_destroy(&dump->dump_wake);
+    session_put(peer);
+    free(dump);
+    return NULL;
+}
+
+/* lock held, send peer the table again, all of it if full, a walk already
+ * running starts over */
+static void
+dump_restart(rib_dump_t *dump, int full)
+{
+    /* a full walk not finished yet stays one */
+    if (!dump->dump_done && dump->dump_full)
+        full = 1;
+    if (dump->dump_done) {
+        dump->dump_routes = dump->dump_updates = dump->dump_batches = 0;
+        clock_gettime(CLOCK_MONOTONIC, &dump->dump_start);
+    }
+
+    /* what it had walked is covered by walking it again */
+    dump->dump_pos = 0;
+    dump->dump_walked = 0;
+    dump->dump_full = full;
+    dump->dump_eor = !full;     /* changes only are not a table */
+    dump->dump_done = 0;
+    pthread_cond_signal(&dump->dump_wake);
+}
+
+/* new peer, its sender starts with the whole table */
+static int
+dump_start(rib_t *rib, session_t *session)
+{
+    rib_dump_t *dump = calloc(1, sizeof(rib_dump_t));
+    if (!dump)
+        return -1;
+    if (!session_tryget(session)) {
+        free(dump);
+        return -1;
+    }
+    dump->dump_rib = rib;
+    dump->dump_peer = session;
+    dump->dump_full = 1;
+    pthread_cond_init(&dump->dump_wake, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &dump->dump_start);
+
+    pthread_mutex_lock(&rib->lock);
+
+    if (rib->peers_size == RIB_MAX_PEERS) {
+        pthread_mutex_unlock(&rib->lock);
+        pthread_cond_destroy(&dump->dump_wake);
+        session_put(session);
+        free(dump);
+        return -1;
+    }
+    rib->peers[rib->peers_size++] = session;
+    dump->dump_next = rib->dumps;
+    rib->dumps = dump;
+
+    if (pthread_create(&dump->dump_thread, NULL, &dump_loop, dump) != 0) {
+        /* without a sender the peer would never get a route */
+        fprintf(stderr, "[ERROR rib] could not start sender for peer "
+            "%u:%u\n", session->session_peer_itad, session->session_peer_id);
+        dump->dump_failed = 1;
+        dump_unlink(rib, dump);
+        rib->peers[--rib->peers_size] = NULL;
+        shutdown(session->session_fd, SHUT_RDWR);
+        pthread_mutex_unlock(&rib->lock);
+        pthread_cond_destroy(&dump->dump_wake);
+        session_put(session);
+        free(dump);
+        return -1;
+    }
+    pthread_detach(dump->dump_thread);
+
+    pthread_mutex_unlock(&rib->lock);
+    return 0;
+}
+
+static void
+flush_locked(rib_t *rib)
+{
+    if (!rib->dirty)
+        return;
+
+    size_t entries_bytes = rib->dirty_size * sizeof(rib_entry_t*);
+    rib_entry_t **entries = pool_alloc(entries_bytes);
+    size_t size = 0;
+    for (rib_entry_t *entry = rib->dirty; entry; entry = entry->re_dirty)
+        if (entries)
+            entries[size++] = entry;
+
+    if (entries) {
+        qsort(entries, size, sizeof(rib_entry_t*), &group_cmp);
+        for (size_t p = 0; p < rib->peers_size; p++) {
+            /* no sender is a peer whose session is ending */
+            rib_dump_t *dump = dump_find(rib, rib->peers[p]);
+            if (!dump)
+                continue;
+            if (dump_queue(rib, dump, entries, size) < 0)
+                dump->dump_failed = 1;
+            pthread_cond_signal(&dump->dump_wake);
+        }
+    }
+
+    TRACE(TRACE_DECISION_RUN, rib->dirty_size, rib->entries);
+
+    rib_entry_t *entry = rib->dirty;
+    while (entry) {
+        rib_entry_t *next = entry->re_dirty;
+        entry->re_queued = 0;
+        entry->re_dirty = NULL;
+        if (!entry->re_paths)
+            entry_free(rib, entry);
+        entry = next;
+    }
+    rib->dirty = NULL;
+    rib->dirty_size = 0;
+
+    pool_free(entries, entries_bytes);
+}
+
+
+/* origination */
+
+static inline uint16_t
+origin_app_proto(const prefixlist_entry_t *entry)
+{
+    return entry->entry_app_proto ? entry->entry_app_proto : APP_PROTO_SIP;
+}
+
+/* routes a node originates, the first permit entry with a server for each
+ * application protocol, entries are in configuration order */
+static size_t
+node_origins(const prefixlist_trie_t *trie, int64_t n,
+    const prefixlist_entry_t **origins)
+{
+    if (n < 0)
+        return 0;
+
+    const prefixlist_node_t *node = &trie->trie_nodes[n];
+    size_t size = 0;
+    for (uint32_t i = 0; i < node->node_entries; i++) {
+        const prefixlist_entry_t *entry =
+            &trie->trie_entries[node->node_entry + i];
+        if (entry->entry_action != PREFIXLIST_PERMIT || !entry->entry_server)
+            continue;
+
+        size_t j = 0;
+        while (j < size &&
+            origin_app_proto(origins[j]) != origin_app_proto(entry))
+        {
+            j++;
+        }
+        if (j == size && size < ORIGIN_APPS)
+            origins[size++] = entry;
+    }
+    return size;
+}
+
+static void
+job_push(diff_job_t *job, const prefixlist_entry_t *entry, int withdraw)
+{
+    if (job->job_size == job->job_capacity) {
+        size_t capacity = job->job_capacity ? job->job_capacity * 2 : 256;
+        origin_delta_t *deltas = realloc(job->job_deltas,
+            capacity * sizeof(origin_delta_t));
+        if (!deltas) {
+            job->job_failed = 1;
+            return;
+        }
+        job->job_deltas = deltas;
+        job->job_capacity = capacity;
+    }
+
+    origin_delta_t *delta = &job->job_deltas[job->job_size++];
+    delta->d_entry = entry;
+    delta->d_app_proto = origin_app_proto(entry);
+    delta->d_withdraw = withdraw;
+}
+
+/* one node of both versions, children not included */
+static void
+diff_entries(diff_job_t *job, int64_t o, int64_t n)
+{
+    const prefixlist_entry_t *old[ORIGIN_APPS], *new[ORIGIN_APPS];
+    size_t old_size = node_origins(job->job_old, o, old);
+    size_t new_size = node_origins(job->job_new, n, new);
+
+    for (size_t i = 0; i < new_size; i++) {
+        size_t j = 0;
+        while (j < old_size &&
+            origin_app_proto(old[j]) != origin_app_proto(new[i]))
+        {
+            j++;
+        }
+        if (j == old_size ||
+            strcmp(old[j]->entry_server, new[i]->entry_server) != 0)
+        {
+            job_push(job, new[i], 0);
+        }
+    }
+    for (size_t j = 0; j < old_size; j++) {
+        size_t i = 0;
+        while (i < new_size &&
+            origin_app_proto(old[j]) != origin_app_proto(new[i]))
+        {
+            i++;
+        }
+        if (i == new_size)
+            job_push(job, old[j], 1);
+    }
+}
+
+/* child of o and n for symbol s, -1 where absent */
+static inline void
+diff_child(const diff_job_t *job, int64_t o, int64_t n, int s,
+    int64_t *co, int64_t *cn)
+{
+    uint16_t bit = 1 << s;
+    const prefixlist_node_t *on = o >= 0 ? &job->job_old->trie_nodes[o] : NULL;
+    const prefixlist_node_t *nn = n >= 0 ? &job->job_new->trie_nodes[n] : NULL;
+
+    *co = on && on->node_map & bit ? (int64_t)on->node_child +
+        __builtin_popcount(on->node_map & (bit - 1)) : -1;
+    *cn = nn && nn->node_map & bit ? (int64_t)nn->node_child +
+        __builtin_popcount(nn->node_map & (bit - 1)) : -1;
+}
+
+static void
+diff_node(diff_job_t *job, int64_t o, int64_t n)
+{
+    diff_entries(job, o, n);
+
+    uint32_t map = (o >= 0 ? job->job_old->trie_nodes[o].node_map : 0) |
+        (n >= 0 ? job->job_new->trie_nodes[n].node_map : 0);
+    for (; map; map &= map - 1) {
+        int64_t co, cn;
+        diff_child(job, o, n, __builtin_ctz(map), &co, &cn);
+        diff_node(job, co, cn);
+    }
+}
+
+static void *
+diff_thread(void *arg)
+{
+    diff_job_t *job = arg;
+    diff_node(job, job->job_o, job->job_n);
+    return NULL;
+}
+
+/* deltas from old to new, either may be NULL, large versions are split by
+ * first digit over threads, jobs in order give the deltas in trie order */
+static int
+origin_diff(const prefixlist_trie_t *old, const prefixlist_trie_t *new,
+    diff_job_t *jobs, size_t *jobs_size)
+{
+    size_t entries = (old ? old->trie_entries_size : 0) +
+        (new ? new->trie_entries_size : 0);
+
+    memset(jobs, 0, (PREFIXLIST_SYMBOLS + 1) * sizeof(diff_job_t));
+    for (size_t i = 0; i <= PREFIXLIST_SYMBOLS; i++) {
+        jobs[i].job_old = old;
+        jobs[i].job_new = new;
+    }
+    jobs[0].job_o = old ? 0 : -1;
+    jobs[0].job_n = new ? 0 : -1;
+
+    if (entries < DIFF_PARALLEL_MIN) {
+        diff_node(&jobs[0], jobs[0].job_o, jobs[0].job_n);
+        *jobs_size = 1;
+        return jobs[0].job_failed ? -1 : 0;
+    }
+
+    /* the root's own entries here, each subtree in a thread */
+    pthread_t tids[PREFIXLIST_SYMBOLS];
+    int spawned[PREFIXLIST_SYMBOLS + 1] = { 0 };
+    size_t size = 1;
+    for (int s = 0; s < PREFIXLIST_SYMBOLS; s++) {
+        diff_job_t *job = &jobs[size];
+        diff_child(&jobs[0], jobs[0].job_o, jobs[0].job_n, s,
+            &job->job_o, &job->job_n);
+        if (job->job_o < 0 && job->job_n < 0)
+            continue;
+        spawned[size] = pthread_create(&tids[size - 1], NULL, &diff_thread,
+            job) == 0;
+        if (!spawned[size])
+            diff_thread(job);
+        size++;
+    }
+
+    diff_entries(&jobs[0], jobs[0].job_o, jobs[0].job_n);
+
+    int failed = jobs[0].job_failed;
+    for (size_t i = 1; i < size; i++) {
+        if (spawned[i])
+            pthread_join(tids[i - 1], NULL);
+        failed |= jobs[i].job_failed;
+    }
+
+    *jobs_size = size;
+    return failed ? -1 : 0;
+}
+
+static attrset_t *
+origin_set(rib_t *rib, const char *server)
+{
+    uint8_t attrs[MAX_MSG_SIZE];
+    int r = new_attr_nexthopserver(attrs, sizeof(attrs), rib->itad, server);
+    if (r < 0)
+        return NULL;
+    size_t len = r;
+    r = new_attr_localpref(attrs + len, sizeof(attrs) - len, RIB_LOCALPREF);
+    if (r < 0)
+        return NULL;
+    len += r;
+
+    return attrset_intern_canon(attrs, len, NULL);
+}
+
+/* lock held */
+static int
+origin_apply(rib_t *rib, const origin_delta_t *deltas, size_t size)
+{
+    uint8_t buff[sizeof(route_t) + RIB_ROUTE_MAX];
+    route_t *route = (route_t *)buff;
+    const char *server = NULL;
+    attrset_t *set = NULL;
+    int applied = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        const prefixlist_entry_t *entry = deltas[i].d_entry;
+        if (entry->entry_len > RIB_ROUTE_MAX)
+            continue;
+
+        route->route_af = strspn(entry->entry_prefix, "0123456789") ==
+            entry->entry_len ? AF_DECIMAL : AF_PENTADECIMAL;
+        route->route_app_proto = deltas[i].d_app_proto;
+        route->route_len = entry->entry_len;
+        memcpy(route->route_addr, entry->entry_prefix, entry->entry_len);
+
+        if (deltas[i].d_withdraw) {
+            withdraw_locked(rib, NULL, route);
+            applied++;
+            continue;
+        }
+
+        /* servers repeat, consecutive ones share the set */
+        if (!server || strcmp(server, entry->entry_server) != 0) {
+            attrset_unref(set);
+            set = origin_set(rib, entry->entry_server);
+            server = entry->entry_server;
+        }
+        if (set && update_locked(rib, NULL, route, set, RIB_LOCALPREF) >= 0)
+            applied++;
+    }
+
+    attrset_unref(set);
+    return applied;
+}
+
+
+/* public */
+
+rib_t *
+rib_new()
+{
+    if (g_rib)
+        return NULL;
+
+    rib_t *rib = calloc(1, sizeof(rib_t));
+    if (!rib)
+        return NULL;
+    pthread_mutex_init(&rib->lock, NULL);
+
+    g_rib = rib;
+    return rib;
+}
+
+void
+rib_set_local(rib_t *rib, uint32_t itad, uint32_t id)
+{
+    pthread_mutex_lock(&rib->lock);
+    rib->itad = itad;
+    rib->id = id;
+    pthread_mutex_unlock(&rib->lock);
+}
+
+int
+rib_update(rib_t *rib, session_t *source, const route_t *route,
+    attrset_t *set, uint32_t localpref)
+{
+    pthread_mutex_lock(&rib->lock);
+    int r = update_locked(rib, source, route, set, localpref);
+    pthread_mutex_unlock(&rib->lock);
+    return r;
+}
+
+int
+rib_withdraw(rib_t *rib, session_t *source, const route_t *route)
+{
+    pthread_mutex_lock(&rib->lock);
+    int r = withdraw_locked(rib, source, route);
+    pthread_mutex_unlock(&rib->lock);
+    return r;
+}
+
+void
+rib_flush(rib_t *rib)
+{
+    pthread_mutex_lock(&rib->lock);
+    flush_locked(rib);
+    pthread_mutex_unlock(&rib->lock);
+}
+
+int
+rib_originate(rib_t *rib, prefixlist_t *plist)
+{
+    if (!rib->itad)
+        return 0;
+
+    prefixlist_trie_t *trie = prefixlist_acquire(plist);
+    if (trie == rib->origin) {
+        prefixlist_release(trie);
+        return 0;
+    }
+
+    diff_job_t jobs[PREFIXLIST_SYMBOLS + 1];
+    size_t jobs_size = 0;
+    int r = origin_diff(rib->origin, trie, jobs, &jobs_size);
+
+    int applied = 0;
+    if (r == 0) {
+        pthread_mutex_lock(&rib->lock);
+        for (size_t i = 0; i < jobs_size; i++)
+            applied += origin_apply(rib, jobs[i].job_deltas,
+                jobs[i].job_size);
+        TRACE(TRACE_RIB_INSERT, AF_DECIMAL, applied);
+        flush_locked(rib);
+        pthread_mutex_unlock(&rib->lock);
+    }
+
+    for (size_t i = 0; i < jobs_size; i++)
+        free(jobs[i].job_deltas);
+
+    if (r < 0) {
+        prefixlist_release(trie);
+        return -1;
+    }
+
+    /* deltas pointed into both versions, the old one can go now */
+    prefixlist_release(rib->origin);
+    rib->origin = trie;
+    return applied;
+}
+
+int
+rib_add_peer(rib_t *rib, session_t *session)
+{
+    return dump_start(rib, session);
+}
+
+int
+rib_refresh_peer(rib_t *rib, session_t *session, int full)
+{
+    pthread_mutex_lock(&rib->lock);
+    rib_dump_t *dump = dump_find(rib, session);
+    if (dump)
+        dump_restart(dump, full);
+    pthread_mutex_unlock(&rib->lock);
+    return dump ? 0 : -1;
+}
+
+void
+rib_remove_peer(rib_t *rib, session_t *session)
+{
+    pthread_mutex_lock(&rib->lock);
+
+    for (size_t p = 0; p < rib->peers_size; p++)
+        if (rib->peers[p] == session) {
+            adjout_free(&rib->peers_out[p]);
+            rib->peers[p] = rib->peers[--rib->peers_size];
+            rib->peers_out[p] = rib->peers_out[rib->peers_size];
+            memset(&rib->peers_out[rib->peers_size], 0, sizeof(adjout_t));
+            break;
+        }
+
+    /* its thread notices and frees it */
+    rib_dump_t *dump = dump_find(rib, session);
+    if (dump) {
+        dump->dump_stopped = 1;
+        dump_unlink(rib, dump);
+        pthread_cond_signal(&dump->dump_wake);
+    }
+
+    /* its paths go a batch of buckets at a time, walked like a sender
+     * walks them so the table may grow in between, the other peers and
+     * the senders get the lock meanwhile, nothing new comes from it */
+    uint64_t pos = 0;
+    while (rib->buckets_size) {
+        size_t size = 0;
+        do {
+            uint64_t mask = rib->buckets_size - 1;
+            for (rib_entry_t *entry = rib->buckets[rev64(pos) & mask];
+                entry; entry = entry->re_next, size++)
+            {
+                withdraw_entry(rib, entry, session);
+            }
+            pos += 1ULL << (64 - __builtin_ctzll(rib->buckets_size));
+        } while (pos && size < RIB_DUMP_BATCH);
+
+        if (!pos)
+            break;
+        flush_locked(rib);
+        pthread_mutex_unlock(&rib->lock);
+        sched_yield();
+        pthread_mutex_lock(&rib->lock);
+    }
+
+    flush_locked(rib);
+    pthread_mutex_unlock(&rib->lock);
+}
+
+void
+rib_print(rib_t *rib, FILE *outf, size_t count)
+{
+    pthread_mutex_lock(&rib->lock);
+
+    fprintf(outf, "rib: %zu routes, %zu buckets, %zu peers, %llu decisions, "
+        "%llu changes, %llu UPDATEs sent\n", rib->entries,
+        rib->buckets_size, rib->peers_size,
+        (unsigned long long)rib->stat_decisions,
+        (unsigned long long)rib->stat_changes,
+        (unsigned long long)rib->stat_updates);
+    for (size_t p = 0; p < rib->peers_size; p++)
+        fprintf(outf, "  peer %u:%u: %zu routes advertised, %zu KiB\n",
+            rib->peers[p]->session_peer_itad, rib->peers[p]->session_peer_id,
+            rib->peers_out[p].size, adjout_bytes(&rib->peers_out[p]) / 1024);
+    for (const rib_dump_t *dump = rib->dumps; dump; dump = dump->dump_next) {
+        const outqueue_t *q = &dump->dump_queue;
+        fprintf(outf, "  sender to %u:%u: %zu routes queued, %zu KiB, "
+            "%llu queued and %llu merged so far\n",
+            dump->dump_peer->session_peer_itad,
+            dump->dump_peer->session_peer_id, q->size,
+            outqueue_bytes(q) / 1024, (unsigned long long)q->queued,
+            (unsigned long long)q->merged);
+        if (!dump->dump_done)
+            fprintf(outf, "    %s walk: %llu routes sent%s\n",
+                dump->dump_full ? "table" : "changes",
+                (unsigned long long)dump->dump_routes,
+                dump->dump_walked ? ", walk done" : "");
+    }
+
+    size_t shown = 0;
+    for (size_t b = 0; b < rib->buckets_size && shown < count; b++)
+        for (rib_entry_t *entry = rib->buckets[b]; entry && shown < count;
+            entry = entry->re_next, shown++)
+        {
+            const rib_path_t *best = entry->re_best;
+            const char *app = app_proto_name(entry->re_route.route_app_proto);
+            fprintf(outf, "  %-6s %-12s %-20.*s ",
+                af_name(entry->re_route.route_af), app ? app : "?",
+                entry->re_route.route_len, entry->re_route.route_addr);
+            if (!best) {
+                fprintf(outf, "unreachable\n");
+                continue;
+            }
+            if (best->rp_source)
+                fprintf(outf, "via %u:%u", best->rp_source->session_peer_itad,
+                    best->rp_source->session_peer_id);
+            else
+                fprintf(outf, "local");
+            fprintf(outf, " set %u localpref %u path %u\n",
+                best->rp_set->set_id, best->rp_localpref,
+                path_length(best->rp_set->set_path));
+        }
+
+    pthread_mutex_unlock(&rib->lock);
+}
+
+void
+rib_destroy(rib_t *rib)
+{
+    if (rib != g_rib)
+        return;
+
+    for (size_t b = 0; b < rib->buckets_size; b++) {
+        rib_entry_t *entry = rib->buckets[b];
+        while (entry) {
+            rib_entry_t *next = entry->re_next;
+            rib_path_t *path = entry->re_paths;
+            while (path) {
+                rib_path_t *path_next = path->rp_next;
+                attrset_unref(path->rp_set);
+                pool_free(path, sizeof(rib_path_t));
+                path = path_next;
+            }
+            pool_free(entry, sizeof(rib_entry_t) + entry->re_route.route_len);
+            entry = next;
+        }
+    }
+
+    for (size_t p = 0; p < rib->peers_size; p++)
+        adjout_free(&rib->peers_out[p]);
+    prefixlist_release(rib->origin);
+    free(rib->buckets);
+    pthread_mutex_destroy(&rib->lock);
+    free(rib);
+    g_rib = NULL;
+}
@@ -0,0 +1,173 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _RIB_H
+#define _RIB_H
+
+#include <protocol/protocol.h>
+
+#include "session.h"
+#include "attrset.h"
+#include "prefixlist.h"
+#include "adjout.h"
+#include "outqueue.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+
+/* Loc-RIB
+ * one entry per route (address family, application protocol, address) with
+ * a candidate path from each source, the local ITAD or a peer session, the
+ * decision process picks the best one whenever a candidate changes and
+ * queues the entry if the pick did, a flush passes the queued entries on to
+ * the established peers, they are sent grouped by attribute set, so routes
+ * that share attributes share UPDATEs
+ * locally originated routes are the permit entries with a server of the
+ * "local" prefix list, each committed version is diffed against the one
+ * originated last and only the difference goes into the RIB
+ *
+ * every peer has a sender thread of its own from ESTABLISHED on, first it
+ * sends the table, the buckets are walked in bit-reversed order so the
+ * cursor survives the table growing meanwhile, then an empty UPDATE
+ * (end-of-RIB); a batch of routes at a time is packed with the lock held
+ * and sent without it, so a slow peer only holds up its own sender
+ * a flush only queues the changed routes on each peer (outqueue.h),
+ * announcements ahead of a running walk are left to it, the sender packs
+ * them as they are when it gets to them, so a route that changed several
+ * times while the peer's socket was full is sent once, as it is last;
+ * routes the peer gets no path for are queued wherever the walk is, apart,
+ * and go first, ahead of the rest of a walk too, and the UPDATEs go to the
+ * session a chunk at a time so its KEEPALIVEs and NOTIFICATIONs get in
+ * between (session.h)
+ * the peer's outbound prefix list and route-map decide what it gets, a
+ * route-map's sets apply to what is sent, not to the RIB
+ * what each peer was sent is kept as a digest per route (adjout.h), the
+ * sender sends a peer only what differs from it, and after its export
+ * policy changed a walk in the same way sends only the routes it now gets
+ * differently
+ */
+
+#define RIB_MAX_PEERS       64
+#define RIB_LOCALPREF       100     /* originated routes, and the default */
+#define RIB_DUMP_BATCH      1024    /* routes per lock hold and 4K of UPDATE */
+
+typedef struct rib_path_s {
+    struct rib_path_s  *rp_next;
+    session_t          *rp_source;      /* NULL if originated */
+    attrset_t          *rp_set;
+    uint32_t            rp_localpref;
+} rib_path_t;
+
+typedef struct rib_entry_s {
+    struct rib_entry_s *re_next;        /* hash chain */
+    struct rib_entry_s *re_dirty;       /* flush queue */
+    uint64_t            re_hash;
+    rib_path_t         *re_paths;
+    rib_path_t         *re_best;        /* NULL if unreachable */
+    uint8_t             re_queued;
+    route_t             re_route;       /* key, address follows */
+} rib_entry_t;
+
+/* sender of a peer, the table, or the changes to it, then what changes */
+typedef struct rib_dump_s {
+    struct rib_dump_s  *dump_next;
+    struct rib_s       *dump_rib;
+    session_t          *dump_peer;      /* referenced until the thread ends */
+    pthread_t           dump_thread;
+    pthread_cond_t      dump_wake;      /* something to send, or stopped */
+    uint64_t            dump_pos;       /* bit-reversed, hashes below done */
+    int                 dump_full;      /* unchanged routes too */
+    int                 dump_walked;    /* cursor wrapped */
+    int                 dump_eor;       /* end-of-RIB packed, or not sent */
+    int                 dump_done;      /* walk and its queue sent */
+    int                 dump_stopped;   /* peer gone, thread frees it */
+    int                 dump_failed;    /* a change could not be queued */
+
+    outqueue_t          dump_queue;     /* routes changed, to send */
+
+    struct timespec     dump_start;     /* of the walk */
+    uint64_t            dump_routes, dump_updates, dump_batches;
+} rib_dump_t;
+
+typedef struct rib_s {
+    pthread_mutex_t     lock;
+
+    rib_entry_t       **buckets;
+    size_t              buckets_size, entries;
+    rib_entry_t        *dirty;
+    size_t              dirty_size;
+
+    uint32_t            itad, id;
+    session_t          *peers[RIB_MAX_PEERS];
+    adjout_t            peers_out[RIB_MAX_PEERS];   /* what each was sent */
+    size_t              peers_size;
+    rib_dump_t         *dumps;          /* senders of the peers */
+
+    /* configuration thread only */
+    prefixlist_trie_t  *origin;         /* version originated last */
+
+    /* counters */
+    uint64_t            stat_decisions, stat_changes, stat_updates;
+} rib_t;
+
+
+/* initialize singleton RIB */
+rib_t *rib_new();
+
+/* local ITAD and id, needed before anything is originated */
+void rib_set_local(rib_t *rib, uint32_t itad, uint32_t id);
+
+/* candidate from source (NULL for originated), replaces its previous one,
+ * the RIB takes its own reference of set, returns 1 if the best path of the
+ * route changed */
+int rib_update(rib_t *rib, session_t *source, const route_t *route,
+    attrset_t *set, uint32_t localpref);
+
+/* drop the candidate from source, returns 1 if the best path changed */
+int rib_withdraw(rib_t *rib, session_t *source, const route_t *route);
+
+/* send the queued changes to the peers */
+void rib_flush(rib_t *rib);
+
+/* originate the current version of plist, only what changed since the last
+ * call, returns the number of routes added, changed or withdrawn */
+int rib_originate(rib_t *rib, prefixlist_t *plist);
+
+/* peer reached ESTABLISHED, a sender thread sends it the table and then
+ * every change */
+int rib_add_peer(rib_t *rib, session_t *session);
+
+/* send peer the table again in the background, all of it with end-of-RIB
+ * if full (it asked for a route refresh), otherwise only the routes whose
+ * export changed from what it was sent (export policy changed), -1 if
+ * session is not a peer */
+int rib_refresh_peer(rib_t *rib, session_t *session, int full);
+
+/* peer session closed, its routes are withdrawn */
+void rib_remove_peer(rib_t *rib, session_t *session);
+
+void rib_print(rib_t *rib, FILE *outf, size_t count);
+
+void rib_destroy(rib_t *rib);
+
+
+#endif /* _RIB_H */
@@ -0,0 +1,228 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ROUTEMAP_H
+#define _ROUTEMAP_H
+
+#include <protocol/protocol.h>
+#include <protocol/attrview.h>
+
+#include "arena.h"
+#include "prefixlist.h"
+#include "attrset.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+
+/* route-maps
+ * clauses are staged by the configuration and compiled on commit into a flat
+ * bytecode program, which is swapped in like prefix lists, clauses are
+ * tried in sequence order, a failing match jumps straight to the next
+ * clause, the first clause whose matches all hold applies its sets and
+ * decides, falling off the end denies
+ * a decision reached without looking at the route only depends on the
+ * attribute set, those are memoized per program and attribute set id, a
+ * new program starts with an empty cache and set ids are never reused, so
+ * nothing has to be flushed
+ */
+
+#define ROUTEMAP_NAME_MAX       32
+#define ROUTEMAP_COMMUNITIES_MAX 16 /* set community per clause */
+#define ROUTEMAP_CACHE_SIZE     4096    /* direct mapped, power of 2 */
+
+enum routemap_op {
+    /* matches, ins_fail is taken when false */
+    RM_OP_MATCH_COMMUNITY,      /* arg: pool index */
+    RM_OP_MATCH_PATH_ITAD,      /* arg: ITAD in AdvertisementPath */
+    RM_OP_MATCH_PATH_ORIGIN,    /* arg: last ITAD of AdvertisementPath */
+    RM_OP_MATCH_PATH_LEN,       /* arg: maximum path length */
+    RM_OP_MATCH_NEXTHOP_ITAD,   /* arg: NextHopServer ITAD */
+    RM_OP_MATCH_AF,             /* arg: route address family */
+    RM_OP_MATCH_APP_PROTO,      /* arg: route application protocol */
+    RM_OP_MATCH_PREFIXLIST,     /* arg: prefix list slot */
+    /* sets */
+    RM_OP_SET_LOCALPREF,        /* arg: value */
+    RM_OP_SET_MED,              /* arg: value */
+    RM_OP_SET_COMMUNITIES,      /* arg: pool index << 16 | count */
+    /* decisions */
+    RM_OP_PERMIT,
+    RM_OP_DENY
+};
+
+typedef struct {
+    uint8_t     ins_op;
+    uint8_t     ins_reserved;
+    uint16_t    ins_fail;       /* pc of the next clause */
+    uint32_t    ins_arg;
+} routemap_ins_t;
+
+#define ROUTEMAP_SET_LOCALPREF  0x01
+#define ROUTEMAP_SET_MED        0x02
+
+typedef struct {
+    uint8_t             res_action;     /* enum prefixlist_action */
+    uint8_t             res_set;        /* ROUTEMAP_SET_* */
+    attr_localpref_t    res_localpref;
+    attr_multiexitdisc_t res_med;
+    const community_t  *res_communities;    /* added */
+    size_t              res_communities_size;
+} routemap_result_t;
+
+typedef struct {
+    uint32_t            cache_set;      /* attribute set id, 0 empty */
+    routemap_result_t   cache_result;
+} routemap_cache_t;
+
+/* compiled route-map, immutable but for the result cache */
+typedef struct {
+    uint32_t            prog_refs;
+    uint32_t            prog_version;
+    uint32_t            prog_clauses;
+    routemap_ins_t     *prog_code;
+    size_t              prog_code_size;
+    community_t        *prog_pool;
+    size_t              prog_pool_size;
+    prefixlist_t      **prog_plists;
+    size_t              prog_plists_size;
+    int                 prog_per_route;     /* matches depend on the route */
+
+    pthread_mutex_t     prog_cache_lock;
+    routemap_cache_t   *prog_cache;         /* allocated on first store */
+    uint64_t            prog_cache_hits, prog_cache_misses,
+                        prog_cache_bypass;
+} routemap_prog_t;
+
+/* one evaluation context per UPDATE, or per batch of routes to export,
+ * holds the prefix lists the program acquired so they are taken once per
+ * UPDATE and not per route */
+typedef struct {
+    routemap_prog_t    *ctx_prog;
+    arena_t            *ctx_arena;
+    prefixlist_trie_t **ctx_tries;
+    uint32_t            ctx_acquired;   /* bitmask of slots */
+    uint32_t            ctx_set;        /* memo of the last attribute set */
+    routemap_result_t   ctx_result;
+
+    /* last set run without an UPDATE, decoded from its attributes */
+    update_index_t     *ctx_index;
+    attr_view_t         ctx_view;
+    uint32_t            ctx_view_set;
+
+    /* last set the sets of a result were applied to, and what came out */
+    uint32_t            ctx_applied_from;
+    routemap_result_t   ctx_applied_result;
+    attrset_t          *ctx_applied;
+} routemap_ctx_t;
+
+typedef struct {
+    uint8_t             op;
+    uint32_t            arg;
+    community_t         communities[ROUTEMAP_COMMUNITIES_MAX];
+    prefixlist_t       *plist;
+} routemap_stmt_t;
+
+typedef struct {
+    uint32_t            clause_seq;
+    uint8_t             clause_action;
+    routemap_stmt_t    *clause_stmts;
+    size_t              clause_stmts_size;
+} routemap_clause_t;
+
+typedef struct routemap_s {
+    struct routemap_s  *next;
+    char                name[ROUTEMAP_NAME_MAX];
+
+    pthread_mutex_t     lock;           /* prog pointer and refs */
+    routemap_prog_t    *prog;           /* NULL until first commit */
+
+    /* configuration side only, kept across commits */
+    routemap_clause_t  *clauses;
+    size_t              clauses_size;
+    routemap_clause_t  *clause;         /* being edited */
+
+    /* running definition while a reload restages the clauses */
+    routemap_clause_t  *reload_clauses;
+    size_t              reload_clauses_size;
+    int                 reload_seen;
+} routemap_t;
+
+
+/* find route-map by name, creating an empty one */
+routemap_t *routemap_get(const char *name);
+
+routemap_t *routemap_find(const char *name);
+
+/* edit clause seq (0 for last + 10), replacing its statements */
+int routemap_clause(routemap_t *rmap, uint8_t action, uint32_t seq);
+
+/* parse and stage a "match ..." or "set ..." into the edited clause */
+int routemap_stage_match(routemap_t *rmap, char *args);
+int routemap_stage_set(routemap_t *rmap, char *args);
+
+/* compile all clauses and swap the program in */
+int routemap_commit(routemap_t *rmap);
+
+/* configuration reload, clauses are restaged from scratch and nothing is
+ * committed until the end, when maps whose clauses changed are recompiled
+ * and maps not defined again are undefined, returns how many changed */
+void routemap_reload_begin();
+int routemap_reload_end();
+
+/* current program with a reference held, NULL if never committed */
+routemap_prog_t *routemap_acquire(routemap_t *rmap);
+
+void routemap_release(routemap_prog_t *prog);
+
+/* temporaries come from arena and live until its reset */
+void routemap_ctx_init(routemap_ctx_t *ctx, routemap_prog_t *prog,
+    arena_t *arena);
+void routemap_ctx_done(routemap_ctx_t *ctx);
+
+/* run against a route of the UPDATE behind view, a NULL program permits
+ * with no sets, < 0 if an attribute fails to decode */
+runtime_error_t routemap_run(routemap_ctx_t *ctx, attr_view_t *view,
+    const route_t *route, routemap_result_t *result);
+
+/* same, memoized by attribute set when the decision allows it */
+runtime_error_t routemap_run_set(routemap_ctx_t *ctx, attr_view_t *view,
+    const attrset_t *set, const route_t *route, routemap_result_t *result);
+
+/* same, for a route that is not in an UPDATE, as it would be with the
+ * attributes of set, which are decoded only if the decision is not
+ * memoized already */
+runtime_error_t routemap_run_attrs(routemap_ctx_t *ctx, const attrset_t *set,
+    const route_t *route, routemap_result_t *result);
+
+/* set with the MED and communities of result, the MED replaced and the
+ * communities added to those it has, new reference, NULL if out of
+ * memory */
+attrset_t *routemap_apply(routemap_ctx_t *ctx, attrset_t *set,
+    const routemap_result_t *result);
+
+void routemap_print(FILE *outf, const char *name);
+
+/* evaluate routes against a synthetic UPDATE, in routes per second, cold
+ * decodes the attributes for every route, warm shares one view */
+int routemap_benchmark(routemap_t *rmap, size_t routes, double *cold,
+    double *warm);
+
+
+#endif /* _ROUTEMAP_H */
@@ -22,40 +22,38 @@
 
 #include "session.h"
 
+#include "attrset.h"
+#include "flood.h"
+#include "locator.h"
+#include "pathtab.h"
+#include "pool.h"
+#include "prefixlist.h"
+#include "rib.h"
+#include "routemap.h"
+#include "topology.h"
+#include "trace.h"
+
+#include <protocol/attrview.h>
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <poll.h>
+#include <time.h>
 
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 
 
 #define DEBUG printf
 
-#define SOCK_TRY_SEND(o, a) \
-    if (o < 0) { \
-        fprintf(stderr, "[ERROR] %s:%s:%s: %s\n", \
-            __FILE__, __func__, __LINE__, strerror(errno)); \
-        a; \
-    }
-
-#define SOCK_TRY_RECV(fd, buff, type, action) \
-    while (1) { \
-        res = recv(fd, buff, sizeof(type), 0); \
-        if (res < 0) { \
-            fprintf(stderr, "[ERROR] %s:%s:%s: %s\n", \
-                __FILE__, __func__, __LINE__, strerror(errno)); \
-            action; break; \
-        } else if (res == 0) { \
-            action; break; \
-        } else if (res < sizeof(type)) { \
-            continue; \
-        } \
-        buff += res; break; \
-    }
+/* socket error or peer closed, distinct from runtime_error_t */
+#define SESSION_SOCK_ERROR  -100
 
 
 const char *session_state_strs[] = {
@@ -67,6 +65,92 @@ const char *session_state_strs[] = {
     "established"
 };
 
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static session_t *g_pool = NULL;
+static size_t g_pool_size = 0, g_live = 0;
+
+
+/* from the pool if it has one, with its buffer and send lock ready */
+static session_t *
+session_alloc()
+{
+    pthread_mutex_lock(&g_pool_lock);
+    session_t *session = g_pool;
+    if (session) {
+        g_pool = session->session_pool_next;
+        g_pool_size--;
+    }
+    g_live++;
+    pthread_mutex_unlock(&g_pool_lock);
+
+    if (session) {
+        if (!session->session_buff) {
+            session->session_buff = pool_alloc(MAX_MSG_SIZE);
+            session->session_buff_size = MAX_MSG_SIZE;
+        }
+        if (session->session_buff)
+            return session;
+
+        pthread_mutex_lock(&g_pool_lock);
+        session->session_pool_next = g_pool;
+        g_pool = session;
+        g_pool_size++;
+        g_live--;
+        pthread_mutex_unlock(&g_pool_lock);
+        return NULL;
+    }
+
+    session = pool_alloc(sizeof(session_t));
+    if (!session)
+        goto error;
+    session->session_buff = pool_alloc(MAX_MSG_SIZE);
+    if (!session->session_buff) {
+        pool_free(session, sizeof(session_t));
+        goto error;
+    }
+    session->session_buff_size = MAX_MSG_SIZE;
+    pthread_mutex_init(&session->session_send_lock, NULL);
+    pthread_cond_init(&session->session_send_cond, NULL);
+    arena_init(&session->session_arena);
+    return session;
+
+error:
+    pthread_mutex_lock(&g_pool_lock);
+    g_live--;
+    pthread_mutex_unlock(&g_pool_lock);
+    return NULL;
+}
+
+static void
+session_init(session_t *session, const session_env_t *env, uint32_t itad,
+    uint32_t id, uint16_t hold, capinfo_transmode_t transmode,
+    const struct sockaddr_in6 *peer_addr, uint32_t peer_itad)
+{
+    session->session_pool_next = NULL;
+    session->session_env = env;
+    session->session_state = STATE_IDLE;
+    session->session_transmode = transmode;
+    session->session_itad = itad;
+    session->session_id = id;
+    session->session_hold = hold;
+    session->session_msg_size = MAX_MSG_SIZE;
+    session->session_compress = NULL;
+    session->session_zsend = session->session_zrecv = 0;
+    session->session_refresh = 0;
+    session->session_urgent = 0;
+    session->session_keepalive = 0;
+    session->session_peer_itad = peer_itad;
+    session->session_peer_id = 0;
+    session->session_flood_slot = -1;
+    __atomic_store_n(&session->session_refs, 2, __ATOMIC_RELEASE);
+    session->session_stopping = 0;
+    session->session_closed = 0;
+    session->session_plist_in = session->session_plist_out = NULL;
+    session->session_rmap_in = session->session_rmap_out = NULL;
+    session->session_policy_in = session->session_policy_out = 0;
+
+    memcpy(&session->session_peer_addr, peer_addr, sizeof(struct sockaddr_in6));
+}
 
 static void
 session_change_state(session_t *s, session_state_t new_state)
@@ -80,60 +164,728 @@ session_change_state(session_t *s, session_state_t new_state)
     s->session_state = new_state;
 }
 
+/* send len bytes of serialized message in session_buff */
+static int
+session_send_msg(session_t *s, size_t len)
+{
+    return session_send(s, s->session_buff, len);
+}
+
+/* descriptors are non-blocking, wait until fd is ready for events, or
+ * timeout ms (-1 forever), a shutdown() wakes this too, returns 0 on
+ * timeout */
+static int
+session_wait(int fd, short events, int timeout)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+    int r = 0;
+    while ((r = poll(&pfd, 1, timeout)) < 0)
+        if (errno != EINTR)
+            return -1;
+    return r;
+}
+
+/* send len bytes of whole messages, send lock held, compressed once
+ * switched on */
+static int
+session_send_locked(session_t *session, const void *buff, size_t len)
+{
+    const msg_t *msg = buff;
+    size_t sent = 0, msg_len = len;
+
+    if (session->session_zsend) {
+        ssize_t res = compress_deflate(session->session_compress, buff, len,
+            &buff);
+        if (res < 0) {
+            fprintf(stderr, "[ERROR session] could not compress\n");
+            /* the stream is broken, the session thread closes it */
+            shutdown(session->session_fd, SHUT_RDWR);
+            return SESSION_SOCK_ERROR;
+        }
+        len = res;
+    }
+
+    while (sent < len) {
+        ssize_t res = send(session->session_fd, buff + sent, len - sent,
+            MSG_NOSIGNAL);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                session_wait(session->session_fd, POLLOUT, -1) > 0)
+            {
+                continue;
+            }
+            fprintf(stderr, "[ERROR session] send(): %s\n", strerror(errno));
+            return SESSION_SOCK_ERROR;
+        }
+        sent += res;
+    }
+
+    TRACE(TRACE_MSG_SENT, msg->msg_type, msg_len);
+    return msg_len;
+}
+
+static time_t
+session_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* ms until the next KEEPALIVE is due, -1 if none is */
+static int
+session_keepalive_wait(const session_t *s)
+{
+    if (!s->session_keepalive)
+        return -1;
+    time_t now = session_now();
+    return now >= s->session_keepalive ? 0 :
+        (s->session_keepalive - now) * 1000;
+}
+
+/* a KEEPALIVE every third of the hold time from OPENCONFIRM on, sent from
+ * a buffer of its own, session_buff may hold a partial message */
+static int
+session_keepalive_send(session_t *s)
+{
+    uint8_t buff[MSG_HDR_LEN];
+    int r = new_msg_keepalive(buff, sizeof(buff));
+    if (r < 0)
+        return r;
+    s->session_keepalive = session_now() + s->session_hold / 3;
+    return session_send(s, buff, r);
+}
+
+/* receive at least one and up to len bytes, sending KEEPALIVEs when due,
+ * also while the peer keeps sending */
+static int
+session_recv_some(session_t *s, void *buff, size_t len)
+{
+    while (1) {
+        if (session_keepalive_wait(s) == 0 && session_keepalive_send(s) < 0)
+            return SESSION_SOCK_ERROR;
+
+        ssize_t res = recv(s->session_fd, buff, len, 0);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            /* readable, or a KEEPALIVE is due */
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+                session_wait(s->session_fd, POLLIN,
+                session_keepalive_wait(s)) >= 0)
+            {
+                continue;
+            }
+            fprintf(stderr, "[ERROR session] recv(): %s\n", strerror(errno));
+            return SESSION_SOCK_ERROR;
+        } else if (res == 0) {
+            return SESSION_SOCK_ERROR;
+        }
+        TRACE(TRACE_MSG_RECV, 0, res);
+        return res;
+    }
+}
+
+/* receive exactly len bytes, decompressed once the peer switched */
+static int
+session_recv_full(session_t *s, void *buff, size_t len)
+{
+    size_t recvd = 0;
+
+    while (recvd < len) {
+        int r = 0;
+        if (!s->session_zrecv) {
+            r = session_recv_some(s, buff + recvd, len - recvd);
+            if (r < 0)
+                return r;
+            recvd += r;
+            continue;
+        }
+
+        r = compress_inflate(s->session_compress, buff + recvd, len - recvd);
+        if (r < 0)
+            return ERROR_COMPRESS;
+        if (r > 0) {
+            recvd += r;
+            continue;
+        }
+
+        size_t space = 0;
+        void *in = compress_in_space(s->session_compress, &space);
+        r = session_recv_some(s, in, space);
+        if (r < 0)
+            return r;
+        compress_in_fed(s->session_compress, r);
+    }
+
+    return recvd;
+}
+
+/* frame one whole message into session_buff */
+static int
+session_recv_msg(session_t *s, const msg_t **msg_out)
+{
+    int r = session_recv_full(s, s->session_buff, MSG_HDR_LEN);
+    if (r < 0)
+        return r;
+
+    r = parse_msg(s->session_buff, MSG_HDR_LEN, msg_out);
+    if (r < 0)
+        return r;
+
+    size_t msg_len = (*msg_out)->msg_len;
+    if (msg_len > s->session_msg_size - MSG_HDR_LEN)
+        return ERROR_BUFFLEN;
+
+    r = session_recv_full(s, s->session_buff + MSG_HDR_LEN, msg_len);
+    if (r < 0)
+        return r;
+
+    TRACE(TRACE_MSG_FRAMED, (*msg_out)->msg_type, msg_len);
+    return MSG_HDR_LEN + msg_len;
+}
+
+/* message size and codec the peer advertised in the OPEN options,
+ * MAX_MSG_SIZE and CAPINFO_COMPRESS_NONE if it did not, other options and
+ * capabilities are not looked at */
+static int
+session_open_caps(const msg_open_t *open, uint32_t *msg_size,
+    capinfo_compress_t *compress, int *refresh)
+{
+    *msg_size = MAX_MSG_SIZE;
+    *compress = CAPINFO_COMPRESS_NONE;
+    *refresh = 0;
+
+    const void *opts = open->open_opts, *end = opts + open->open_opts_len;
+
+    while (opts < end) {
+        const msg_open_opt_t *opt = opts;
+        if (end - opts < sizeof(msg_open_opt_t) ||
+            opt->opt_len > end - opts - sizeof(msg_open_opt_t))
+        {
+            return ERROR_INCOMPLETE;
+        }
+        int r = parse_msg_open_opt(opts, end - opts, &opt);
+        if (r == ERROR_OPT) {
+            opts += sizeof(msg_open_opt_t) + opt->opt_len;
+            continue;
+        }
+        if (r < 0)
+            return r;
+
+        const void *caps = opt->opt_val, *caps_end = caps + opt->opt_len;
+        while (caps < caps_end) {
+            const capinfo_t *capinfo = NULL;
+            r = parse_capinfo_t(caps, caps_end - caps, &capinfo);
+            if (r < 0)
+                return r;
+
+            if (capinfo->capinfo_code == CAPINFO_CODE_MSGSIZE) {
+                const capinfo_msgsize_t *msgsize = NULL;
+                r = parse_capinfo_msgsize(capinfo->capinfo_val,
+                    capinfo->capinfo_len, &msgsize);
+                if (r < 0)
+                    return r;
+                *msg_size = *msgsize;
+            } else if (capinfo->capinfo_code == CAPINFO_CODE_COMPRESS) {
+                const capinfo_compress_t *codec = NULL;
+                r = parse_capinfo_compress(capinfo->capinfo_val,
+                    capinfo->capinfo_len, &codec);
+                if (r < 0)
+                    return r;
+                *compress = *codec;
+            } else if (capinfo->capinfo_code == CAPINFO_CODE_REFRESH) {
+                *refresh = 1;
+            }
+
+            caps += sizeof(capinfo_t) + capinfo->capinfo_len;
+        }
+
+        opts = caps_end;
+    }
+
+    return 0;
+}
+
+/* codec to offer in our OPEN, its streams are set up beforehand */
+static capinfo_compress_t
+session_compress_offer(session_t *s)
+{
+    if (!s->session_env || !__atomic_load_n(&s->session_env->env_compress,
+        __ATOMIC_RELAXED))
+    {
+        return CAPINFO_COMPRESS_NONE;
+    }
+
+    s->session_compress = compress_new();
+    return s->session_compress ? CAPINFO_COMPRESS_ZLIB :
+        CAPINFO_COMPRESS_NONE;
+}
+
+/* messages up to msg_size bytes fit in the receive buffer */
+static int
+session_grow_buff(session_t *s, size_t msg_size)
+{
+    if (msg_size <= s->session_buff_size)
+        return 0;
+
+    void *buff = pool_alloc(msg_size);
+    if (!buff)
+        return ERROR_BUFF;
+
+    pool_free(s->session_buff, s->session_buff_size);
+    s->session_buff = buff;
+    s->session_buff_size = msg_size;
+    return 0;
+}
+
+static int
+session_handle_open(session_t *s, const msg_t *msg)
+{
+    if (s->session_state != STATE_OPENSENT)
+        return ERROR_FSM;
+
+    const msg_open_t *open = NULL;
+    int r = parse_msg_open(msg->msg_val, msg->msg_len, &open);
+    if (r < 0)
+        return r;
+
+    /* initiated sessions know who they expect */
+    if (s->session_peer_itad && s->session_peer_itad != open->open_itad)
+        return ERROR_ITAD;
+
+    uint32_t msg_size = 0;
+    capinfo_compress_t compress = CAPINFO_COMPRESS_NONE;
+    int refresh = 0;
+    r = session_open_caps(open, &msg_size, &compress, &refresh);
+    if (r < 0)
+        return r;
+    if (msg_size > SESSION_MSG_SIZE)
+        msg_size = SESSION_MSG_SIZE;
+
+    /* streams were set up if we offered compression, the peer has to
+     * have offered the same codec */
+    if (s->session_compress && compress != CAPINFO_COMPRESS_ZLIB) {
+        compress_free(s->session_compress);
+        s->session_compress = NULL;
+    }
+
+    s->session_refresh = refresh;
+    s->session_peer_itad = open->open_itad;
+    s->session_peer_id = open->open_id;
+    if (s->session_env && s->session_env->env_locator)
+        locator_set_id(s->session_env->env_locator, &s->session_peer_addr,
+            open->open_id);
+    if (open->open_hold < s->session_hold)
+        s->session_hold = open->open_hold;
+
+    /* open and msg are in the old buffer */
+    r = session_grow_buff(s, msg_size);
+    if (r < 0)
+        return r;
+    s->session_msg_size = msg_size;
+
+    r = new_msg_keepalive(s->session_buff, s->session_buff_size);
+    if (r < 0)
+        return r;
+
+    r = session_send_msg(s, r);
+    if (r < 0)
+        return r;
+    if (s->session_hold)
+        s->session_keepalive = session_now() + s->session_hold / 3;
+
+    /* nothing else is sent before the session is established */
+    if (s->session_compress)
+        s->session_zsend = 1;
+
+    session_change_state(s, STATE_OPENCONFIRM);
+    return 0;
+}
+
+static int
+session_handle_keepalive(session_t *s, const msg_t *msg)
+{
+    switch (s->session_state) {
+    case STATE_OPENCONFIRM:
+        /* the peer compresses from after this one on */
+        if (s->session_compress)
+            s->session_zrecv = 1;
+        session_change_state(s, STATE_ESTABLISHED);
+    break;
+    case STATE_ESTABLISHED: return 0;
+    default: return ERROR_FSM;
+    }
+
+    /* internal peers take part in link-state flooding */
+    if (s->session_peer_itad == s->session_itad &&
+        s->session_env && s->session_env->env_flood)
+    {
+        flood_add_neighbor(s->session_env->env_flood, s);
+    }
+
+    /* what a reload compares against to tell what to send again */
+    __atomic_store_n(&s->session_policy_in, session_policy(s, 0),
+        __ATOMIC_RELAXED);
+    __atomic_store_n(&s->session_policy_out, session_policy(s, 1),
+        __ATOMIC_RELAXED);
+
+    if (s->session_env && s->session_env->env_rib)
+        rib_add_peer(s->session_env->env_rib, s);
+
+    return 0;
+}
+
+static int
+session_handle_refresh(session_t *s, const msg_t *msg)
+{
+    if (s->session_state != STATE_ESTABLISHED)
+        return ERROR_FSM;
+
+    printf("[INFO session] peer %d:%d asked for a route refresh\n",
+        s->session_peer_itad, s->session_peer_id);
+    if (s->session_env && s->session_env->env_rib)
+        rib_refresh_peer(s->session_env->env_rib, s, 1);
+    return 0;
+}
+
+static int
+session_handle_update(session_t *s, const msg_t *msg)
+{
+    if (s->session_state != STATE_ESTABLISHED)
+        return ERROR_FSM;
+
+    /* no attributes at all, the peer has sent its whole table */
+    if (msg->msg_len == 0) {
+        printf("[INFO session] end-of-RIB from peer %d:%d\n",
+            s->session_peer_itad, s->session_peer_id);
+        return 0;
+    }
+
+    /* room for as many routes as the body can hold, in the message's
+     * arena, the negotiated size bounds it */
+    update_index_t index;
+    index.route_capacity = UPDATE_INDEX_ROUTES(msg->msg_len);
+    index.route_off = arena_alloc(&s->session_arena,
+        index.route_capacity * sizeof(uint16_t));
+    if (!index.route_off)
+        return ERROR_BUFF;
+    int r = parse_msg_update(msg->msg_val, msg->msg_len, &index);
+    TRACE(TRACE_PARSE_DONE, MSG_TYPE_UPDATE, r);
+    if (r < 0)
+        return r;
+
+    /* duplicate and stale link-state attributes were processed already */
+    uint32_t stale = 0;
+    if (s->session_flood_slot >= 0)
+        stale = flood_receive(s->session_env->env_flood, s, msg->msg_val,
+            &index);
+
+    attr_view_t view;
+    attr_view_init(&view, msg->msg_val, &index, &arena_alloc_fn,
+        &s->session_arena);
+
+    /* fresh adjacency announcement, an empty one withdraws them all */
+    if (UPDATE_INDEX_HAS(&index, ATTR_TYPE_ITADTOPOLOGY) &&
+        !(stale & (1u << ATTR_TYPE_ITADTOPOLOGY)) && s->session_env &&
+        s->session_env->env_topology)
+    {
+        const msg_update_attr_lsencap_t *attr = (const void *)msg->msg_val +
+            index.attr_off[ATTR_TYPE_ITADTOPOLOGY];
+        const uint32_t *itads = NULL;
+        r = attr_view_itadtopology(&view, &itads);
+        if (r < 0)
+            return r;
+        topology_update(s->session_env->env_topology, s->session_peer_itad,
+            attr->attr_id, itads, r);
+    }
+
+    /* a flooded copy already seen had its routes applied then, an older one
+     * would undo what came after it */
+    size_t reach_size = stale & (1u << ATTR_TYPE_REACHABLEROUTES) ? 0 :
+        index.reach_size;
+    size_t withdrawn_size = stale & (1u << ATTR_TYPE_WITHDRAWNROUTES) ? 0 :
+        index.withdrawn_size;
+
+    /* routes of the UPDATE share one interned attribute set */
+    attrset_t *set = NULL;
+    if (reach_size)
+        set = attrset_intern(msg->msg_val, msg->msg_len, &index,
+            &s->session_arena);
+    const path_t *advpath = set ? set->set_path : NULL;
+
+    /* routes that already went through the local ITAD are loops */
+    int looped = s->session_peer_itad != s->session_itad &&
+        path_contains(advpath, s->session_itad);
+    if (looped) {
+        DEBUG("update: looped through ITAD %d, %d routes ignored\n",
+            s->session_itad, index.reach_size);
+    }
+
+    /* LocalPref is only meaningful inside the ITAD */
+    attr_localpref_t localpref = RIB_LOCALPREF;
+    if (s->session_peer_itad == s->session_itad) {
+        r = attr_view_localpref(&view, &localpref);
+        if (r < 0) {
+            attrset_unref(set);
+            return r;
+        }
+        if (r == 0)
+            localpref = RIB_LOCALPREF;
+    }
+
+    rib_t *rib = s->session_env ? s->session_env->env_rib : NULL;
+
+    /* import policy, one version of each for the whole UPDATE */
+    size_t denied = 0;
+    prefixlist_trie_t *plist_in = prefixlist_acquire(
+        __atomic_load_n(&s->session_plist_in, __ATOMIC_ACQUIRE));
+    routemap_prog_t *rmap_in = routemap_acquire(
+        __atomic_load_n(&s->session_rmap_in, __ATOMIC_ACQUIRE));
+    routemap_ctx_t rmap_ctx;
+    routemap_ctx_init(&rmap_ctx, rmap_in, &s->session_arena);
+
+    for (size_t i = 0; i < reach_size && !looped && r >= 0; i++) {
+        const route_t *route = attr_view_reachable(&view, i);
+        if (prefixlist_match(plist_in, route) == PREFIXLIST_DENY) {
+            denied++;
+            /* sent again after the filter changed, it is dropped now */
+            if (rib)
+                rib_withdraw(rib, s, route);
+            continue;
+        }
+
+        routemap_result_t result;
+        r = routemap_run_set(&rmap_ctx, &view, set, route, &result);
+        if (r < 0)
+            break;
+        if (result.res_action == PREFIXLIST_DENY) {
+            denied++;
+            /* a route that no longer passes replaces what was accepted */
+            if (rib)
+                rib_withdraw(rib, s, route);
+            continue;
+        }
+
+        if (!rib)
+            continue;
+
+        /* set med and set community make a set of their own */
+        attrset_t *applied = routemap_apply(&rmap_ctx, set, &result);
+        if (!applied) {
+            denied++;
+            rib_withdraw(rib, s, route);
+            continue;
+        }
+        rib_update(rib, s, route, applied,
+            result.res_set & ROUTEMAP_SET_LOCALPREF ?
+            result.res_localpref : localpref);
+        attrset_unref(applied);
+    }
+
+    routemap_ctx_done(&rmap_ctx);
+    routemap_release(rmap_in);
+    prefixlist_release(plist_in);
+    if (r < 0) {
+        attrset_unref(set);
+        return r;
+    }
+
+    for (size_t i = 0; rib && i < withdrawn_size; i++)
+        rib_withdraw(rib, s, attr_view_withdrawn(&view, i));
+    if (rib)
+        rib_flush(rib);
+
+    DEBUG("update: %d reachable (%zu denied), %d withdrawn, path length %d, "
+        "stale mask %x\n", index.reach_size, denied, index.withdrawn_size,
+        path_length(advpath), stale);
+
+    attrset_unref(set);
+
+    return 0;
+}
+
+static void
+session_handle_notif(session_t *s, const msg_t *msg)
+{
+    const msg_notif_t *notif = NULL;
+    if (parse_msg_notif(msg->msg_val, msg->msg_len, &notif) < 0) {
+        printf("[INFO session] peer %d:%d sent malformed NOTIFICATION\n",
+            s->session_peer_itad, s->session_peer_id);
+        return;
+    }
+
+    printf("[INFO session] peer %d:%d sent NOTIFICATION %d/%d\n",
+        s->session_peer_itad, s->session_peer_id,
+        notif->notif_error_code, notif->notif_error_subcode);
+}
+
+/* map a runtime error to the NOTIFICATION that reports it */
+static void
+session_notify_error(session_t *s, int error)
+{
+    uint8_t code = NOTIF_CODE_CEASE, subcode = 0;
+
+    switch (error) {
+    case ERROR_MSGTYPE:
+        code = NOTIF_CODE_ERROR_MSG; subcode = NOTIF_SUBCODE_MSG_BAD_TYPE;
+    break;
+    case ERROR_BUFFLEN:
+    case ERROR_INCOMPLETE:
+        code = NOTIF_CODE_ERROR_MSG; subcode = NOTIF_SUBCODE_MSG_BAD_LEN;
+    break;
+    case ERROR_VERSION:
+        code = NOTIF_CODE_ERROR_OPEN;
+        subcode = NOTIF_SUBCODE_OPEN_UNSUP_VERSION;
+    break;
+    case ERROR_ITAD:
+        code = NOTIF_CODE_ERROR_OPEN; subcode = NOTIF_SUBCODE_OPEN_BAD_ITAD;
+    break;
+    case ERROR_HOLD:
+        code = NOTIF_CODE_ERROR_OPEN; subcode = NOTIF_SUBCODE_OPEN_BAD_HOLD;
+    break;
+    case ERROR_MSGSIZE:
+        code = NOTIF_CODE_ERROR_OPEN;
+        subcode = NOTIF_SUBCODE_OPEN_CAP_MISMATCH;
+    break;
+    case ERROR_ATTR_TYPE:
+        code = NOTIF_CODE_ERROR_UPDATE;
+        subcode = NOTIF_SUBCODE_UPDATE_UNK_WELLKNOWN_ATTR;
+    break;
+    case ERROR_ATTR_MISSING:
+        code = NOTIF_CODE_ERROR_UPDATE;
+        subcode = NOTIF_SUBCODE_UPDATE_MISS_WELLKNOWN_ATTR;
+    break;
+    case ERROR_ATTR_FLAG_WELL_KNOWN:
+    case ERROR_ATTR_FLAG_LSENCAP:
+        code = NOTIF_CODE_ERROR_UPDATE;
+        subcode = NOTIF_SUBCODE_UPDATE_BAD_ATTR_FLAG;
+    break;
+    case ERROR_ATTR_LEN:
+        code = NOTIF_CODE_ERROR_UPDATE;
+        subcode = NOTIF_SUBCODE_UPDATE_BAD_ATTR_LEN;
+    break;
+    case ERROR_ATTR_DUP:
+    case ERROR_ROUTES:
+        code = NOTIF_CODE_ERROR_UPDATE;
+        subcode = NOTIF_SUBCODE_UPDATE_MALFORM_ATTR;
+    break;
+    case ERROR_AF:
+    case ERROR_APP_PROTO:
+    case ERROR_ITADPATH_TYPE:
+    case ERROR_COMMUNITY_ITAD:
+        code = NOTIF_CODE_ERROR_UPDATE;
+        subcode = NOTIF_SUBCODE_UPDATE_INVAL_ATTR;
+    break;
+    case ERROR_FSM:
+        code = NOTIF_CODE_ERROR_STATE;
+    break;
+    }
+
+    int r = 0;
+    PROTO_TRY(
+        new_msg_notification(s->session_buff, s->session_buff_size, code,
+            subcode, 0, NULL),
+        return
+    );
+
+    session_send_msg(s, r);
+}
+
 static void *
 session_loop(void *arg)
 {
     session_t *s = arg;
 
+    trace_thread_name("session");
+
+    /* little unsent data is left to the kernel, what is still to send
+     * waits in the process, where urgent messages can go ahead of it */
+    int lowat = SESSION_BULK_CHUNK;
+    if (setsockopt(s->session_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+        sizeof(lowat)) < 0)
+    {
+        fprintf(stderr, "[WARNING session] TCP_NOTSENT_LOWAT: %s\n",
+            strerror(errno));
+    }
+
     int r = 0;
 
     /* send OPEN */
     PROTO_TRY(
-        new_msg_open(s->session_buff, MAX_MSG_SIZE,
+        new_msg_open(s->session_buff, s->session_buff_size,
             s->session_hold, s->session_itad, s->session_id,
             supported_routetypes, supported_routetypes_size,
-            s->session_transmode),
-        goto proto_error
-    );
-
-    SOCK_TRY_SEND(
-        send(s->session_fd, s->session_buff, r, 0) < 0,
+            s->session_transmode, SESSION_MSG_SIZE,
+            session_compress_offer(s), 1),
         goto sock_error
     );
+
+    if (session_send_msg(s, r) < 0)
+        goto sock_error;
     session_change_state(s, STATE_OPENSENT);
 
-    int res = 0;
     while (1) {
-        void *recv_wnd = s->session_buff;
-        /* receive message */
-        SOCK_TRY_RECV(s->session_fd, recv_wnd, msg_t, goto sock_error);
+        /* whatever the last message left in the arena is dropped */
+        arena_reset(&s->session_arena);
 
+        /* receive message */
         const msg_t *msg = NULL;
-        PROTO_TRY(
-            parse_msg(s->session_buff, r, &msg),
-            goto proto_error
-        );
+        r = session_recv_msg(s, &msg);
+        if (r == SESSION_SOCK_ERROR)
+            goto sock_error;
+        if (r < 0)
+            goto proto_error;
 
-        DEBUG("msg: %d[%d]\n", msg->msg_type, msg->msg_len);
+        switch (msg->msg_type) {
+        case MSG_TYPE_OPEN:         r = session_handle_open(s, msg); break;
+        case MSG_TYPE_UPDATE:       r = session_handle_update(s, msg); break;
+        case MSG_TYPE_KEEPALIVE:    r = session_handle_keepalive(s, msg); break;
+        case MSG_TYPE_REFRESH:      r = session_handle_refresh(s, msg); break;
+        case MSG_TYPE_NOTIFICATION:
+            session_handle_notif(s, msg);
+            goto sock_error;
+        }
 
-        /* continue */
+        if (r == SESSION_SOCK_ERROR)
+            goto sock_error;
+        if (r < 0)
+            goto proto_error;
     }
 
 proto_error:
-    uint8_t subcode = 0;
-    switch (r) {
-        case ERROR_MSGTYPE: subcode = NOTIF_SUBCODE_MSG_BAD_TYPE; break;
-    }
-
-    PROTO_TRY(
-        new_msg_notification(s->session_buff, MAX_MSG_SIZE,
-            NOTIF_CODE_ERROR_MSG, subcode, 0, NULL),
-        goto proto_error
-    );
+    fprintf(stderr, "[ERROR session] peer %d:%d: %s\n",
+        s->session_peer_itad, s->session_peer_id, runtime_error_strs[-r]);
+    session_notify_error(s, r);
 
 sock_error:
-    close(s->session_fd);
-    s->session_state = STATE_IDLE;
+    if (s->session_flood_slot >= 0)
+        flood_remove_neighbor(s->session_env->env_flood, s);
+    /* the peer's own adjacencies go with it, what it relayed for others
+     * stays until they withdraw it, a copy it announces again when back is
+     * applied even with the same sequence number */
+    if (s->session_state == STATE_ESTABLISHED && s->session_env &&
+        s->session_env->env_topology)
+    {
+        topology_withdraw(s->session_env->env_topology, s->session_peer_itad,
+            s->session_peer_id);
+        if (s->session_env->env_flood)
+            flood_forget(s->session_env->env_flood, s->session_peer_id,
+                ATTR_TYPE_ITADTOPOLOGY);
+    }
+    if (s->session_state == STATE_ESTABLISHED && s->session_env &&
+        s->session_env->env_rib)
+    {
+        rib_remove_peer(s->session_env->env_rib, s);
+    }
+    /* the descriptor is closed with the session, so a concurrent
+     * session_stop() never shuts down a reused one */
+    shutdown(s->session_fd, SHUT_RDWR);
+    session_change_state(s, STATE_IDLE);
+    __atomic_store_n(&s->session_closed, 1, __ATOMIC_RELEASE);
+    session_put(s);
     return NULL;
 }
 
@@ -153,10 +905,18 @@ connect_loop(void *arg)
             sizeof(struct sockaddr_in6));
 
         if (res < 0) {
-            fprintf(stderr, "[ERROR] %s:%s:%s: %s\n",
+            fprintf(stderr, "[ERROR] %s:%s:%d: %s\n",
                 __FILE__, __func__, __LINE__, strerror(errno));
             session_change_state(s, STATE_IDLE);
-            sleep(s->session_connect_retry);
+            for (time_t t = 0; t < s->session_connect_retry &&
+                !__atomic_load_n(&s->session_stopping, __ATOMIC_ACQUIRE); t++)
+            {
+                sleep(1);
+            }
+            if (__atomic_load_n(&s->session_stopping, __ATOMIC_ACQUIRE)) {
+                session_put(s);
+                return NULL;
+            }
             if (s->session_connect_retry < 3600)
                 s->session_connect_retry *= 2;
             continue;
@@ -166,44 +926,42 @@ connect_loop(void *arg)
     }
 
     s->session_connect_retry = 60;
+    /* like accepted ones, so receiving can time out for KEEPALIVEs */
+    fcntl(s->session_fd, F_SETFL, fcntl(s->session_fd, F_GETFL) | O_NONBLOCK);
     session_loop(arg);
 }
 
 
 session_t *
-session_new_initiate(uint32_t itad, uint32_t id, uint16_t hold,
-    capinfo_transmode_t transmode, const struct sockaddr_in6 *peer_addr,
-    uint32_t peer_itad)
+session_new_initiate(const session_env_t *env, uint32_t itad, uint32_t id,
+    uint16_t hold, capinfo_transmode_t transmode,
+    const struct sockaddr_in6 *peer_addr, uint32_t peer_itad)
 {
     /* allocate resources */
-    session_t *session = malloc(sizeof(session_t));
-    session->session_buff = malloc(MAX_MSG_SIZE);
-    session->session_state = STATE_IDLE;
-    session->session_transmode = transmode;
-    session->session_itad = itad;
-    session->session_id = id;
-    session->session_peer_itad = peer_itad;
-
-    memcpy(&session->session_peer_addr, peer_addr, sizeof(struct sockaddr_in6));
+    session_t *session = session_alloc();
+    if (!session)
+        return NULL;
+    session_init(session, env, itad, id, hold, transmode, peer_addr,
+        peer_itad);
     session->session_fd = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
 
     pthread_create(&session->session_thread, NULL, &connect_loop, session);
     pthread_detach(session->session_thread);
+
+    return session;
 }
 
 session_t *
-session_new_peer(uint32_t itad, uint32_t id, uint16_t hold,
-    capinfo_transmode_t transmode, const struct sockaddr_in6 *peer_addr, int fd)
+session_new_peer(const session_env_t *env, uint32_t itad, uint32_t id,
+    uint16_t hold, capinfo_transmode_t transmode,
+    const struct sockaddr_in6 *peer_addr, int fd, uint32_t peer_itad)
 {
     /* allocate resources */
-    session_t *session = malloc(sizeof(session_t));
-    session->session_buff = malloc(MAX_MSG_SIZE);
-    session->session_state = STATE_IDLE;
-    session->session_transmode = transmode;
-    session->session_itad = itad;
-    session->session_id = id;
-
-    memcpy(&session->session_peer_addr, peer_addr, sizeof(struct sockaddr_in6));
+    session_t *session = session_alloc();
+    if (!session)
+        return NULL;
+    session_init(session, env, itad, id, hold, transmode, peer_addr,
+        peer_itad);
     session->session_fd = fd;
 
     pthread_create(&session->session_thread, NULL, &session_loop, session);
@@ -212,10 +970,157 @@ session_new_peer(uint32_t itad, uint32_t id, uint16_t hold,
     return session;
 }
 
+session_state_t
+session_get_state(const session_t *session)
+{
+    return session->session_state;
+}
+
+int
+session_is_closed(const session_t *session)
+{
+    return __atomic_load_n(&session->session_closed, __ATOMIC_ACQUIRE);
+}
+
 void
-session_destroy(session_t *session)
+session_pool_stats(size_t *live, size_t *pooled)
+{
+    pthread_mutex_lock(&g_pool_lock);
+    *live = g_live;
+    *pooled = g_pool_size;
+    pthread_mutex_unlock(&g_pool_lock);
+}
+
+int
+session_send(session_t *session, const void *buff, size_t len)
+{
+    /* announced before waiting for the lock, bulk senders step aside */
+    __atomic_add_fetch(&session->session_urgent, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&session->session_send_lock);
+    int r = session_send_locked(session, buff, len);
+    __atomic_sub_fetch(&session->session_urgent, 1, __ATOMIC_ACQ_REL);
+    pthread_cond_broadcast(&session->session_send_cond);
+    pthread_mutex_unlock(&session->session_send_lock);
+    return r;
+}
+
+int
+session_send_bulk(session_t *session, const void *buff, size_t len)
 {
-    free(session->session_buff);
-    free(session);
+    size_t off = 0;
+
+    while (off < len) {
+        /* whole messages up to SESSION_BULK_CHUNK, at least one */
+        size_t chunk = 0;
+        while (off + chunk < len) {
+            uint16_t msg_len;
+            memcpy(&msg_len, buff + off + chunk, sizeof(msg_len));
+            size_t size = MSG_HDR_LEN + msg_len;
+            if (chunk && chunk + size > SESSION_BULK_CHUNK)
+                break;
+            chunk += size;
+        }
+
+        pthread_mutex_lock(&session->session_send_lock);
+        while (__atomic_load_n(&session->session_urgent, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&session->session_send_cond,
+                &session->session_send_lock);
+        int r = session_send_locked(session, buff + off, chunk);
+        pthread_mutex_unlock(&session->session_send_lock);
+        if (r < 0)
+            return r;
+        off += chunk;
+    }
+
+    return len;
 }
 
+uint64_t
+session_policy(session_t *session, int out)
+{
+    prefixlist_trie_t *trie = prefixlist_acquire(__atomic_load_n(
+        out ? &session->session_plist_out : &session->session_plist_in,
+        __ATOMIC_ACQUIRE));
+    routemap_prog_t *prog = routemap_acquire(__atomic_load_n(
+        out ? &session->session_rmap_out : &session->session_rmap_in,
+        __ATOMIC_ACQUIRE));
+
+    /* both version counters are global, 0 is nothing bound */
+    uint64_t policy = (uint64_t)(trie ? trie->trie_version : 0) << 32 |
+        (prog ? prog->prog_version : 0);
+
+    routemap_release(prog);
+    prefixlist_release(trie);
+    return policy;
+}
+
+int
+session_request_refresh(session_t *session)
+{
+    if (!session->session_refresh ||
+        session_get_state(session) != STATE_ESTABLISHED)
+    {
+        return -1;
+    }
+
+    uint8_t buff[MSG_HDR_LEN];
+    int r = new_msg_refresh(buff, sizeof(buff));
+    if (r < 0)
+        return r;
+    return session_send(session, buff, r) < 0 ? -1 : 0;
+}
+
+void
+session_stop(session_t *session)
+{
+    __atomic_store_n(&session->session_stopping, 1, __ATOMIC_RELEASE);
+    /* wakes the thread out of connect() or recv() */
+    shutdown(session->session_fd, SHUT_RDWR);
+    session_put(session);
+}
+
+int
+session_tryget(session_t *session)
+{
+    uint32_t refs = __atomic_load_n(&session->session_refs, __ATOMIC_RELAXED);
+    do {
+        if (refs == 0)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&session->session_refs, &refs,
+        refs + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    return 1;
+}
+
+void
+session_put(session_t *session)
+{
+    if (__atomic_sub_fetch(&session->session_refs, 1, __ATOMIC_ACQ_REL) == 0)
+        session_destroy(session);
+}
+
+void
+session_destroy(session_t *session)
+{
+    close(session->session_fd);
+    session->session_fd = -1;
+    compress_free(session->session_compress);
+    session->session_compress = NULL;
+
+    /* the session itself is never freed, a lock-free reader may still try
+     * to take a reference, only the buffers of surplus ones are */
+    pthread_mutex_lock(&g_pool_lock);
+    g_live--;
+    if (g_pool_size >= SESSION_POOL_MAX) {
+        pool_free(session->session_buff, session->session_buff_size);
+        session->session_buff = NULL;
+        arena_destroy(&session->session_arena);
+    } else if (session->session_buff_size > MAX_MSG_SIZE) {
+        /* a reused session starts over at MAX_MSG_SIZE */
+        pool_free(session->session_buff, session->session_buff_size);
+        session->session_buff = NULL;
+    }
+    session->session_pool_next = g_pool;
+    g_pool = session;
+    g_pool_size++;
+    pthread_mutex_unlock(&g_pool_lock);
+}
@@ -23,8 +23,28 @@
 
 #include <protocol/protocol.h>
 
+#include "arena.h"
+#include "compress.h"
+
 #include <netinet/in.h>
+#include <pthread.h>
+
 
+struct flood_s;
+struct topology_s;
+struct rib_s;
+struct locator_s;
+struct prefixlist_s;
+struct routemap_s;
+
+/* shared state sessions work against, owned by the manager */
+typedef struct {
+    struct flood_s     *env_flood;
+    struct topology_s  *env_topology;
+    struct rib_s       *env_rib;
+    struct locator_s   *env_locator;
+    int                 env_compress;   /* offer compression in OPEN */
+} session_env_t;
 
 typedef enum {
     STATE_IDLE,
@@ -35,14 +55,42 @@ typedef enum {
     STATE_ESTABLISHED
 } session_state_t;
 
-typedef struct {
+/* sessions closed for good go back to a pool and are handed out again,
+ * they are type-stable, never freed, so a reader that found one without a
+ * lock may always try to take a reference; beyond SESSION_POOL_MAX pooled
+ * ones keep only the session itself, not its buffer */
+#define SESSION_POOL_MAX    1024
+
+/* message size offered in OPEN, sessions use MAX_MSG_SIZE until both ends
+ * advertised one, then the smaller */
+#define SESSION_MSG_SIZE    MAX_MSG_SIZE_EXT
+
+/* UPDATEs from the RIB go out this many bytes, in whole messages, per hold
+ * of the send lock, a KEEPALIVE or NOTIFICATION waiting for it goes next;
+ * the socket keeps about as much unsent (TCP_NOTSENT_LOWAT), so one never
+ * waits behind much more than twice that */
+#define SESSION_BULK_CHUNK  16384
+
+typedef struct session_s {
+    struct session_s   *session_pool_next;
     pthread_t           session_thread;
+    pthread_mutex_t     session_send_lock;
+    pthread_cond_t      session_send_cond;  /* bulk waits out urgent ones */
+    uint32_t            session_urgent;     /* urgent sends waiting */
     void               *session_buff;
+    size_t              session_buff_size;
+    uint32_t            session_msg_size;   /* negotiated in OPEN */
+    compress_t         *session_compress;   /* both ends offered it */
+    int                 session_zsend, session_zrecv;   /* switched on */
+    int                 session_refresh;    /* peer answers ROUTE-REFRESH */
+    arena_t             session_arena;  /* session thread, per message */
+    const session_env_t *session_env;
     session_state_t     session_state;
     uint32_t            session_itad, session_id;
     uint16_t            session_hold;
 
     time_t              session_connect_retry;
+    time_t              session_keepalive;  /* next one due, monotonic */
 
     capinfo_transmode_t session_transmode;
 
@@ -50,23 +98,70 @@ typedef struct {
     int                 session_fd;
 
     uint32_t            session_peer_itad, session_peer_id;
+
+    int                 session_flood_slot; /* internal peers, or -1 */
+
+    uint32_t            session_refs;   /* owner, thread, readers; 0 pooled */
+    int                 session_stopping;
+    int                 session_closed; /* thread done, owner may reap */
+
+    /* import and export filters, may be rebound while running */
+    struct prefixlist_s *session_plist_in, *session_plist_out;
+    struct routemap_s  *session_rmap_in, *session_rmap_out;
+    /* session_policy() when the routes exchanged last went through them */
+    uint64_t            session_policy_in, session_policy_out;
 } session_t;
 
 
 /* sessions start with no data exchanged yet */
 
 /* initiate connection to peer */
-session_t *session_new_initiate(uint32_t itad, uint32_t id, uint16_t hold,
-    capinfo_transmode_t transmode, const struct sockaddr_in6 *peer_addr,
-    uint32_t peer_itad);
+session_t *session_new_initiate(const session_env_t *env, uint32_t itad,
+    uint32_t id, uint16_t hold, capinfo_transmode_t transmode,
+    const struct sockaddr_in6 *peer_addr, uint32_t peer_itad);
 
-/* connection request received from peer */
-session_t *session_new_peer(uint32_t itad, uint32_t id, uint16_t hold,
-    capinfo_transmode_t transmode, const struct sockaddr_in6 *peer_addr,
-    int fd);
+/* connection request received from peer, peer_itad 0 accepts any */
+session_t *session_new_peer(const session_env_t *env, uint32_t itad,
+    uint32_t id, uint16_t hold, capinfo_transmode_t transmode,
+    const struct sockaddr_in6 *peer_addr, int fd, uint32_t peer_itad);
 
 session_state_t session_get_state(const session_t *session);
 
+/* the connection ended and will not be retried */
+int session_is_closed(const session_t *session);
+
+/* take a reference unless the session is already gone, returns 1 if
+ * taken, the session may have been reused, check it is still the one
+ * that was looked up */
+int session_tryget(session_t *session);
+
+/* drop a reference, the last one pools the session */
+void session_put(session_t *session);
+
+/* sessions in use and kept in the pool */
+void session_pool_stats(size_t *live, size_t *pooled);
+
+/* send a whole serialized message, thread safe, ahead of bulk sends
+ * waiting for the socket */
+int session_send(session_t *session, const void *buff, size_t len);
+
+/* send whole serialized messages back to back, thread safe, a chunk at a
+ * time so urgent messages can go in between */
+int session_send_bulk(session_t *session, const void *buff, size_t len);
+
+/* versions of the import or export filters bound now, changes whenever
+ * one is rebound or redefined */
+uint64_t session_policy(session_t *session, int out);
+
+/* ask the peer to send its routes again, so they go through the import
+ * filters as they are now, -1 if it cannot */
+int session_request_refresh(session_t *session);
+
+/* ask the session thread to close the connection and exit, it frees the
+ * session once both it and the owner are done, the owner must not touch the
+ * session after this */
+void session_stop(session_t *session);
+
 void session_destroy(session_t *session);
 
 
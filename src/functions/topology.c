@@ -0,0 +1,495 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    topology.c: inter-ITAD graph with dynamic shortest paths
+
+*/
+
+#include "topology.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static topology_t *g_topology = NULL;
+
+
+/* min-heap of (dist, node) for the bounded Dijkstra runs */
+
+typedef struct {
+    uint32_t    dist, node;
+} heap_item_t;
+
+typedef struct {
+    heap_item_t *items;
+    size_t      size, capacity;
+} heap_t;
+
+static void
+heap_push(heap_t *h, uint32_t dist, uint32_t node)
+{
+    if (h->size + 1 > h->capacity) {
+        h->capacity = h->capacity ? h->capacity * 2 : 64;
+        h->items = realloc(h->items, h->capacity * sizeof(heap_item_t));
+    }
+
+    size_t i = h->size++;
+    while (i > 0 && h->items[(i - 1) / 2].dist > dist) {
+        h->items[i] = h->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->items[i].dist = dist;
+    h->items[i].node = node;
+}
+
+static heap_item_t
+heap_pop(heap_t *h)
+{
+    heap_item_t top = h->items[0], last = h->items[--h->size];
+
+    size_t i = 0;
+    while (2 * i + 1 < h->size) {
+        size_t c = 2 * i + 1;
+        if (c + 1 < h->size && h->items[c + 1].dist < h->items[c].dist)
+            c++;
+        if (h->items[c].dist >= last.dist)
+            break;
+        h->items[i] = h->items[c];
+        i = c;
+    }
+    if (h->size)
+        h->items[i] = last;
+
+    return top;
+}
+
+
+/* nodes */
+
+static inline size_t
+itad_hash(uint32_t itad)
+{
+    return ((uint64_t)itad * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+static uint32_t
+topo_node_find(const topology_t *topo, uint32_t itad)
+{
+    size_t mask = topo->node_index_capacity - 1;
+    for (size_t i = itad_hash(itad) & mask;; i = (i + 1) & mask) {
+        uint32_t n = topo->node_index[i];
+        if (n == 0)
+            return TOPO_INF;
+        if (topo->nodes[n - 1].node_itad == itad)
+            return n - 1;
+    }
+}
+
+static void
+topo_node_index_insert(topology_t *topo, uint32_t n)
+{
+    size_t mask = topo->node_index_capacity - 1;
+    size_t i = itad_hash(topo->nodes[n].node_itad) & mask;
+    while (topo->node_index[i])
+        i = (i + 1) & mask;
+    topo->node_index[i] = n + 1;
+}
+
+static uint32_t
+topo_node_get(topology_t *topo, uint32_t itad)
+{
+    uint32_t n = topo_node_find(topo, itad);
+    if (n != TOPO_INF)
+        return n;
+
+    if (topo->nodes_size + 1 > topo->nodes_capacity) {
+        topo->nodes_capacity *= 2;
+        topo->nodes = realloc(topo->nodes,
+            topo->nodes_capacity * sizeof(topo_node_t));
+    }
+
+    if ((topo->nodes_size + 1) * 2 > topo->node_index_capacity) {
+        free(topo->node_index);
+        topo->node_index_capacity *= 2;
+        topo->node_index = calloc(topo->node_index_capacity,
+            sizeof(uint32_t));
+        for (size_t i = 0; i < topo->nodes_size; i++)
+            topo_node_index_insert(topo, i);
+    }
+
+    n = topo->nodes_size++;
+    topo_node_t *node = &topo->nodes[n];
+    memset(node, 0, sizeof(topo_node_t));
+    node->node_itad = itad;
+    node->node_dist = TOPO_INF;
+    node->node_parent = TOPO_INF;
+    topo_node_index_insert(topo, n);
+
+    return n;
+}
+
+static topo_edge_t *
+topo_edge_get(topo_node_t *node, uint32_t to)
+{
+    for (size_t i = 0; i < node->node_edges_size; i++)
+        if (node->node_edges[i].edge_to == to)
+            return &node->node_edges[i];
+
+    if (node->node_edges_size + 1 > node->node_edges_capacity) {
+        node->node_edges_capacity = node->node_edges_capacity ?
+            node->node_edges_capacity * 2 : 4;
+        node->node_edges = realloc(node->node_edges,
+            node->node_edges_capacity * sizeof(topo_edge_t));
+    }
+
+    topo_edge_t *edge = &node->node_edges[node->node_edges_size++];
+    edge->edge_to = to;
+    edge->edge_count = 0;
+    return edge;
+}
+
+
+/* shortest paths */
+
+/* settle whatever is in the heap, only nodes that improve are expanded */
+static void
+topo_dijkstra(topology_t *topo, heap_t *heap)
+{
+    while (heap->size) {
+        heap_item_t it = heap_pop(heap);
+        topo_node_t *node = &topo->nodes[it.node];
+        if (it.dist > node->node_dist)
+            continue;
+
+        topo->stat_visited++;
+
+        for (size_t i = 0; i < node->node_edges_size; i++) {
+            const topo_edge_t *edge = &node->node_edges[i];
+            topo_node_t *to = &topo->nodes[edge->edge_to];
+            if (edge->edge_count == 0 || it.dist + 1 >= to->node_dist)
+                continue;
+            to->node_dist = it.dist + 1;
+            to->node_parent = it.node;
+            heap_push(heap, to->node_dist, edge->edge_to);
+        }
+    }
+
+    free(heap->items);
+    heap->items = NULL;
+    heap->capacity = 0;
+}
+
+static void
+topo_spf_full(topology_t *topo)
+{
+    for (size_t i = 0; i < topo->nodes_size; i++) {
+        topo->nodes[i].node_dist = TOPO_INF;
+        topo->nodes[i].node_parent = TOPO_INF;
+    }
+
+    if (topo->root == TOPO_INF)
+        return;
+
+    heap_t heap = { 0 };
+    topo->nodes[topo->root].node_dist = 0;
+    heap_push(&heap, 0, topo->root);
+    topo_dijkstra(topo, &heap);
+
+    topo->stat_full++;
+}
+
+/* adjacency u-v came up, only nodes it shortens are visited */
+static void
+topo_spf_insert(topology_t *topo, uint32_t u, uint32_t v)
+{
+    heap_t heap = { 0 };
+    topo_node_t *nu = &topo->nodes[u], *nv = &topo->nodes[v];
+
+    if (nu->node_dist != TOPO_INF && nu->node_dist + 1 < nv->node_dist) {
+        nv->node_dist = nu->node_dist + 1;
+        nv->node_parent = u;
+        heap_push(&heap, nv->node_dist, v);
+    } else if (nv->node_dist != TOPO_INF &&
+        nv->node_dist + 1 < nu->node_dist)
+    {
+        nu->node_dist = nv->node_dist + 1;
+        nu->node_parent = v;
+        heap_push(&heap, nu->node_dist, u);
+    }
+
+    topo->stat_incremental++;
+    topo_dijkstra(topo, &heap);
+}
+
+/* adjacency u-v went down, if it was a tree edge the subtree below it is
+ * invalidated and reattached from its unaffected neighbors */
+static void
+topo_spf_delete(topology_t *topo, uint32_t u, uint32_t v)
+{
+    uint32_t child;
+    if (topo->nodes[v].node_parent == u)
+        child = v;
+    else if (topo->nodes[u].node_parent == v)
+        child = u;
+    else
+        return; /* not on any shortest path */
+
+    topo->stat_incremental++;
+
+    uint32_t gen = ++topo->mark_gen;
+    uint32_t *affected = malloc(sizeof(uint32_t) * topo->nodes_size);
+    size_t affected_size = 0;
+
+    affected[affected_size++] = child;
+    topo->nodes[child].node_mark = gen;
+    for (size_t q = 0; q < affected_size; q++) {
+        const topo_node_t *node = &topo->nodes[affected[q]];
+        for (size_t i = 0; i < node->node_edges_size; i++) {
+            uint32_t w = node->node_edges[i].edge_to;
+            topo_node_t *nw = &topo->nodes[w];
+            if (nw->node_mark != gen && nw->node_parent == affected[q]) {
+                nw->node_mark = gen;
+                affected[affected_size++] = w;
+            }
+        }
+    }
+
+    for (size_t q = 0; q < affected_size; q++) {
+        topo->nodes[affected[q]].node_dist = TOPO_INF;
+        topo->nodes[affected[q]].node_parent = TOPO_INF;
+    }
+
+    heap_t heap = { 0 };
+    for (size_t q = 0; q < affected_size; q++) {
+        topo_node_t *node = &topo->nodes[affected[q]];
+        for (size_t i = 0; i < node->node_edges_size; i++) {
+            const topo_edge_t *edge = &node->node_edges[i];
+            const topo_node_t *nw = &topo->nodes[edge->edge_to];
+            if (edge->edge_count == 0 || nw->node_mark == gen ||
+                nw->node_dist == TOPO_INF)
+            {
+                continue;
+            }
+            if (nw->node_dist + 1 < node->node_dist) {
+                node->node_dist = nw->node_dist + 1;
+                node->node_parent = edge->edge_to;
+            }
+        }
+        if (node->node_dist != TOPO_INF)
+            heap_push(&heap, node->node_dist, affected[q]);
+    }
+
+    free(affected);
+    topo_dijkstra(topo, &heap);
+}
+
+static void
+topo_adjacency_add(topology_t *topo, uint32_t a, uint32_t b)
+{
+    uint32_t u = topo_node_get(topo, a), v = topo_node_get(topo, b);
+    topo_edge_get(&topo->nodes[v], u)->edge_count++;
+    if (topo_edge_get(&topo->nodes[u], v)->edge_count++ == 0)
+        topo_spf_insert(topo, u, v);
+}
+
+static void
+topo_adjacency_del(topology_t *topo, uint32_t a, uint32_t b)
+{
+    uint32_t u = topo_node_find(topo, a), v = topo_node_find(topo, b);
+    if (u == TOPO_INF || v == TOPO_INF)
+        return;
+
+    topo_edge_get(&topo->nodes[v], u)->edge_count--;
+    if (--topo_edge_get(&topo->nodes[u], v)->edge_count == 0)
+        topo_spf_delete(topo, u, v);
+}
+
+static int
+itad_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static topo_orig_t *
+topo_orig_get(topology_t *topo, uint32_t itad, uint32_t id)
+{
+    for (size_t i = 0; i < topo->origs_size; i++)
+        if (topo->origs[i].orig_itad == itad && topo->origs[i].orig_id == id)
+            return &topo->origs[i];
+
+    if (topo->origs_size + 1 > topo->origs_capacity) {
+        topo->origs_capacity *= 2;
+        topo->origs = realloc(topo->origs,
+            topo->origs_capacity * sizeof(topo_orig_t));
+    }
+
+    topo_orig_t *orig = &topo->origs[topo->origs_size++];
+    orig->orig_itad = itad;
+    orig->orig_id = id;
+    orig->orig_itads = NULL;
+    orig->orig_itads_size = 0;
+    return orig;
+}
+
+
+/* public */
+
+topology_t *
+topology_new()
+{
+    if (g_topology != NULL)
+        return NULL;
+
+    g_topology = calloc(1, sizeof(topology_t));
+    pthread_rwlock_init(&g_topology->lock, NULL);
+
+    g_topology->root = TOPO_INF;
+
+    g_topology->nodes_capacity = 64;
+    g_topology->nodes = malloc(g_topology->nodes_capacity *
+        sizeof(topo_node_t));
+    g_topology->node_index_capacity = 128;
+    g_topology->node_index = calloc(g_topology->node_index_capacity,
+        sizeof(uint32_t));
+
+    g_topology->origs_capacity = 16;
+    g_topology->origs = malloc(g_topology->origs_capacity *
+        sizeof(topo_orig_t));
+
+    return g_topology;
+}
+
+void
+topology_set_root(topology_t *topo, uint32_t itad)
+{
+    pthread_rwlock_wrlock(&topo->lock);
+    topo->root = topo_node_get(topo, itad);
+    topo_spf_full(topo);
+    pthread_rwlock_unlock(&topo->lock);
+}
+
+void
+topology_update(topology_t *topo, uint32_t itad, uint32_t id,
+    const uint32_t *itads, size_t itads_size)
+{
+    uint32_t *sorted = malloc(sizeof(uint32_t) * (itads_size + 1));
+    memcpy(sorted, itads, sizeof(uint32_t) * itads_size);
+    qsort(sorted, itads_size, sizeof(uint32_t), &itad_cmp);
+
+    pthread_rwlock_wrlock(&topo->lock);
+
+    topo_orig_t *orig = topo_orig_get(topo, itad, id);
+
+    /* merge old and new sorted sets, touching only what changed */
+    size_t i = 0, j = 0, n = 0;
+    while (i < orig->orig_itads_size || j < itads_size) {
+        if (j < itads_size && n && sorted[j] == sorted[n - 1]) {
+            j++; /* duplicate in announcement */
+        } else if (j == itads_size || (i < orig->orig_itads_size &&
+            orig->orig_itads[i] < sorted[j]))
+        {
+            if (orig->orig_itads[i] != itad)
+                topo_adjacency_del(topo, itad, orig->orig_itads[i]);
+            i++;
+        } else if (i == orig->orig_itads_size ||
+            sorted[j] < orig->orig_itads[i])
+        {
+            if (sorted[j] != itad)
+                topo_adjacency_add(topo, itad, sorted[j]);
+            sorted[n++] = sorted[j++];
+        } else {
+            sorted[n++] = sorted[j++];
+            i++;
+        }
+    }
+
+    free(orig->orig_itads);
+    orig->orig_itads = sorted;
+    orig->orig_itads_size = n;
+
+    pthread_rwlock_unlock(&topo->lock);
+}
+
+void
+topology_withdraw(topology_t *topo, uint32_t itad, uint32_t id)
+{
+    topology_update(topo, itad, id, NULL, 0);
+}
+
+uint32_t
+topology_distance(topology_t *topo, uint32_t itad)
+{
+    pthread_rwlock_rdlock(&topo->lock);
+    uint32_t n = topo_node_find(topo, itad);
+    uint32_t dist = n == TOPO_INF ? TOPO_INF : topo->nodes[n].node_dist;
+    pthread_rwlock_unlock(&topo->lock);
+    return dist;
+}
+
+void
+topology_print(topology_t *topo, FILE *outf)
+{
+    pthread_rwlock_rdlock(&topo->lock);
+
+    fprintf(outf, "topology: %zu ITADs, %zu originators\n",
+        topo->nodes_size, topo->origs_size);
+    fprintf(outf, "  spf full %llu, incremental %llu, nodes visited %llu\n",
+        (unsigned long long)topo->stat_full,
+        (unsigned long long)topo->stat_incremental,
+        (unsigned long long)topo->stat_visited);
+
+    for (size_t i = 0; i < topo->nodes_size; i++) {
+        const topo_node_t *node = &topo->nodes[i];
+        if (node->node_dist == TOPO_INF)
+            fprintf(outf, "  %10u unreachable      ", node->node_itad);
+        else if (node->node_parent == TOPO_INF)
+            fprintf(outf, "  %10u dist %3u          ", node->node_itad,
+                node->node_dist);
+        else
+            fprintf(outf, "  %10u dist %3u via %10u", node->node_itad,
+                node->node_dist, topo->nodes[node->node_parent].node_itad);
+
+        fprintf(outf, " adj");
+        for (size_t j = 0; j < node->node_edges_size; j++)
+            if (node->node_edges[j].edge_count)
+                fprintf(outf, " %u",
+                    topo->nodes[node->node_edges[j].edge_to].node_itad);
+        fprintf(outf, "\n");
+    }
+
+    pthread_rwlock_unlock(&topo->lock);
+}
+
+void
+topology_destroy(topology_t *topo)
+{
+    if (topo != g_topology)
+        return;
+
+    for (size_t i = 0; i < topo->nodes_size; i++)
+        free(topo->nodes[i].node_edges);
+    for (size_t i = 0; i < topo->origs_size; i++)
+        free(topo->origs[i].orig_itads);
+
+    free(topo->nodes);
+    free(topo->node_index);
+    free(topo->origs);
+    pthread_rwlock_destroy(&topo->lock);
+    free(topo);
+    g_topology = NULL;
+}
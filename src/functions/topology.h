@@ -0,0 +1,101 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+
+/* inter-ITAD adjacency graph built from ITADTopology attributes
+ * an adjacency exists while at least one originator announces it, shortest
+ * paths (hops) from the local ITAD are kept up to date incrementally, only
+ * the nodes whose distance can change are visited on a single adjacency
+ * change, a full recomputation is only done when the root changes
+ */
+
+#define TOPO_INF    UINT32_MAX
+
+typedef struct {
+    uint32_t    edge_to;        /* node index */
+    uint32_t    edge_count;     /* originators announcing it, 0 = down */
+} topo_edge_t;
+
+typedef struct {
+    uint32_t    node_itad;
+    uint32_t    node_dist;      /* hops from root, TOPO_INF unreachable */
+    uint32_t    node_parent;    /* node index, TOPO_INF for none */
+    uint32_t    node_mark;      /* scratch generation */
+    topo_edge_t *node_edges;
+    uint32_t    node_edges_size, node_edges_capacity;
+} topo_node_t;
+
+/* adjacency set last announced by an originator */
+typedef struct {
+    uint32_t    orig_itad, orig_id;
+    uint32_t   *orig_itads;     /* sorted */
+    size_t      orig_itads_size;
+} topo_orig_t;
+
+typedef struct topology_s {
+    pthread_rwlock_t    lock;
+
+    uint32_t            root;           /* node index */
+
+    topo_node_t        *nodes;
+    size_t              nodes_size, nodes_capacity;
+    uint32_t           *node_index;     /* open addressing itad -> node+1 */
+    size_t              node_index_capacity;
+
+    topo_orig_t        *origs;
+    size_t              origs_size, origs_capacity;
+
+    uint32_t            mark_gen;
+
+    /* counters */
+    uint64_t            stat_full, stat_incremental, stat_visited;
+} topology_t;
+
+
+/* initialize singleton topology */
+topology_t *topology_new();
+
+/* set local ITAD, recomputes from scratch */
+void topology_set_root(topology_t *topo, uint32_t itad);
+
+/* replace the adjacencies announced by originator (itad, id) with itads */
+void topology_update(topology_t *topo, uint32_t itad, uint32_t id,
+    const uint32_t *itads, size_t itads_size);
+
+/* originator gone, withdraw its adjacencies */
+void topology_withdraw(topology_t *topo, uint32_t itad, uint32_t id);
+
+/* hops from the local ITAD, TOPO_INF if unreachable or unknown */
+uint32_t topology_distance(topology_t *topo, uint32_t itad);
+
+void topology_print(topology_t *topo, FILE *outf);
+
+void topology_destroy(topology_t *topo);
+
+
+#endif /* _TOPOLOGY_H */
@@ -0,0 +1,320 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    trace.c: per-thread binary event rings, lock-free on the write side
+
+*/
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define RING_MASK   (TRACE_RING_SIZE - 1)
+
+
+/* objects */
+
+const char *trace_type_strs[] = {
+    "none",
+    "msg_recv",
+    "msg_framed",
+    "parse_done",
+    "rib_insert",
+    "decision_run",
+    "msg_queued",
+    "msg_sent"
+};
+
+static trace_ring_t *g_rings = NULL;       /* all rings ever created */
+static uint32_t g_ring_count = 0;
+static uint64_t g_tsc_hz = 0;
+static __thread trace_ring_t *t_ring = NULL;
+
+
+/* utils */
+
+static inline uint64_t
+trace_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t
+monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static trace_ring_t *
+trace_ring_get()
+{
+    if (t_ring)
+        return t_ring;
+
+    trace_ring_t *ring = calloc(1, sizeof(trace_ring_t));
+    if (!ring)
+        return NULL;
+
+    ring->ring_tid = __atomic_add_fetch(&g_ring_count, 1, __ATOMIC_RELAXED);
+
+    /* rings outlive their threads, a stall post mortem needs them */
+    ring->ring_next = __atomic_load_n(&g_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_rings, &ring->ring_next, ring,
+        0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+
+    t_ring = ring;
+    return ring;
+}
+
+/* copies the valid window of a ring that may be written concurrently,
+ * returns number of events copied into out (oldest first) */
+static size_t
+trace_ring_snapshot(const trace_ring_t *ring, trace_event_t *out)
+{
+    uint64_t head = __atomic_load_n(&ring->ring_head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    for (uint64_t i = start; i < head; i++)
+        out[i - start] = ring->ring_events[i & RING_MASK];
+
+    /* drop whatever the writer lapped while we were copying, and the
+     * oldest event left if the ring is full, its slot is the one event
+     * head2 is being written into, the copies are done before the load */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t head2 = __atomic_load_n(&ring->ring_head, __ATOMIC_RELAXED);
+    uint64_t valid = head2 + 1 > TRACE_RING_SIZE ?
+        head2 + 1 - TRACE_RING_SIZE : 0;
+    if (valid > start) {
+        size_t skip = valid - start >= head - start ? head - start :
+            valid - start;
+        memmove(out, out + skip, (head - start - skip) * sizeof(trace_event_t));
+        return head - start - skip;
+    }
+
+    return head - start;
+}
+
+
+/* public */
+
+void
+trace_init()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec ts = { 0, 10000000 }; /* 10 ms */
+    uint64_t ns0 = monotonic_ns(), tsc0 = trace_tsc();
+    nanosleep(&ts, NULL);
+    uint64_t ns1 = monotonic_ns(), tsc1 = trace_tsc();
+    g_tsc_hz = (tsc1 - tsc0) * 1000000000ULL / (ns1 - ns0);
+#else
+    g_tsc_hz = 1000000000ULL;
+#endif
+}
+
+void
+trace_thread_name(const char *name)
+{
+#ifndef TRACE_ENABLED
+    return;
+#endif
+    trace_ring_t *ring = trace_ring_get();
+    if (!ring)
+        return;
+    strncpy(ring->ring_name, name, TRACE_NAME_LEN - 1);
+}
+
+void
+trace_event(uint16_t type, uint32_t a0, uint64_t a1)
+{
+    trace_ring_t *ring = trace_ring_get();
+    if (!ring)
+        return;
+
+    /* a reader that copied any of this event then sees head published */
+    uint64_t head = ring->ring_head;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    trace_event_t *ev = &ring->ring_events[head & RING_MASK];
+    ev->ev_tsc = trace_tsc();
+    ev->ev_type = type;
+    ev->ev_a0 = a0;
+    ev->ev_a1 = a1;
+
+    __atomic_store_n(&ring->ring_head, head + 1, __ATOMIC_RELEASE);
+}
+
+void
+trace_print(FILE *outf, size_t last)
+{
+#ifndef TRACE_ENABLED
+    fprintf(outf, "trace not compiled in, rebuild with -DTRACE=ON\n");
+    return;
+#endif
+
+    trace_event_t *events = malloc(sizeof(trace_event_t) * TRACE_RING_SIZE);
+    if (!events)
+        return;
+
+    trace_ring_t *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE);
+    for (; ring; ring = ring->ring_next) {
+        size_t count = trace_ring_snapshot(ring, events);
+        size_t first = last && count > last ? count - last : 0;
+
+        fprintf(outf, "thread %u (%s): %zu events\n", ring->ring_tid,
+            ring->ring_name[0] ? ring->ring_name : "-", count);
+
+        for (size_t i = first; i < count; i++) {
+            const trace_event_t *ev = &events[i];
+            fprintf(outf, "  %20llu %-13s %10u %20llu\n",
+                (unsigned long long)ev->ev_tsc,
+                ev->ev_type <= TRACE_MSG_SENT ?
+                    trace_type_strs[ev->ev_type] : "?",
+                ev->ev_a0, (unsigned long long)ev->ev_a1);
+        }
+    }
+
+    free(events);
+}
+
+int
+trace_dump(FILE *f)
+{
+    trace_event_t *events = malloc(sizeof(trace_event_t) * TRACE_RING_SIZE);
+    if (!events)
+        return -1;
+
+    trace_dump_t hdr = { 0 };
+    hdr.dump_magic = TRACE_DUMP_MAGIC;
+    hdr.dump_tsc_hz = g_tsc_hz;
+
+    trace_ring_t *rings = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE);
+    for (trace_ring_t *ring = rings; ring; ring = ring->ring_next)
+        hdr.dump_rings++;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+        goto error;
+
+    for (trace_ring_t *ring = rings; ring; ring = ring->ring_next) {
+        trace_dump_ring_t rhdr = { 0 };
+        rhdr.ring_tid = ring->ring_tid;
+        rhdr.ring_count = trace_ring_snapshot(ring, events);
+        memcpy(rhdr.ring_name, ring->ring_name, TRACE_NAME_LEN);
+
+        if (fwrite(&rhdr, sizeof(rhdr), 1, f) != 1 ||
+            fwrite(events, sizeof(trace_event_t), rhdr.ring_count, f) !=
+                rhdr.ring_count)
+        {
+            goto error;
+        }
+    }
+
+    free(events);
+    return 0;
+
+error:
+    free(events);
+    return -1;
+}
+
+int
+trace_decode_json(FILE *in, FILE *out)
+{
+    trace_dump_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        hdr.dump_magic != TRACE_DUMP_MAGIC)
+    {
+        return -1;
+    }
+
+    double tsc_per_us = hdr.dump_tsc_hz ? hdr.dump_tsc_hz / 1e6 : 1.0;
+    uint64_t base = UINT64_MAX;
+    int first = 1;
+
+    trace_event_t *events = malloc(sizeof(trace_event_t) * TRACE_RING_SIZE);
+    if (!events)
+        return -1;
+
+    /* timestamps are made relative to the earliest event, which requires
+     * finding it first */
+    long rings_pos = ftell(in);
+    for (uint32_t r = 0; r < hdr.dump_rings; r++) {
+        trace_dump_ring_t rhdr;
+        if (fread(&rhdr, sizeof(rhdr), 1, in) != 1 ||
+            rhdr.ring_count > TRACE_RING_SIZE ||
+            fread(events, sizeof(trace_event_t), rhdr.ring_count, in) !=
+                rhdr.ring_count)
+        {
+            goto error;
+        }
+        if (rhdr.ring_count && events[0].ev_tsc < base)
+            base = events[0].ev_tsc;
+    }
+    fseek(in, rings_pos, SEEK_SET);
+
+    fprintf(out, "{\"traceEvents\":[");
+
+    for (uint32_t r = 0; r < hdr.dump_rings; r++) {
+        trace_dump_ring_t rhdr;
+        if (fread(&rhdr, sizeof(rhdr), 1, in) != 1 ||
+            fread(events, sizeof(trace_event_t), rhdr.ring_count, in) !=
+                rhdr.ring_count)
+        {
+            goto error;
+        }
+
+        rhdr.ring_name[TRACE_NAME_LEN - 1] = '\0';
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first ? "" : ",",
+            rhdr.ring_tid, rhdr.ring_name[0] ? rhdr.ring_name : "thread");
+        first = 0;
+
+        for (uint32_t i = 0; i < rhdr.ring_count; i++) {
+            const trace_event_t *ev = &events[i];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+                "\"ts\":%.3f,\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"a0\":%u,\"a1\":%llu}}",
+                ev->ev_type <= TRACE_MSG_SENT ?
+                    trace_type_strs[ev->ev_type] : "unknown",
+                (ev->ev_tsc - base) / tsc_per_us, rhdr.ring_tid,
+                ev->ev_a0, (unsigned long long)ev->ev_a1);
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+
+    free(events);
+    return 0;
+
+error:
+    free(events);
+    return -1;
+}
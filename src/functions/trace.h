@@ -0,0 +1,114 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/* hot-path binary trace
+ * compiled in with -DTRACE=ON (cmake), fixed-size events are written into a
+ * per-thread ring that overwrites the oldest entry when full
+ */
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE     4096    /* events per thread, power of 2 */
+#endif
+
+#define TRACE_NAME_LEN      16
+
+enum trace_type {
+    TRACE_MSG_RECV = 1,     /* bytes received,  a0: msg type, a1: bytes */
+    TRACE_MSG_FRAMED,       /* message framed,  a0: msg type, a1: msg len */
+    TRACE_PARSE_DONE,       /* message parsed,  a0: msg type, a1: result */
+    TRACE_RIB_INSERT,       /* route inserted,  a0: af,       a1: routes */
+    TRACE_DECISION_RUN,     /* decision ran,    a0: changed,  a1: routes */
+    TRACE_MSG_QUEUED,       /* message queued,  a0: msg type, a1: msg len,
+                             * a route to an UPDATE its route len */
+    TRACE_MSG_SENT          /* message sent,    a0: msg type, a1: bytes */
+};
+
+typedef struct {
+    uint64_t    ev_tsc;
+    uint16_t    ev_type;
+    uint16_t    ev_reserved;
+    uint32_t    ev_a0;
+    uint64_t    ev_a1;
+} trace_event_t;
+
+typedef struct trace_ring_s {
+    struct trace_ring_s *ring_next;
+    uint32_t            ring_tid;
+    char                ring_name[TRACE_NAME_LEN];
+    uint64_t            ring_head;  /* total events written */
+    trace_event_t       ring_events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+
+/* dump file layout: header, then for each ring a trace_dump_ring_t followed
+ * by ring_count events, oldest first */
+
+#define TRACE_DUMP_MAGIC    0x3143525450495254ULL /* "TRIPTRC1" */
+
+typedef struct {
+    uint64_t    dump_magic;
+    uint64_t    dump_tsc_hz;
+    uint32_t    dump_rings;
+    uint32_t    dump_reserved;
+} trace_dump_t;
+
+typedef struct {
+    uint32_t    ring_tid;
+    uint32_t    ring_count;
+    char        ring_name[TRACE_NAME_LEN];
+} trace_dump_ring_t;
+
+
+extern const char *trace_type_strs[];
+
+#ifdef TRACE_ENABLED
+#define TRACE(type, a0, a1) trace_event(type, a0, a1)
+#else
+/* arguments are not evaluated, only kept from being unused */
+#define TRACE(type, a0, a1) ((void)sizeof(a0), (void)sizeof(a1))
+#endif
+
+/* calibrate timestamp counter */
+void trace_init();
+
+/* name the calling thread's ring */
+void trace_thread_name(const char *name);
+
+/* record event in the calling thread's ring */
+void trace_event(uint16_t type, uint32_t a0, uint64_t a1);
+
+/* print the rings decoded in human readable form */
+void trace_print(FILE *outf, size_t last);
+
+/* write a binary snapshot of all rings */
+int trace_dump(FILE *f);
+
+/* decode a binary snapshot into Chrome trace-event JSON */
+int trace_decode_json(FILE *in, FILE *out);
+
+
+#endif /* _TRACE_H */
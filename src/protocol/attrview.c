@@ -0,0 +1,357 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    attrview.c: lazy UPDATE attribute decoding, thread safe, no alloc
+
+*/
+
+#include "attrview.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* utils */
+
+#define VIEW_IS_CACHED(v, t)    (((v)->view_decoded >> (t)) & 1)
+
+static int
+view_cache(attr_view_t *view, uint8_t type, int result)
+{
+    view->view_decoded |= 1u << type;
+    view->view_result[type] = result;
+    return result;
+}
+
+static void *
+view_alloc(attr_view_t *view, size_t size)
+{
+    return view->view_alloc_fn ?
+        view->view_alloc_fn(view->view_alloc_arg, size) : NULL;
+}
+
+static const void *
+view_val(const attr_view_t *view, uint8_t type, size_t *len)
+{
+    *len = view->view_index->attr_val_len[type];
+    return view->view_body + view->view_index->attr_val_off[type];
+}
+
+static int
+community_cmp(const void *a, const void *b)
+{
+    const community_t *ca = a, *cb = b;
+    if (ca->community_itad != cb->community_itad)
+        return ca->community_itad < cb->community_itad ? -1 : 1;
+    if (ca->community_id != cb->community_id)
+        return ca->community_id < cb->community_id ? -1 : 1;
+    return 0;
+}
+
+/* flatten the segments of a validated path attribute */
+static int
+view_decode_itadpath(attr_view_t *view, uint8_t type,
+    const uint32_t **itads_out, uint32_t *pathlen_out)
+{
+    size_t len;
+    const void *val = view_val(view, type, &len);
+
+    /* segment bounds were checked by parse_msg_update() */
+    size_t count = 0;
+    for (size_t off = 0; off < len;) {
+        const itadpath_t *seg = val + off;
+        count += seg->itadpath_len;
+        off += sizeof(itadpath_t) + (sizeof(uint32_t) * seg->itadpath_len);
+    }
+
+    uint32_t *itads = view_alloc(view, sizeof(uint32_t) * count);
+    if (!itads)
+        return ERROR_BUFFLEN;
+
+    uint32_t pathlen = 0;
+    size_t i = 0;
+    for (size_t off = 0; off < len;) {
+        const itadpath_t *seg = val + off;
+        for (size_t j = 0; j < seg->itadpath_len; j++) {
+            if (seg->itadpath_segs[j] == 0)
+                return ERROR_ITAD;
+            itads[i++] = seg->itadpath_segs[j];
+        }
+        pathlen += seg->itadpath_type == ITADPATH_TYPE_AP_SET ?
+            (seg->itadpath_len ? 1 : 0) : seg->itadpath_len;
+        off += sizeof(itadpath_t) + (sizeof(uint32_t) * seg->itadpath_len);
+    }
+
+    *itads_out = itads;
+    *pathlen_out = pathlen;
+    return count;
+}
+
+
+/* public */
+
+void
+attr_view_init(attr_view_t *view, const void *body,
+    const update_index_t *index, attr_view_alloc_t alloc, void *alloc_arg)
+{
+    view->view_body = body;
+    view->view_index = index;
+    view->view_decoded = 0;
+    view->view_alloc_fn = alloc;
+    view->view_alloc_arg = alloc_arg;
+}
+
+int
+attr_view_raw(const attr_view_t *view, uint8_t type,
+    const msg_update_attr_t **attr_out)
+{
+    if (type > ATTR_TYPE_MAX || !UPDATE_INDEX_HAS(view->view_index, type))
+        return 0;
+
+    *attr_out = view->view_body + view->view_index->attr_off[type];
+    return 1;
+}
+
+size_t
+attr_view_passthru_size(const attr_view_t *view)
+{
+    return view->view_index->passthru_size;
+}
+
+const msg_update_attr_t *
+attr_view_passthru(const attr_view_t *view, size_t i)
+{
+    if (i >= view->view_index->passthru_size)
+        return NULL;
+    return view->view_body + view->view_index->passthru_off[i];
+}
+
+const route_t *
+attr_view_reachable(const attr_view_t *view, size_t i)
+{
+    const update_index_t *index = view->view_index;
+    if (i >= index->reach_size)
+        return NULL;
+    return view->view_body + index->route_off[index->reach_first + i];
+}
+
+const route_t *
+attr_view_withdrawn(const attr_view_t *view, size_t i)
+{
+    const update_index_t *index = view->view_index;
+    if (i >= index->withdrawn_size)
+        return NULL;
+    return view->view_body + index->route_off[index->withdrawn_first + i];
+}
+
+runtime_error_t
+attr_view_localpref(attr_view_t *view, attr_localpref_t *localpref_out)
+{
+    const uint8_t type = ATTR_TYPE_LOCALPREFERENCE;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        size_t len;
+        const attr_localpref_t *localpref = NULL;
+        const void *val = view_val(view, type, &len);
+        int r = parse_attr_localpref(val, len, &localpref);
+        if (r < 0)
+            return view_cache(view, type, r);
+
+        view->view_localpref = *localpref;
+        view_cache(view, type, 1);
+    }
+
+    if (view->view_result[type] > 0)
+        *localpref_out = view->view_localpref;
+    return view->view_result[type];
+}
+
+runtime_error_t
+attr_view_multiexitdisc(attr_view_t *view,
+    attr_multiexitdisc_t *multiexitdisc_out)
+{
+    const uint8_t type = ATTR_TYPE_MULTIEXITDISC;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        size_t len;
+        const attr_multiexitdisc_t *multiexitdisc = NULL;
+        const void *val = view_val(view, type, &len);
+        int r = parse_attr_multiexitdisc(val, len, &multiexitdisc);
+        if (r < 0)
+            return view_cache(view, type, r);
+
+        view->view_multiexitdisc = *multiexitdisc;
+        view_cache(view, type, 1);
+    }
+
+    if (view->view_result[type] > 0)
+        *multiexitdisc_out = view->view_multiexitdisc;
+    return view->view_result[type];
+}
+
+runtime_error_t
+attr_view_nexthopserver(attr_view_t *view,
+    const attr_nexthopserver_t **nexthopserver_out)
+{
+    const uint8_t type = ATTR_TYPE_NEXTHOPSERVER;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        size_t len;
+        const attr_nexthopserver_t *nexthop = view_val(view, type, &len);
+        if (nexthop->nexthopserver_itad == 0)
+            return view_cache(view, type, ERROR_ITAD);
+
+        view->view_nexthopserver = nexthop;
+        view_cache(view, type, 1);
+    }
+
+    if (view->view_result[type] > 0)
+        *nexthopserver_out = view->view_nexthopserver;
+    return view->view_result[type];
+}
+
+runtime_error_t
+attr_view_advertisementpath(attr_view_t *view, const uint32_t **itads_out)
+{
+    const uint8_t type = ATTR_TYPE_ADVERTISEMENTPATH;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        view_cache(view, type, view_decode_itadpath(view, type,
+            &view->view_advpath, &view->view_advpath_len));
+    }
+
+    if (view->view_result[type] > 0)
+        *itads_out = view->view_advpath;
+    return view->view_result[type];
+}
+
+runtime_error_t
+attr_view_advertisementpath_len(attr_view_t *view)
+{
+    const uint32_t *itads = NULL;
+    int r = attr_view_advertisementpath(view, &itads);
+    if (r <= 0)
+        return r;
+    return view->view_advpath_len;
+}
+
+runtime_error_t
+attr_view_routedpath(attr_view_t *view, const uint32_t **itads_out)
+{
+    const uint8_t type = ATTR_TYPE_ROUTEDPATH;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        view_cache(view, type, view_decode_itadpath(view, type,
+            &view->view_routedpath, &view->view_routedpath_len));
+    }
+
+    if (view->view_result[type] > 0)
+        *itads_out = view->view_routedpath;
+    return view->view_result[type];
+}
+
+runtime_error_t
+attr_view_communities(attr_view_t *view, const community_t **communities_out)
+{
+    const uint8_t type = ATTR_TYPE_COMMUNITIES;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        size_t len;
+        const void *val = view_val(view, type, &len);
+        size_t count = len / sizeof(community_t);
+
+        community_t *communities = view_alloc(view, len);
+        if (!communities)
+            return view_cache(view, type, ERROR_BUFFLEN);
+
+        for (size_t i = 0; i < count; i++) {
+            const community_t *community = NULL;
+            int r = parse_community(val + (i * sizeof(community_t)),
+                sizeof(community_t), &community);
+            if (r < 0)
+                return view_cache(view, type, r);
+            communities[i] = *community;
+        }
+
+        qsort(communities, count, sizeof(community_t), &community_cmp);
+
+        view->view_communities = communities;
+        view_cache(view, type, count);
+    }
+
+    if (view->view_result[type] > 0)
+        *communities_out = view->view_communities;
+    return view->view_result[type];
+}
+
+runtime_error_t
+attr_view_has_community(attr_view_t *view, community_t community)
+{
+    const community_t *communities = NULL;
+    int r = attr_view_communities(view, &communities);
+    if (r <= 0)
+        return r;
+
+    return bsearch(&community, communities, r, sizeof(community_t),
+        &community_cmp) != NULL;
+}
+
+runtime_error_t
+attr_view_itadtopology(attr_view_t *view, const uint32_t **itads_out)
+{
+    const uint8_t type = ATTR_TYPE_ITADTOPOLOGY;
+
+    if (!VIEW_IS_CACHED(view, type)) {
+        if (!UPDATE_INDEX_HAS(view->view_index, type))
+            return view_cache(view, type, 0);
+
+        size_t len;
+        const void *val = view_val(view, type, &len);
+        for (size_t off = 0; off < len; off += sizeof(uint32_t)) {
+            const uint32_t *itad = NULL;
+            int r = parse_itad(val + off, sizeof(uint32_t), &itad);
+            if (r < 0)
+                return view_cache(view, type, r);
+        }
+
+        view->view_itadtopology = val;
+        view_cache(view, type, len / sizeof(uint32_t));
+    }
+
+    if (view->view_result[type] > 0)
+        *itads_out = view->view_itadtopology;
+    return view->view_result[type];
+}
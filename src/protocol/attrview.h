@@ -0,0 +1,109 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ATTRVIEW_H
+#define _ATTRVIEW_H
+
+#include "protocol.h"
+
+
+/* lazily decoded view of a validated UPDATE
+ * attributes are decoded from the receive buffer on first access and the
+ * result (or error) is cached, attributes nobody asks for are never decoded
+ * decoded arrays that can not point into the wire are allocated through the
+ * caller's allocator, normally the worker's per-message arena, the view
+ * never frees them
+ */
+
+typedef void *(*attr_view_alloc_t)(void *arg, size_t size);
+
+typedef struct {
+    const void             *view_body;      /* UPDATE msg_val */
+    const update_index_t   *view_index;
+
+    uint32_t                view_decoded;   /* bitmask by attr_type */
+    int                     view_result[ATTR_TYPE_MAX + 1];
+
+    attr_view_alloc_t       view_alloc_fn;
+    void                   *view_alloc_arg;
+
+    /* decoded values */
+    attr_localpref_t        view_localpref;
+    attr_multiexitdisc_t    view_multiexitdisc;
+    const attr_nexthopserver_t *view_nexthopserver;
+    const uint32_t         *view_advpath;       /* flattened ITADs */
+    uint32_t                view_advpath_len;   /* path length, set is 1 */
+    const uint32_t         *view_routedpath;
+    uint32_t                view_routedpath_len;
+    const community_t      *view_communities;   /* sorted */
+    const uint32_t         *view_itadtopology;
+} attr_view_t;
+
+
+void attr_view_init(attr_view_t *view, const void *body,
+    const update_index_t *index, attr_view_alloc_t alloc, void *alloc_arg);
+
+/* raw wire attribute, never decoded, for forwarding
+ * returns 1 if present, 0 if absent */
+int attr_view_raw(const attr_view_t *view, uint8_t type,
+    const msg_update_attr_t **attr_out);
+
+/* uninterpreted transitive attributes, as received */
+size_t attr_view_passthru_size(const attr_view_t *view);
+const msg_update_attr_t *attr_view_passthru(const attr_view_t *view,
+    size_t i);
+
+/* routes are already validated by parse_msg_update() */
+const route_t *attr_view_reachable(const attr_view_t *view, size_t i);
+const route_t *attr_view_withdrawn(const attr_view_t *view, size_t i);
+
+/* single value accessors return 1 if present, 0 if absent
+ * list accessors return the element count, 0 if absent
+ * all return < 0 if the attribute fails to decode */
+
+runtime_error_t attr_view_localpref(attr_view_t *view,
+    attr_localpref_t *localpref_out);
+
+runtime_error_t attr_view_multiexitdisc(attr_view_t *view,
+    attr_multiexitdisc_t *multiexitdisc_out);
+
+runtime_error_t attr_view_nexthopserver(attr_view_t *view,
+    const attr_nexthopserver_t **nexthopserver_out);
+
+runtime_error_t attr_view_advertisementpath(attr_view_t *view,
+    const uint32_t **itads_out);
+
+runtime_error_t attr_view_advertisementpath_len(attr_view_t *view);
+
+runtime_error_t attr_view_routedpath(attr_view_t *view,
+    const uint32_t **itads_out);
+
+runtime_error_t attr_view_communities(attr_view_t *view,
+    const community_t **communities_out);
+
+/* 1 if the UPDATE carries community, binary search over the decoded list */
+runtime_error_t attr_view_has_community(attr_view_t *view,
+    community_t community);
+
+runtime_error_t attr_view_itadtopology(attr_view_t *view,
+    const uint32_t **itads_out);
+
+
+#endif /* _ATTRVIEW_H */
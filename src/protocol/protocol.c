@@ -28,28 +28,35 @@
 /* objects */
 
 const char *runtime_error_strs[] = {
-    "no error",
+    [0] = "no error",
     /* serialization and deserialization */
-    "invalid buffer",
-    "not enough buffer",
-    "hold time must be 0 or at least 3 s",
-    "ITAD must not be 0 (reserved)",
-    "invalid NOTIFICATION error code",
-    "invalid NOTIFICATION error subcode",
+    [-ERROR_BUFF] = "invalid buffer",
+    [-ERROR_BUFFLEN] = "not enough buffer",
+    [-ERROR_HOLD] = "hold time must be 0 or at least 3 s",
+    [-ERROR_ITAD] = "ITAD must not be 0 (reserved)",
+    [-ERROR_NOTIF_ERROR_CODE] = "invalid NOTIFICATION error code",
+    [-ERROR_NOTIF_ERROR_SUBCODE] = "invalid NOTIFICATION error subcode",
     /* deserialization specific */
-    "passed an incomplete message, recv more"
-    "invalid message type",
-    "unsupported protocol version",
-    "unsupported OPEN option param",
-    "unsupported capability info code",
-    "unsupported address family",
-    "unsupported application protocol",
-    "invalid send/recv capability",
-    "unsupported attribute type",
-    "attribute should have well-known",
-    "attribute must be link-state encapsulated",
-    "unsupported ITAD path type",
-    "reserved community ITAD with bad ID"
+    [-ERROR_INCOMPLETE] = "passed an incomplete message, recv more",
+    [-ERROR_MSGTYPE] = "invalid message type",
+    [-ERROR_VERSION] = "unsupported protocol version",
+    [-ERROR_OPT] = "unsupported OPEN option param",
+    [-ERROR_CAPINFO_CODE] = "unsupported capability info code",
+    [-ERROR_AF] = "unsupported address family",
+    [-ERROR_APP_PROTO] = "unsupported application protocol",
+    [-ERROR_TRANS] = "invalid send/recv capability",
+    [-ERROR_ATTR_TYPE] = "unsupported attribute type",
+    [-ERROR_ATTR_FLAG_WELL_KNOWN] = "attribute should have well-known",
+    [-ERROR_ATTR_FLAG_LSENCAP] = "attribute must be link-state encapsulated",
+    [-ERROR_ITADPATH_TYPE] = "unsupported ITAD path type",
+    [-ERROR_COMMUNITY_ITAD] = "reserved community ITAD with bad ID",
+    [-ERROR_ATTR_LEN] = "attribute length inconsistent",
+    [-ERROR_ATTR_DUP] = "attribute appears more than once",
+    [-ERROR_ATTR_MISSING] = "missing conditionally mandatory attribute",
+    [-ERROR_ROUTES] = "more routes than the index can hold",
+    [-ERROR_FSM] = "message unexpected in session state",
+    [-ERROR_MSGSIZE] = "message size capability out of range",
+    [-ERROR_COMPRESS] = "corrupt compressed stream"
 };
 
 const capinfo_routetype_t supported_routetypes[] = {
@@ -69,6 +76,25 @@ const capinfo_routetype_t supported_routetypes[] = {
 const size_t supported_routetypes_size = sizeof(supported_routetypes) /
     sizeof(capinfo_routetype_t);
 
+static const struct {
+    const char *name;
+    uint16_t    value;
+} af_names[] = {
+    { "decimal",        AF_DECIMAL },
+    { "pentadecimal",   AF_PENTADECIMAL },
+    { "e164",           AF_E164 },
+    { "trunk-group",    AF_TRUNKGROUP },
+    { "carrier",        AF_CARRIER },
+    { NULL,             0 }
+}, app_proto_names[] = {
+    { "sip",            APP_PROTO_SIP },
+    { "h323-q931",      APP_PROTO_H323_225_0_Q931 },
+    { "h323-ras",       APP_PROTO_H323_225_0_RAS },
+    { "h323-annexg",    APP_PROTO_H323_225_0_ANNEXG },
+    { "iax2",           APP_PROTO_IAX2 },
+    { NULL,             0 }
+};
+
 
 /* utils */
 
@@ -79,6 +105,18 @@ const size_t supported_routetypes_size = sizeof(supported_routetypes) /
     (x != APP_PROTO_IAX2))
 #define CHECK_ITADPATH_TYPE(x) ((x < ITADPATH_TYPE_AP_SET) || \
     (x > ITADPATH_TYPE_AP_SEQUENCE))
+#define CHECK_ATTR_TYPE(x) ((x < ATTR_TYPE_WITHDRAWNROUTES) || \
+    (x > ATTR_TYPE_MAX))
+#define CHECK_ATTR_INTERPRETED(x) ((x >= ATTR_TYPE_WITHDRAWNROUTES) && \
+    (x <= ATTR_TYPE_CONVERTEDROUTE))
+/* RFC3219 attributes other than Communities are well-known */
+#define CHECK_ATTR_WELL_KNOWN(t, f) ((t >= ATTR_TYPE_WITHDRAWNROUTES) && \
+    (t <= ATTR_TYPE_CONVERTEDROUTE) && (t != ATTR_TYPE_COMMUNITIES) && \
+    !IS_ATTR_FLAG_WELL_KNOWN(f))
+/* only routes and topology may be link-state encapsulated */
+#define CHECK_ATTR_LSENCAP(t, f) (IS_ATTR_FLAG_LSENCAP(f) ? \
+    ((t != ATTR_TYPE_WITHDRAWNROUTES) && (t != ATTR_TYPE_REACHABLEROUTES) && \
+    (t != ATTR_TYPE_ITADTOPOLOGY)) : (t == ATTR_TYPE_ITADTOPOLOGY))
 
 int
 check_notif_error_code_subcode(uint8_t code, uint8_t subcode)
@@ -125,13 +163,21 @@ runtime_error_t
 new_msg_open(void *buff, size_t len,
     uint16_t hold, uint32_t itad, uint32_t id,
     const capinfo_routetype_t *capinfo_routetypes, size_t routetypes_size,
-    capinfo_transmode_t capinfo_transmode)
+    capinfo_transmode_t capinfo_transmode, capinfo_msgsize_t capinfo_msgsize,
+    capinfo_compress_t capinfo_compress, int capinfo_refresh)
 {
     if (!buff)
         return ERROR_BUFF;
 
     size_t capinfo_routetypes_size = 0, capinfo_transmode_size = 0,
-        opt_size = 0;
+        capinfo_msgsize_size = 0, capinfo_compress_size = 0,
+        capinfo_refresh_size = 0, opt_size = 0;
+
+    if (capinfo_msgsize && (capinfo_msgsize < MAX_MSG_SIZE ||
+        capinfo_msgsize > MAX_MSG_SIZE_EXT))
+    {
+        return ERROR_MSGSIZE;
+    }
 
     if (capinfo_routetypes)
         capinfo_routetypes_size = sizeof(capinfo_t) +
@@ -139,10 +185,24 @@ new_msg_open(void *buff, size_t len,
     if (capinfo_transmode != CAPINFO_TRANS_NULL)
         capinfo_transmode_size += sizeof(capinfo_t) +
             sizeof(capinfo_transmode_t);
-    if (capinfo_routetypes || capinfo_transmode != CAPINFO_TRANS_NULL)
+    if (capinfo_msgsize)
+        capinfo_msgsize_size = sizeof(capinfo_t) + sizeof(capinfo_msgsize_t);
+    if (capinfo_compress != CAPINFO_COMPRESS_NONE)
+        capinfo_compress_size = sizeof(capinfo_t) +
+            sizeof(capinfo_compress_t);
+    if (capinfo_refresh)
+        capinfo_refresh_size = sizeof(capinfo_t);
+    if (capinfo_routetypes || capinfo_transmode != CAPINFO_TRANS_NULL ||
+        capinfo_msgsize || capinfo_compress != CAPINFO_COMPRESS_NONE ||
+        capinfo_refresh)
+    {
         opt_size = sizeof(msg_open_opt_t) + capinfo_routetypes_size +
-            capinfo_transmode_size;
-    size_t msg_size = sizeof(msg_t) + sizeof(msg_open_t) + opt_size;
+            capinfo_transmode_size + capinfo_msgsize_size +
+            capinfo_compress_size + capinfo_refresh_size;
+    }
+    /* sizeof(msg_open_t) counts the padding after open_opts_len */
+    size_t msg_size = MSG_HDR_LEN + offsetof(msg_open_t, open_opts) +
+        opt_size;
 
     if (len < msg_size)
         return ERROR_BUFFLEN;
@@ -154,11 +214,12 @@ new_msg_open(void *buff, size_t len,
         return ERROR_ITAD;
 
     /* MSG {
-     *   OPEN [{ OPT_CAPINFO { [CAPINFO_ROUTETYPE] | [CAPINFO_TRANS] } }]
+     *   OPEN [{ OPT_CAPINFO { [CAPINFO_ROUTETYPE] | [CAPINFO_TRANS] |
+     *       [CAPINFO_MSGSIZE] | [CAPINFO_COMPRESS] | [CAPINFO_REFRESH] } }]
      * }
      */
     msg_t *msg = buff;
-    msg->msg_len = msg_size - sizeof(msg_t);
+    msg->msg_len = msg_size - MSG_HDR_LEN;
     msg->msg_type = MSG_TYPE_OPEN;
 
     msg_open_t *msg_open = (msg_open_t*)msg->msg_val;
@@ -167,10 +228,10 @@ new_msg_open(void *buff, size_t len,
     msg_open->open_hold = hold;
     msg_open->open_itad = itad;
     msg_open->open_id = id;
-    msg_open->open_opts_len = msg_size - sizeof(msg_t) - sizeof(msg_open_t);
+    msg_open->open_opts_len = opt_size;
 
     void *end = msg_open->open_opts;
-    if (capinfo_routetypes || capinfo_transmode != CAPINFO_TRANS_NULL)  {
+    if (opt_size) {
         msg_open_opt_t *opt = end;
         opt->opt_type = OPEN_OPT_TYPE_CAPABILITY_INFO;
         opt->opt_len = opt_size - sizeof(msg_open_opt_t);
@@ -193,6 +254,31 @@ new_msg_open(void *buff, size_t len,
         end += capinfo_transmode_size;
     }
 
+    if (capinfo_msgsize) {
+        capinfo_t *capinfo = end;
+        capinfo->capinfo_code = CAPINFO_CODE_MSGSIZE;
+        capinfo->capinfo_len = sizeof(capinfo_msgsize_t);
+        memcpy(capinfo->capinfo_val, &capinfo_msgsize,
+            sizeof(capinfo_msgsize_t));
+        end += capinfo_msgsize_size;
+    }
+
+    if (capinfo_compress != CAPINFO_COMPRESS_NONE) {
+        capinfo_t *capinfo = end;
+        capinfo->capinfo_code = CAPINFO_CODE_COMPRESS;
+        capinfo->capinfo_len = sizeof(capinfo_compress_t);
+        memcpy(capinfo->capinfo_val, &capinfo_compress,
+            sizeof(capinfo_compress_t));
+        end += capinfo_compress_size;
+    }
+
+    if (capinfo_refresh) {
+        capinfo_t *capinfo = end;
+        capinfo->capinfo_code = CAPINFO_CODE_REFRESH;
+        capinfo->capinfo_len = 0;
+        end += capinfo_refresh_size;
+    }
+
     return msg_size;
 }
 
@@ -209,7 +295,7 @@ new_msg_update(void *buff, size_t len,
     if (!buff)
         return ERROR_BUFF;
 
-    if (len < sizeof(msg_t))
+    if (len < MSG_HDR_LEN)
         return ERROR_BUFFLEN;
 
     msg_t *msg = buff;
@@ -230,6 +316,8 @@ new_msg_update(void *buff, size_t len,
         end += attrsize;
     }
 
+    msg->msg_len = end - (void*)msg->msg_val;
+
     return end - buff;
 }
 
@@ -251,18 +339,19 @@ new_attr_withdrawnroutes(void *buff, size_t len,
         return ERROR_BUFFLEN;
 
     void *end = buff;
-
-    msg_update_attr_t *attr = end;
-    attr->attr_flags = ATTR_FLAG_WELL_KNOWN | ATTR_FLAG_LSENCAP;
-    attr->attr_type = ATTR_TYPE_WITHDRAWNROUTES;
-    attr->attr_len = attr_size - sizeof(msg_update_attr_t);
-
     if (lsencap) {
-        msg_update_attr_lsencap_t *attr_lsencap = end;
-        attr_lsencap->attr_id = id;
-        attr_lsencap->attr_seq = seq;
+        msg_update_attr_lsencap_t *attr = end;
+        attr->attr_flags = ATTR_FLAG_WELL_KNOWN | ATTR_FLAG_LSENCAP;
+        attr->attr_type = ATTR_TYPE_WITHDRAWNROUTES;
+        attr->attr_len = attr_size - sizeof(msg_update_attr_lsencap_t);
+        attr->attr_id = id;
+        attr->attr_seq = seq;
         end += sizeof(msg_update_attr_lsencap_t);
     } else {
+        msg_update_attr_t *attr = end;
+        attr->attr_flags = ATTR_FLAG_WELL_KNOWN;
+        attr->attr_type = ATTR_TYPE_WITHDRAWNROUTES;
+        attr->attr_len = attr_size - sizeof(msg_update_attr_t);
         end += sizeof(msg_update_attr_t);
     }
 
@@ -295,7 +384,7 @@ new_attr_reachableroutes(void *buff, size_t len,
     void *end = buff;
     if (lsencap) {
         msg_update_attr_lsencap_t *attr = end;
-        attr->attr_flags = ATTR_FLAG_WELL_KNOWN;
+        attr->attr_flags = ATTR_FLAG_WELL_KNOWN | ATTR_FLAG_LSENCAP;
         attr->attr_type = ATTR_TYPE_REACHABLEROUTES;
         attr->attr_len = attr_size - sizeof(msg_update_attr_lsencap_t);
         attr->attr_id = id;
@@ -303,7 +392,7 @@ new_attr_reachableroutes(void *buff, size_t len,
         end += sizeof(msg_update_attr_lsencap_t);
     } else {
         msg_update_attr_t *attr = end;
-        attr->attr_flags = ATTR_FLAG_WELL_KNOWN | ATTR_FLAG_LSENCAP;
+        attr->attr_flags = ATTR_FLAG_WELL_KNOWN;
         attr->attr_type = ATTR_TYPE_REACHABLEROUTES;
         attr->attr_len = attr_size - sizeof(msg_update_attr_t);
         end += sizeof(msg_update_attr_t);
@@ -497,7 +586,7 @@ new_attr_itadtopology(void *buff, size_t len,
     attr->attr_seq = seq;
     memcpy(attr->attr_val, itads, attr->attr_len);
 
-    return sizeof(msg_update_attr_t) + attr->attr_len;
+    return sizeof(msg_update_attr_lsencap_t) + attr->attr_len;
 }
 
 runtime_error_t
@@ -525,14 +614,33 @@ new_msg_keepalive(void *buff, size_t len)
     if (!buff)
         return ERROR_BUFF;
 
-    if (len < sizeof(msg_t))
+    if (len < MSG_HDR_LEN)
         return ERROR_BUFFLEN;
 
     msg_t *msg = buff;
     msg->msg_len = 0;
     msg->msg_type = MSG_TYPE_KEEPALIVE;
 
-    return sizeof(msg_t);
+    return MSG_HDR_LEN;
+}
+
+
+/* message ROUTE-REFRESH */
+
+runtime_error_t
+new_msg_refresh(void *buff, size_t len)
+{
+    if (!buff)
+        return ERROR_BUFF;
+
+    if (len < MSG_HDR_LEN)
+        return ERROR_BUFFLEN;
+
+    msg_t *msg = buff;
+    msg->msg_len = 0;
+    msg->msg_type = MSG_TYPE_REFRESH;
+
+    return MSG_HDR_LEN;
 }
 
 
@@ -545,7 +653,7 @@ new_msg_notification(void *buff, size_t len,
     if (!buff)
         return ERROR_BUFF;
 
-    size_t msg_size = sizeof(msg_t) + sizeof(msg_notif_t) + datalen;
+    size_t msg_size = MSG_HDR_LEN + sizeof(msg_notif_t) + datalen;
     if (len < msg_size)
         return ERROR_BUFFLEN;
 
@@ -580,17 +688,17 @@ new_msg_notification(void *buff, size_t len,
 runtime_error_t
 parse_msg(const void *buff, size_t len, const msg_t **msg_out)
 {
-    if (len < sizeof(msg_t))
+    if (len < MSG_HDR_LEN)
         return ERROR_INCOMPLETE;
 
     const msg_t *msg = buff;
 
-    if (msg->msg_type < MSG_TYPE_OPEN || msg->msg_type > MSG_TYPE_KEEPALIVE)
+    if (msg->msg_type < MSG_TYPE_OPEN || msg->msg_type > MSG_TYPE_REFRESH)
         return ERROR_MSGTYPE;
 
     *msg_out = msg;
 
-    return sizeof(msg_t);
+    return MSG_HDR_LEN;
 }
 
 
@@ -601,9 +709,9 @@ runtime_error_t
 parse_msg_open(const void *buff, size_t len,
     const msg_open_t **open_out)
 {
-    if (len < sizeof(msg_open_t))
+    if (len < offsetof(msg_open_t, open_opts))
         return ERROR_INCOMPLETE;
-    
+
     const msg_open_t *open = buff;
 
     if (open->open_ver != 1)
@@ -615,9 +723,12 @@ parse_msg_open(const void *buff, size_t len,
     if (open->open_itad == 0)
         return ERROR_ITAD;
 
+    if (open->open_opts_len > len - offsetof(msg_open_t, open_opts))
+        return ERROR_INCOMPLETE;
+
     *open_out = open;
 
-    return sizeof(msg_open_t);
+    return offsetof(msg_open_t, open_opts);
 }
 
 runtime_error_t
@@ -646,12 +757,16 @@ parse_capinfo_t(const void *buff, size_t len,
 
     const capinfo_t *capinfo = buff;
 
-    if (capinfo->capinfo_code < CAPINFO_CODE_ROUTETYPE ||
-        capinfo->capinfo_code > CAPINFO_CODE_TRANSMODE)
+    if ((capinfo->capinfo_code < CAPINFO_CODE_ROUTETYPE ||
+        capinfo->capinfo_code > CAPINFO_CODE_TRANSMODE) &&
+        capinfo->capinfo_code < CAPINFO_CODE_VENDOR)
     {
         return ERROR_CAPINFO_CODE;
     }
 
+    if (capinfo->capinfo_len > len - sizeof(capinfo_t))
+        return ERROR_INCOMPLETE;
+
     *capinfo_out = capinfo;
 
     return sizeof(capinfo_t);
@@ -701,6 +816,35 @@ parse_capinfo_transmode(const void *buff, size_t len,
     return sizeof(capinfo_transmode_t);
 }
 
+runtime_error_t
+parse_capinfo_msgsize(const void *buff, size_t len,
+    const capinfo_msgsize_t **msgsize_out)
+{
+    if (len < sizeof(capinfo_msgsize_t))
+        return ERROR_INCOMPLETE;
+
+    const capinfo_msgsize_t *msgsize = buff;
+
+    if (*msgsize < MAX_MSG_SIZE || *msgsize > MAX_MSG_SIZE_EXT)
+        return ERROR_MSGSIZE;
+
+    *msgsize_out = msgsize;
+
+    return sizeof(capinfo_msgsize_t);
+}
+
+runtime_error_t
+parse_capinfo_compress(const void *buff, size_t len,
+    const capinfo_compress_t **compress_out)
+{
+    if (len < sizeof(capinfo_compress_t))
+        return ERROR_INCOMPLETE;
+
+    *compress_out = buff;
+
+    return sizeof(capinfo_compress_t);
+}
+
 
 
 /* message UPDATE
@@ -719,19 +863,18 @@ parse_msg_update_attr(const void *buff, size_t len,
     
     const msg_update_attr_t *attr = buff;
 
-    if (attr->attr_type < ATTR_TYPE_WITHDRAWNROUTES ||
-        attr->attr_type < ATTR_TYPE_CARRIER)
+    /* unrecognized optional attributes are let through */
+    if (CHECK_ATTR_TYPE(attr->attr_type) &&
+        IS_ATTR_FLAG_WELL_KNOWN(attr->attr_flags))
     {
         return ERROR_ATTR_TYPE;
     }
 
-    if ((attr->attr_type < ATTR_TYPE_WITHDRAWNROUTES ||
-        attr->attr_type < ATTR_TYPE_CARRIER) &&
-        !IS_ATTR_FLAG_WELL_KNOWN(attr->attr_flags))
-    {
+    if (CHECK_ATTR_WELL_KNOWN(attr->attr_type, attr->attr_flags))
         return ERROR_ATTR_FLAG_WELL_KNOWN;
-    }
 
+    if (CHECK_ATTR_LSENCAP(attr->attr_type, attr->attr_flags))
+        return ERROR_ATTR_FLAG_LSENCAP;
 
     *attr_out = attr;
 
@@ -760,6 +903,195 @@ parse_msg_update_attr_lsencap(const void *buff, size_t len,
 }
 
 
+/* validate a list of routes, appending their offsets to the index */
+static runtime_error_t
+parse_update_routes(const void *buff, size_t len, size_t base,
+    update_index_t *index, size_t *routes)
+{
+    size_t off = 0;
+    while (off < len) {
+        const route_t *route = NULL;
+        int r = parse_route(buff + off, len - off, &route);
+        if (r == ERROR_INCOMPLETE)
+            return ERROR_ATTR_LEN;
+        if (r < 0)
+            return r;
+
+        if (route->route_len > len - off - sizeof(route_t))
+            return ERROR_ATTR_LEN;
+
+        if (*routes >= index->route_capacity)
+            return ERROR_ROUTES;
+
+        index->route_off[(*routes)++] = base + off;
+        off += sizeof(route_t) + route->route_len;
+    }
+
+    return len;
+}
+
+/* validate a list of ITAD path segments */
+static runtime_error_t
+parse_update_itadpath(const void *buff, size_t len)
+{
+    size_t off = 0;
+    while (off < len) {
+        const itadpath_t *itadpath = NULL;
+        int r = parse_itadpath(buff + off, len - off, &itadpath);
+        if (r == ERROR_INCOMPLETE)
+            return ERROR_ATTR_LEN;
+        if (r < 0)
+            return r;
+
+        size_t seg_size = sizeof(itadpath_t) +
+            (sizeof(uint32_t) * itadpath->itadpath_len);
+        if (seg_size > len - off)
+            return ERROR_ATTR_LEN;
+
+        off += seg_size;
+    }
+
+    return len;
+}
+
+/* index an uninterpreted attribute for pass-through if transitive */
+static runtime_error_t
+parse_update_passthru(const void *buff, size_t off,
+    const msg_update_attr_t *attr, update_index_t *index)
+{
+    if (!IS_ATTR_FLAG_TRANSITIVE(attr->attr_flags))
+        return 0;
+
+    for (size_t i = 0; i < index->passthru_size; i++) {
+        const msg_update_attr_t *prev = buff + index->passthru_off[i];
+        if (prev->attr_type == attr->attr_type)
+            return ERROR_ATTR_DUP;
+    }
+
+    index->passthru_off[index->passthru_size++] = off;
+    return 0;
+}
+
+/* single pass over the UPDATE body: every attribute header, every route and
+ * every path segment is bounds checked exactly once */
+runtime_error_t
+parse_msg_update(const void *buff, size_t len, update_index_t *index)
+{
+    if (!buff || !index)
+        return ERROR_BUFF;
+
+    index->attr_present = 0;
+    index->reach_first = index->reach_size = 0;
+    index->withdrawn_first = index->withdrawn_size = 0;
+    index->passthru_size = 0;
+
+    size_t routes = 0;
+    size_t off = 0;
+    while (off < len) {
+        const msg_update_attr_t *attr = NULL;
+        int r = parse_msg_update_attr(buff + off, len - off, &attr);
+        if (r == 0) {
+            const msg_update_attr_lsencap_t *attr_lsencap = NULL;
+            r = parse_msg_update_attr_lsencap(buff + off, len - off,
+                &attr_lsencap);
+        }
+        if (r == ERROR_INCOMPLETE)
+            return ERROR_ATTR_LEN;
+        if (r < 0)
+            return r;
+
+        size_t hdr_len = r;
+        if (attr->attr_len > len - off - hdr_len)
+            return ERROR_ATTR_LEN;
+
+        const void *val = buff + off + hdr_len;
+        size_t val_off = off + hdr_len, val_len = attr->attr_len;
+
+        if (!CHECK_ATTR_INTERPRETED(attr->attr_type)) {
+            r = parse_update_passthru(buff, off, attr, index);
+            if (r < 0)
+                return r;
+            off += hdr_len + val_len;
+            continue;
+        }
+
+        if (UPDATE_INDEX_HAS(index, attr->attr_type))
+            return ERROR_ATTR_DUP;
+
+        switch (attr->attr_type) {
+        case ATTR_TYPE_WITHDRAWNROUTES:
+            index->withdrawn_first = routes;
+            r = parse_update_routes(val, val_len, val_off, index, &routes);
+            index->withdrawn_size = routes - index->withdrawn_first;
+        break;
+        case ATTR_TYPE_REACHABLEROUTES:
+            index->reach_first = routes;
+            r = parse_update_routes(val, val_len, val_off, index, &routes);
+            index->reach_size = routes - index->reach_first;
+        break;
+        case ATTR_TYPE_NEXTHOPSERVER: {
+            const attr_nexthopserver_t *nexthop = val;
+            if (val_len < offsetof(attr_nexthopserver_t,
+                    nexthopserver_server) ||
+                nexthop->nexthopserver_serverlen > val_len -
+                    offsetof(attr_nexthopserver_t, nexthopserver_server))
+            {
+                r = ERROR_ATTR_LEN;
+            }
+        } break;
+        case ATTR_TYPE_ADVERTISEMENTPATH:
+        case ATTR_TYPE_ROUTEDPATH:
+            r = parse_update_itadpath(val, val_len);
+        break;
+        case ATTR_TYPE_ATOMICAGGREGATE:
+        case ATTR_TYPE_CONVERTEDROUTE:
+            if (val_len != 0)
+                r = ERROR_ATTR_LEN;
+        break;
+        case ATTR_TYPE_LOCALPREFERENCE:
+        case ATTR_TYPE_MULTIEXITDISC:
+            if (val_len != sizeof(uint32_t))
+                r = ERROR_ATTR_LEN;
+        break;
+        case ATTR_TYPE_COMMUNITIES:
+            if (val_len % sizeof(community_t))
+                r = ERROR_ATTR_LEN;
+        break;
+        case ATTR_TYPE_ITADTOPOLOGY:
+            if (val_len % sizeof(uint32_t))
+                r = ERROR_ATTR_LEN;
+        break;
+        }
+
+        if (r < 0)
+            return r;
+
+        index->attr_present |= 1u << attr->attr_type;
+        index->attr_off[attr->attr_type] = off;
+        index->attr_val_off[attr->attr_type] = val_off;
+        index->attr_val_len[attr->attr_type] = val_len;
+
+        off += hdr_len + val_len;
+    }
+
+    /* conditionally mandatory attributes */
+    if ((UPDATE_INDEX_HAS(index, ATTR_TYPE_REACHABLEROUTES) ||
+        UPDATE_INDEX_HAS(index, ATTR_TYPE_WITHDRAWNROUTES)) &&
+        !UPDATE_INDEX_HAS(index, ATTR_TYPE_ADVERTISEMENTPATH))
+    {
+        return ERROR_ATTR_MISSING;
+    }
+
+    if (UPDATE_INDEX_HAS(index, ATTR_TYPE_REACHABLEROUTES) &&
+        !UPDATE_INDEX_HAS(index, ATTR_TYPE_ROUTEDPATH))
+    {
+        return ERROR_ATTR_MISSING;
+    }
+
+    return len;
+}
+
+
 /* attributes */
 
 /* attribute WithdrawnRoutes
@@ -928,3 +1260,40 @@ parse_msg_notif(const void *buff, size_t len,
 }
 
 
+/* names */
+
+uint16_t
+af_from_name(const char *name)
+{
+    for (size_t i = 0; af_names[i].name; i++)
+        if (strcmp(af_names[i].name, name) == 0)
+            return af_names[i].value;
+    return 0;
+}
+
+const char *
+af_name(uint16_t af)
+{
+    for (size_t i = 0; af_names[i].name; i++)
+        if (af_names[i].value == af)
+            return af_names[i].name;
+    return "unknown";
+}
+
+uint16_t
+app_proto_from_name(const char *name)
+{
+    for (size_t i = 0; app_proto_names[i].name; i++)
+        if (strcmp(app_proto_names[i].name, name) == 0)
+            return app_proto_names[i].value;
+    return 0;
+}
+
+const char *
+app_proto_name(uint16_t app_proto)
+{
+    for (size_t i = 0; app_proto_names[i].name; i++)
+        if (app_proto_names[i].value == app_proto)
+            return app_proto_names[i].name;
+    return "unknown";
+}
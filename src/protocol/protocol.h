@@ -25,7 +25,8 @@
 #include <stddef.h>
 
 
-#define MAX_MSG_SIZE    4096
+#define MAX_MSG_SIZE        4096    /* RFC3219 */
+#define MAX_MSG_SIZE_EXT    65535   /* agreed with CAPINFO_CODE_MSGSIZE */
 
 
 /* message header */
@@ -34,15 +35,19 @@ enum msg_type {
     MSG_TYPE_OPEN = 1,
     MSG_TYPE_UPDATE,
     MSG_TYPE_NOTIFICATION,
-    MSG_TYPE_KEEPALIVE
+    MSG_TYPE_KEEPALIVE,
+    MSG_TYPE_REFRESH        /* agreed with CAPINFO_CODE_REFRESH */
 };
 
 typedef struct {
-    uint16_t    msg_len;
+    uint16_t    msg_len;    /* length of msg_val */
     uint8_t     msg_type;
     uint8_t     msg_val[];
 } msg_t;
 
+/* on the wire header length, sizeof(msg_t) includes trailing padding */
+#define MSG_HDR_LEN     offsetof(msg_t, msg_val)
+
 
 /* message OPEN */
 
@@ -69,7 +74,13 @@ typedef struct {
 
 enum capinfo_code {
     CAPINFO_CODE_ROUTETYPE = 1,
-    CAPINFO_CODE_TRANSMODE
+    CAPINFO_CODE_TRANSMODE,
+    /* RFC3219 leaves 32768 and above to vendors, peers that do not know
+     * a vendor capability ignore it */
+    CAPINFO_CODE_VENDOR = 32768,
+    CAPINFO_CODE_MSGSIZE = CAPINFO_CODE_VENDOR,
+    CAPINFO_CODE_COMPRESS,
+    CAPINFO_CODE_REFRESH
 };
 
 typedef struct {
@@ -95,10 +106,28 @@ enum capinfo_transmode {
 
 typedef uint32_t capinfo_transmode_t;
 
+/* largest message, header included, the sender accepts, from MAX_MSG_SIZE
+ * to MAX_MSG_SIZE_EXT, both ends use the smaller of the two */
+typedef uint32_t capinfo_msgsize_t;
+
+/* stream codec the sender can decode, once both ends advertised the same
+ * one everything each sends after its KEEPALIVE answering the OPEN is one
+ * compressed stream, flushed at message boundaries */
+enum capinfo_compress {
+    CAPINFO_COMPRESS_NONE,  /* only for serializer */
+    CAPINFO_COMPRESS_ZLIB
+};
+
+typedef uint32_t capinfo_compress_t;
+
+/* route refresh has no value, the sender answers ROUTE-REFRESH messages */
+
 
 /* message UPDATE
  * unpadded list of attributes
- * attributes defined by RFCs are Well-Known */
+ * attributes defined by RFCs are Well-Known
+ * one without any attribute marks the end of the initial table dump
+ * (end-of-RIB) */
 
 /*
  * attr_flag is a bitfield
@@ -147,6 +176,8 @@ enum attr_type {
     ATTR_TYPE_CARRIER
 };
 
+#define ATTR_TYPE_MAX   ATTR_TYPE_CARRIER
+
 typedef struct {
     uint8_t     attr_flags;
     uint8_t     attr_type;
@@ -308,6 +339,12 @@ typedef uint32_t attr_itadtopology_t[];
  */
 
 
+/* message ROUTE-REFRESH
+ * (empty message) header only, asks the peer to send all its routes again,
+ * ending with an end-of-RIB UPDATE
+ */
+
+
 /* message NOTIFICATION */
 
 enum notif_code {
@@ -375,7 +412,14 @@ typedef enum runtime_errors_e {
     ERROR_ATTR_FLAG_WELL_KNOWN = -19,/* attribute should have well-known */
     ERROR_ATTR_FLAG_LSENCAP = -20,  /* attribute must be link-state encapsul. */
     ERROR_ITADPATH_TYPE = -21,      /* unsupported ITAD path type */
-    ERROR_COMMUNITY_ITAD = -22      /* reserved community ITAD with bad ID */
+    ERROR_COMMUNITY_ITAD = -22,     /* reserved community ITAD with bad ID */
+    ERROR_ATTR_LEN = -23,           /* attribute length inconsistent */
+    ERROR_ATTR_DUP = -24,           /* attribute appears more than once */
+    ERROR_ATTR_MISSING = -25,       /* missing conditionally mandatory attr */
+    ERROR_ROUTES = -26,             /* more routes than the index can hold */
+    ERROR_FSM = -27,                /* message unexpected in session state */
+    ERROR_MSGSIZE = -28,            /* message size capability out of range */
+    ERROR_COMPRESS = -29            /* corrupt compressed stream */
 } runtime_error_t;
 
 extern const char *runtime_error_strs[];
@@ -386,6 +430,13 @@ extern const char *runtime_error_strs[];
 extern const capinfo_routetype_t supported_routetypes[];
 extern const size_t supported_routetypes_size;
 
+/* configuration names of address families and application protocols,
+ * lookups return 0 if unknown */
+uint16_t af_from_name(const char *name);
+const char *af_name(uint16_t af);
+uint16_t app_proto_from_name(const char *name);
+const char *app_proto_name(uint16_t app_proto);
+
 
 /* macros */
 
@@ -394,7 +445,7 @@ extern const size_t supported_routetypes_size;
 #define PROTO_TRY(o, a) \
     r = o; \
     if (r < 0) { \
-        fprintf(stderr, "[DEBUG] %s:%s:%s: %s\n", \
+        fprintf(stderr, "[DEBUG] %s:%s:%d: %s\n", \
             __FILE__, __func__, __LINE__, runtime_error_strs[-r]); \
         a; \
     }
@@ -404,15 +455,21 @@ extern const size_t supported_routetypes_size;
  * sizes are in element count, not bytes
  */
 
+/* capinfo_msgsize 0, CAPINFO_COMPRESS_NONE and capinfo_refresh 0 leave
+ * those capabilities out */
 runtime_error_t new_msg_open(void *buff, size_t len, uint16_t hold,
     uint32_t itad, uint32_t id, const capinfo_routetype_t *capinfo_routetypes,
-    size_t routetypes_size, capinfo_transmode_t capinfo_transmode);
+    size_t routetypes_size, capinfo_transmode_t capinfo_transmode,
+    capinfo_msgsize_t capinfo_msgsize, capinfo_compress_t capinfo_compress,
+    int capinfo_refresh);
 
 runtime_error_t new_msg_update(void *buff, size_t len,
     const msg_update_attr_t **attrs, size_t attrs_size);
 
 runtime_error_t new_msg_keepalive(void *buff, size_t len);
 
+runtime_error_t new_msg_refresh(void *buff, size_t len);
+
 runtime_error_t new_msg_notification(void *buff, size_t len, uint8_t error_code,
     uint8_t error_subcode, size_t datalen, const void *data);
 
@@ -474,11 +531,55 @@ runtime_error_t parse_capinfo_routetype(const void *buff, size_t len,
 runtime_error_t parse_capinfo_transmode(const void *buff, size_t len,
     const capinfo_transmode_t **transmode_out);
 
+runtime_error_t parse_capinfo_msgsize(const void *buff, size_t len,
+    const capinfo_msgsize_t **msgsize_out);
+
+/* unknown codecs are not an error, they are just not used */
+runtime_error_t parse_capinfo_compress(const void *buff, size_t len,
+    const capinfo_compress_t **compress_out);
+
 
 /* message UPDATE
  * list of attributes
  */
 
+/* offset index of a validated UPDATE body, offsets are relative to the start
+ * of msg_val so fields can be read in place from the receive buffer
+ * a route is at least sizeof(route_t), which bounds the route count of a
+ * body, the caller provides route_off for as many as its messages can
+ * carry, an attribute type appears once, which bounds the pass-through
+ * ones */
+
+#define UPDATE_INDEX_ROUTES(len)    ((len) / sizeof(route_t))
+#define UPDATE_INDEX_MAX_PASSTHRU   256
+
+#define UPDATE_INDEX_HAS(idx, type)   (((idx)->attr_present >> (type)) & 1)
+
+typedef struct {
+    uint32_t    attr_present;                   /* bitmask by attr_type */
+    uint16_t    attr_off[ATTR_TYPE_MAX + 1];    /* attribute header */
+    uint16_t    attr_val_off[ATTR_TYPE_MAX + 1];/* attribute value */
+    uint16_t    attr_val_len[ATTR_TYPE_MAX + 1];
+
+    uint16_t    reach_first, reach_size;        /* into route_off */
+    uint16_t    withdrawn_first, withdrawn_size;
+    uint16_t   *route_off;                      /* caller's */
+    size_t      route_capacity;
+
+    /* uninterpreted transitive attributes, to be relayed as they are */
+    uint16_t    passthru_size;
+    uint16_t    passthru_off[UPDATE_INDEX_MAX_PASSTHRU];
+} update_index_t;
+
+/* validates a whole UPDATE body (msg_val, msg_len) in one pass and fills the
+ * caller's index, route_off and route_capacity set by the caller, contents
+ * of Communities, ITADTopology and path segments are only bounds checked
+ * unrecognized attributes are an error only if flagged well-known, other
+ * uninterpreted ones (RFC5115, RFC5140 and unknown) are dropped unless
+ * transitive, then they are indexed in passthru_off */
+runtime_error_t parse_msg_update(const void *buff, size_t len,
+    update_index_t *index);
+
 runtime_error_t parse_msg_update_attr(const void *buff, size_t len,
     const msg_update_attr_t **attr_out);
 
@@ -513,6 +614,11 @@ runtime_error_t parse_itad(const void *buff, size_t len,
  */
 
 
+/* message ROUTE-REFRESH
+ * (empty, no parser)
+ */
+
+
 /* message NOTIFICATION
  */
 
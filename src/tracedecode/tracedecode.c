@@ -0,0 +1,64 @@
+/*
+
+    trip: Modern TRIP LS implementation
+    Copyright (C) 2025 arf20 (Ángel Ruiz Fernandez)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    tracedecode.c: trace dump to Chrome trace-event JSON decoder
+
+*/
+
+#include <functions/trace.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace dump> [json out]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "Error opening trace dump %s: %s\n",
+            argv[1], strerror(errno));
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (argc > 2) {
+        out = fopen(argv[2], "w");
+        if (!out) {
+            fprintf(stderr, "Error opening output %s: %s\n",
+                argv[2], strerror(errno));
+            fclose(in);
+            return 1;
+        }
+    }
+
+    int res = trace_decode_json(in, out);
+    if (res < 0)
+        fprintf(stderr, "Error decoding trace dump %s\n", argv[1]);
+
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+
+    return res < 0 ? 1 : 0;
+}
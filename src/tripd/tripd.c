@@ -23,22 +23,35 @@
 #include <protocol/protocol.h>
 
 #include <command/parser.h>
+#include <functions/trace.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
+#include <signal.h>
 #include <unistd.h>
 
 #define CONFIG_FILE "../tripd.conf"
 
+static volatile sig_atomic_t reload_pending = 0;
+
+static void
+sighup_handler(int sig)
+{
+    reload_pending = 1;
+}
+
 int
 main(int arg, char **argv)
 {
     printf("tripd\n");
 
+    trace_init();
+    trace_thread_name("main");
 
     parser_t *parser = parser_init(stdout);
+    parser->config_path = CONFIG_FILE;
 
     /* read config */
     parser_parse_cmd(parser, "enable");
@@ -53,8 +66,15 @@ main(int arg, char **argv)
     parser_parse_file(parser, conff);
     fclose(conff);
 
+    /* SIGHUP reloads the config, applying only what changed */
+    signal(SIGHUP, &sighup_handler);
+
     while (1) {
         sleep(1000);
+        if (reload_pending) {
+            reload_pending = 0;
+            parser_reload(parser, CONFIG_FILE);
+        }
     }
 
     return 0;